@@ -4,4 +4,12 @@ C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=vert shader/colored_vert.glsl -o
 C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=frag shader/colored_frag.glsl -o shader/colored_frag.spv
 C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=vert shader/standard_vert.glsl -o shader/standard_vert.spv
 C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=frag shader/standard_frag.glsl -o shader/standard_frag.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=comp shader/cull_comp.glsl -o shader/cull_comp.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=vert shader/depth_vert.glsl -o shader/depth_vert.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=comp shader/depth_pyramid_comp.glsl -o shader/depth_pyramid_comp.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=frag shader/standard_gbuffer_frag.glsl -o shader/standard_gbuffer_frag.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=frag shader/colored_gbuffer_frag.glsl -o shader/colored_gbuffer_frag.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=vert shader/deferred_lighting_vert.glsl -o shader/deferred_lighting_vert.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=frag shader/deferred_lighting_frag.glsl -o shader/deferred_lighting_frag.spv
+C:\VulkanSDK\1.2.198.1\Bin\glslc -fshader-stage=vert shader/shadow_vert.glsl -o shader/shadow_vert.spv
 pause
\ No newline at end of file
@@ -1,16 +1,8 @@
 #version 450
+#extension GL_GOOGLE_include_directive : enable
 
-layout(set = 0, binding = 0) uniform UniformBufferObject {
-    mat4 V;
-    mat4 P;
-	mat4 M[16];
-} ubo;
-
-layout( push_constant ) uniform constants
-{
-	uint object_index;
-} PushConstants;
-
+#include "globals.glsl"
+#include "global_vert.glsl"
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec4 inColor;
@@ -20,8 +12,8 @@ layout(location = 0) out vec4 vertexColor;
 layout(location = 1) out vec2 uv;
 
 void main() {
-    mat4 MVP = ubo.P * ubo.V * ubo.M[PushConstants.object_index];
+    mat4 MVP = get_mvp();
     gl_Position = MVP * vec4(inPosition, 1.0);
     vertexColor = inColor;
 	uv = inUv;
-}
\ No newline at end of file
+}
@@ -0,0 +1,25 @@
+#version 450
+
+//what colored_frag.glsl lights, for the deferred lighting pass
+layout(set = 1, binding = 0) uniform MaterialUniformBufferObject {
+    vec4 color;
+} ubo;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+layout(location = 2) out vec4 outMaterial;
+layout(location = 0) in vec4 vertexColor;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec3 vertex_normal;
+layout(location = 3) in vec3 world_position;
+layout(location = 4) in mat3 TBN;
+
+void main() {
+	float roughness = 0.5;
+	float metallic = 0.5;
+
+	//alpha 1 tells the lighting pass the pixel was written, the g-buffer is cleared to 0
+	outAlbedo = vec4(ubo.color.xyz, 1.0);
+	outNormal = vec4(normalize(vertex_normal), 0.0);
+	outMaterial = vec4(roughness, metallic, 0.0, 0.0);
+}
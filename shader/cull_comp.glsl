@@ -0,0 +1,191 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "globals.glsl"
+
+//see GpuCulling
+layout(local_size_x = 64) in;
+
+struct CullObject {
+	vec4 bounds;
+	uint object_index;
+	uint batch;
+	uint first_command;
+	uint index_count;
+	uint first_index;
+	int vertex_offset;
+	uint padding0;
+	uint padding1;
+};
+
+//VkDrawIndexedIndirectCommand
+struct DrawCommand {
+	uint index_count;
+	uint instance_count;
+	uint first_index;
+	int vertex_offset;
+	uint first_instance;
+};
+
+layout(std430, set = 0, binding = 2) writeonly buffer InstanceBuffer {
+	uint object_indices[];
+} instance_data;
+
+layout(std430, set = 1, binding = 0) readonly buffer CullObjects {
+	CullObject objects[];
+} cull_data;
+
+layout(std430, set = 1, binding = 1) writeonly buffer DrawCommands {
+	DrawCommand commands[];
+} draw_data;
+
+layout(std430, set = 1, binding = 2) buffer DrawCounts {
+	uint counts[];
+} draw_counts;
+
+layout(std430, set = 1, binding = 3) buffer Visibility {
+	uint visible[];
+} visibility;
+
+layout(std430, set = 1, binding = 4) buffer OcclusionStats {
+	uint tested;
+	uint frustum_culled;
+	uint occluded;
+	uint visible;
+	uint late_draws;
+} stats;
+
+layout(set = 1, binding = 5) uniform sampler2D depth_pyramid;
+
+const uint PHASE_EARLY = 0;
+
+layout(push_constant) uniform constants {
+	uint object_count;
+	uint compact;
+	uint phase;
+	uint command_offset;
+	uint count_offset;
+	uint pyramid_width;
+	uint pyramid_height;
+	uint pyramid_levels;
+} params;
+
+//frustum planes are sums of the rows of the view projection matrix, with vulkan's 0..1 depth
+bool is_in_frustum(vec3 center, float radius) {
+	mat4 rows = transpose(globals.P * globals.V);
+	vec4 planes[6] = vec4[6](
+		rows[3] + rows[0],
+		rows[3] - rows[0],
+		rows[3] + rows[1],
+		rows[3] - rows[1],
+		rows[2],
+		rows[3] - rows[2]
+	);
+
+	for (int i = 0; i < 6; i++) {
+		vec4 plane = planes[i] / length(planes[i].xyz);
+		if (dot(plane.xyz, center) + plane.w < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//tests the screen rectangle of the sphere's bounding box against the depth pyramid. the level
+//is picked so the rectangle covers at most 2x2 texels, each holding the farthest depth under
+//it, so the sphere is hidden if its nearest point is behind all four
+bool is_occluded(vec3 center, float radius) {
+	mat4 VP = globals.P * globals.V;
+	vec2 uv_min = vec2(1.0);
+	vec2 uv_max = vec2(0.0);
+	float nearest = 1.0;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = VP * vec4(corner, 1.0);
+		//crosses the near plane, too close to say
+		if (clip.w <= 0.0 || clip.z < 0.0) {
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		vec2 uv = ndc.xy * 0.5 + 0.5;
+		uv_min = min(uv_min, uv);
+		uv_max = max(uv_max, uv);
+		nearest = min(nearest, ndc.z);
+	}
+	uv_min = clamp(uv_min, 0.0, 1.0);
+	uv_max = clamp(uv_max, 0.0, 1.0);
+
+	vec2 size = (uv_max - uv_min) * vec2(params.pyramid_width, params.pyramid_height);
+	float level = ceil(log2(max(max(size.x, size.y), 1.0)));
+	int lod = int(min(level, float(params.pyramid_levels - 1)));
+
+	ivec2 level_size = textureSize(depth_pyramid, lod);
+	ivec2 first = clamp(ivec2(uv_min * vec2(level_size)), ivec2(0), level_size - 1);
+	ivec2 last = clamp(ivec2(uv_max * vec2(level_size)), ivec2(0), level_size - 1);
+	float farthest = 0.0;
+	for (int y = first.y; y <= last.y; y++) {
+		for (int x = first.x; x <= last.x; x++) {
+			farthest = max(farthest, texelFetch(depth_pyramid, ivec2(x, y), lod).r);
+		}
+	}
+	return nearest > farthest;
+}
+
+void main() {
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= params.object_count) {
+		return;
+	}
+
+	CullObject object = cull_data.objects[index];
+	mat4 M = object_data.objects[object.object_index].M;
+	vec3 center = vec3(M * vec4(object.bounds.xyz, 1.0));
+	float radius = object.bounds.w * max(length(M[0].xyz), max(length(M[1].xyz), length(M[2].xyz)));
+
+	bool in_frustum = is_in_frustum(center, radius);
+	bool was_visible = visibility.visible[index] != 0;
+
+	//the early phase draws what was visible last time. the late phase draws what is visible
+	//now and wasn't drawn early, and remembers it for next time
+	bool draw;
+	if (params.phase == PHASE_EARLY) {
+		draw = in_frustum && was_visible;
+	}
+	else {
+		bool occluded = in_frustum && is_occluded(center, radius);
+		bool visible = in_frustum && !occluded;
+		draw = visible && !was_visible;
+		visibility.visible[index] = visible ? 1 : 0;
+
+		atomicAdd(stats.tested, 1);
+		if (!in_frustum) {
+			atomicAdd(stats.frustum_culled, 1);
+		}
+		if (occluded) {
+			atomicAdd(stats.occluded, 1);
+		}
+		if (visible) {
+			atomicAdd(stats.visible, 1);
+		}
+		if (draw) {
+			atomicAdd(stats.late_draws, 1);
+		}
+	}
+
+	//compacted, drawn objects are packed at the front of their batch and counted.
+	//otherwise every object keeps its own slot and the others draw no instances
+	uint slot = params.command_offset + index;
+	if (params.compact != 0) {
+		if (!draw) {
+			return;
+		}
+		slot = params.command_offset + object.first_command + atomicAdd(draw_counts.counts[params.count_offset + object.batch], 1);
+	}
+
+	draw_data.commands[slot].index_count = object.index_count;
+	draw_data.commands[slot].instance_count = draw ? 1 : 0;
+	draw_data.commands[slot].first_index = object.first_index;
+	draw_data.commands[slot].vertex_offset = object.vertex_offset;
+	draw_data.commands[slot].first_instance = slot;
+	instance_data.object_indices[slot] = object.object_index;
+}
@@ -0,0 +1,45 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "globals.glsl"
+#include "lighting.glsl"
+
+//written by the g-buffer pass, see the materials' _gbuffer fragment shaders
+layout(set = 1, binding = 0) uniform sampler2D albedo_buffer;
+layout(set = 1, binding = 1) uniform sampler2D normal_buffer;
+layout(set = 1, binding = 2) uniform sampler2D material_buffer;
+layout(set = 1, binding = 3) uniform sampler2D depth_buffer;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(depth_buffer, texel, 0).r;
+	vec4 albedo_alpha = texelFetch(albedo_buffer, texel, 0);
+	//nothing was drawn here, or only a forward material's depth by the prepass. the clear
+	//color stays and the forward pass draws on top
+	if (depth >= 1.0 || albedo_alpha.a == 0.0) {
+		discard;
+	}
+
+	float ambientStrength = 0.002;
+	vec3 ambient_color = vec3(1,1,1);
+
+	vec3 albedo = albedo_alpha.xyz;
+	vec2 material = texelFetch(material_buffer, texel, 0).xy;
+
+	//back from the depth buffer to where the fragment was in the world
+	vec2 ndc = gl_FragCoord.xy / vec2(textureSize(depth_buffer, 0)) * 2.0 - 1.0;
+	vec4 world_position = globals.inverse_VP * vec4(ndc, depth, 1.0);
+
+	LightingData light_data;
+	light_data.world_pos = world_position.xyz / world_position.w;
+	light_data.roughness = material.x;
+	light_data.metallic = material.y;
+	light_data.albedo = albedo;
+	light_data.normal = texelFetch(normal_buffer, texel, 0).xyz;
+
+	vec3 ambient = ambientStrength * ambient_color;
+	vec3 direct = lighting_direct(light_data);
+	outColor = vec4(albedo * ambient + direct, 1.0);
+}
@@ -0,0 +1,32 @@
+#version 450
+
+//one level of the depth pyramid, see DepthPyramid
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D destination;
+
+layout(push_constant) uniform constants {
+	uvec2 source_size;
+	uvec2 size;
+} params;
+
+void main() {
+	uvec2 position = gl_GlobalInvocationID.xy;
+	if (any(greaterThanEqual(position, params.size))) {
+		return;
+	}
+
+	//the farthest depth of every source texel this one covers. level 0 doesn't halve the
+	//depth buffer evenly, so that can be up to 3x3 texels
+	uvec2 first = position * params.source_size / params.size;
+	uvec2 last = min(((position + 1) * params.source_size + params.size - 1) / params.size, params.source_size) - 1;
+
+	float depth = 0.0;
+	for (uint y = first.y; y <= last.y; y++) {
+		for (uint x = first.x; x <= last.x; x++) {
+			depth = max(depth, texelFetch(source, ivec2(x, y), 0).r);
+		}
+	}
+	imageStore(destination, ivec2(position), vec4(depth));
+}
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "globals.glsl"
+#include "global_vert.glsl"
+
+//depth prepass, no fragment shader. the position has to be computed exactly like the
+//material vertex shaders do it
+layout(location = 0) in vec3 inPosition;
+
+void main() {
+    mat4 MVP = get_mvp();
+    gl_Position = MVP * vec4(inPosition, 1.0);
+}
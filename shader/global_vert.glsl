@@ -1,14 +1,23 @@
-layout( push_constant ) uniform constants
-{
-	uint object_index;
-} PushConstants;
+//the depth prepass only lets fragments through that land on exactly the depth it wrote,
+//so every vertex shader has to compute the same position bit for bit
+invariant gl_Position;
+
+layout(std430, set = 0, binding = 2) readonly buffer InstanceBuffer {
+	uint object_indices[];
+} instance_data;
+
+//gl_InstanceIndex starts at the draw's firstInstance, which is where the renderer put
+//the object indices of this batch
+uint get_object_index() {
+	return instance_data.object_indices[gl_InstanceIndex];
+}
 
 mat4 get_mvp() {
-	return globals.P * globals.V * globals.M[PushConstants.object_index];
+	return globals.P * globals.V * object_data.objects[get_object_index()].M;
 }
 
 mat4 get_m() {
-	return globals.M[PushConstants.object_index];
+	return object_data.objects[get_object_index()].M;
 }
 
 mat3 get_tbn(vec3 norm, vec3 tan) {
@@ -17,4 +26,4 @@ mat3 get_tbn(vec3 norm, vec3 tan) {
 	vec3 N = normalize(vec3(M * vec4(norm, 0.0)));
 	vec3 B = cross(N, T);
 	return mat3(T, B, N);
-}
\ No newline at end of file
+}
@@ -1,14 +1,19 @@
-struct LightData {
-	mat4 M;
-	vec4 color;
-};
-
 layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 V;
     mat4 P;
-	mat4 M[256];
 	vec3 camera_position;
-	LightData lights[16];
-	uint num_lights;
-	
-} globals;
\ No newline at end of file
+	//clusters x, y and depth, light count
+	uvec4 cluster_grid;
+	//cluster size in pixels, scale and bias from log view depth to depth slice
+	vec4 cluster_params;
+	//clip space back to world space, for positions rebuilt from depth
+	mat4 inverse_VP;
+} globals;
+
+struct ObjectData {
+	mat4 M;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer {
+	ObjectData objects[];
+} object_data;
@@ -1,5 +1,78 @@
 #define PI 3.1415926538
 
+//clustered lights, see light_clusters.h
+struct LightRecord {
+	vec3 position;
+	float range;
+	vec3 color;
+	uint type;
+};
+
+struct ClusterRecord {
+	uint offset;
+	uint count;
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer LightBuffer {
+	LightRecord lights[];
+} light_data;
+
+layout(std430, set = 0, binding = 4) readonly buffer ClusterBuffer {
+	ClusterRecord clusters[];
+} cluster_data;
+
+layout(std430, set = 0, binding = 5) readonly buffer LightIndexBuffer {
+	uint indices[];
+} light_index_data;
+
+//point light shadows, see shadow_atlas.h. indexed like light_data.lights
+struct ShadowRecord {
+	mat4 view_projection[6];
+	vec4 rects[6];
+};
+
+layout(std430, set = 0, binding = 6) readonly buffer ShadowBuffer {
+	ShadowRecord shadows[];
+} shadow_data;
+
+layout(set = 0, binding = 7) uniform sampler2DShadow shadow_atlas;
+
+//1 where the light reaches the position, 0 in its shadow
+float shadow_factor(uint light_index, vec3 world_pos, vec3 light_pos) {
+	//the cube face the light sees the position through, +x -x +y -y +z -z
+	vec3 direction = world_pos - light_pos;
+	vec3 extent = abs(direction);
+	uint face;
+	if (extent.x >= extent.y && extent.x >= extent.z) {
+		face = direction.x >= 0.0 ? 0u : 1u;
+	}
+	else if (extent.y >= extent.z) {
+		face = direction.y >= 0.0 ? 2u : 3u;
+	}
+	else {
+		face = direction.z >= 0.0 ? 4u : 5u;
+	}
+
+	vec4 rect = shadow_data.shadows[light_index].rects[face];
+	if (rect.z == 0.0) {
+		return 1.0;
+	}
+	vec4 clip = shadow_data.shadows[light_index].view_projection[face] * vec4(world_pos, 1.0);
+	vec3 ndc = clip.xyz / clip.w;
+
+	//2x2 taps, kept inside the tile so the neighbouring tiles don't bleed in
+	vec2 texel = 1.0 / vec2(textureSize(shadow_atlas, 0));
+	vec2 uv = rect.xy + (ndc.xy * 0.5 + 0.5) * rect.zw;
+	vec2 uv_min = rect.xy + texel * 0.5;
+	vec2 uv_max = rect.xy + rect.zw - texel * 0.5;
+	float lit = 0.0;
+	for (int i = 0; i < 4; i++) {
+		vec2 offset = vec2(i & 1, i >> 1) - 0.5;
+		lit += texture(shadow_atlas, vec3(clamp(uv + offset * texel, uv_min, uv_max), ndc.z));
+	}
+	return lit * 0.25;
+}
+
 vec3 fresnelSchlick(float cosTheta, vec3 F0)
 {
     return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
@@ -56,19 +129,32 @@ vec3 lighting_direct(LightingData data) {
 	vec3 V = normalize(camera_pos - data.world_pos);
 	vec3 N = normalize(data.normal);
 	
+	//the cluster this fragment is in
+	uvec4 grid = globals.cluster_grid;
+	vec4 params = globals.cluster_params;
+	float view_depth = -(globals.V * vec4(data.world_pos, 1.0)).z;
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / params.xy), grid.xy - 1);
+	uint slice = min(uint(max(log(view_depth) * params.z + params.w, 0.0)), grid.z - 1);
+	ClusterRecord cluster = cluster_data.clusters[tile.x + grid.x * (tile.y + grid.y * slice)];
+	
 	vec3 Lo = vec3(0);
 	//per-light from here
-	for (int i = 0; i < globals.num_lights; i++) {
-		vec3 light_color = globals.lights[i].color.xyz;
-		vec3 light_pos = vec3(globals.lights[i].M * vec4(0,0,0,1.0));
+	for (uint i = 0; i < cluster.count; i++) {
+		uint light_index = light_index_data.indices[cluster.offset + i];
+		LightRecord light = light_data.lights[light_index];
+		vec3 light_color = light.color;
+		vec3 light_pos = light.position;
 	
 		vec3 L = normalize(light_pos - data.world_pos);
 		vec3 H = normalize(V + L);
 		
 		
+		//inverse square, windowed to reach zero at the light's range
 		float distance    = length(light_pos - data.world_pos);
-		float attenuation = 1.0 / (distance * distance);
-		vec3 radiance     = light_color * attenuation;        
+		float ratio       = distance / light.range;
+		float window      = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+		float attenuation = window * window / max(distance * distance, 0.0001);
+		vec3 radiance     = light_color * attenuation * shadow_factor(light_index, data.world_pos, light_pos);
 		
 		// cook-torrance brdf
 		float NDF = DistributionGGX(N, H, data.roughness);        
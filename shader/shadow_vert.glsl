@@ -0,0 +1,24 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+
+#include "globals.glsl"
+
+//shadow casters drawn into one tile of the shadow atlas, no fragment shader. see shadow_atlas.h
+layout(std430, set = 1, binding = 0) readonly buffer ShadowViewBuffer {
+	mat4 view_projections[];
+} shadow_views;
+
+layout(std430, set = 1, binding = 1) readonly buffer ShadowInstanceBuffer {
+	uint object_indices[];
+} shadow_instances;
+
+layout(push_constant) uniform ShadowConstants {
+	uint view;
+} constants;
+
+layout(location = 0) in vec3 inPosition;
+
+void main() {
+    mat4 M = object_data.objects[shadow_instances.object_indices[gl_InstanceIndex]].M;
+    gl_Position = shadow_views.view_projections[constants.view] * M * vec4(inPosition, 1.0);
+}
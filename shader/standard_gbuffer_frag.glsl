@@ -0,0 +1,36 @@
+#version 450
+
+//what standard_frag.glsl lights, for the deferred lighting pass
+layout(set = 1, binding = 0) uniform MaterialUniformBufferObject {
+    float roughness;
+} ubo;
+layout(set = 1, binding = 1) uniform sampler2D albedoTex;
+layout(set = 1, binding = 2) uniform sampler2D normalTex;
+layout(set = 1, binding = 3) uniform sampler2D prbMapTex;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+layout(location = 2) out vec4 outMaterial;
+layout(location = 0) in vec4 vertexColor;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec3 vertex_normal;
+layout(location = 3) in vec3 world_position;
+layout(location = 4) in mat3 TBN;
+
+//takes in normal in tangent space and return world space normalized
+vec3 decode_normal(vec4 tex) {
+	vec3 norm = tex.xyz * 2.0 - 1.0;
+	return -normalize(TBN * norm);
+}
+
+void main() {
+	vec3 albedo = texture(albedoTex, uv).xyz;
+	vec3 normal = decode_normal(texture(normalTex, uv));
+	float roughness = 0.5;//pbr.x;
+	float metallic = 0.0;
+
+	//alpha 1 tells the lighting pass the pixel was written, the g-buffer is cleared to 0
+	outAlbedo = vec4(albedo, 1.0);
+	outNormal = vec4(normal, 0.0);
+	outMaterial = vec4(roughness, metallic, 0.0, 0.0);
+}
@@ -0,0 +1,298 @@
+#include "allocator.h"
+#include "log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void RangeAllocator::init(vk::DeviceSize size) {
+    capacity = size;
+    used = 0;
+    free_ranges.clear();
+    free_ranges.push_back({ 0, size });
+}
+
+vk::DeviceSize RangeAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    for (size_t i = 0; i < free_ranges.size(); i++) {
+        Range range = free_ranges[i];
+        vk::DeviceSize aligned = align_up(range.offset, alignment);
+        vk::DeviceSize padding = aligned - range.offset;
+        if (padding + size > range.size) {
+            continue;
+        }
+
+        vk::DeviceSize tail = range.size - padding - size;
+
+        //the alignment padding stays in the free list as its own range
+        if (padding > 0 && tail > 0) {
+            free_ranges[i].size = padding;
+            free_ranges.insert(free_ranges.begin() + i + 1, Range{ aligned + size, tail });
+        }
+        else if (padding > 0) {
+            free_ranges[i].size = padding;
+        }
+        else if (tail > 0) {
+            free_ranges[i] = Range{ aligned + size, tail };
+        }
+        else {
+            free_ranges.erase(free_ranges.begin() + i);
+        }
+
+        used += size;
+        return aligned;
+    }
+
+    return INVALID_OFFSET;
+}
+
+void RangeAllocator::free(vk::DeviceSize offset, vk::DeviceSize size) {
+    auto next = std::lower_bound(free_ranges.begin(), free_ranges.end(), offset,
+        [](const Range& range, vk::DeviceSize value) { return range.offset < value; });
+
+    bool merge_prev = next != free_ranges.begin() && (next - 1)->offset + (next - 1)->size == offset;
+    bool merge_next = next != free_ranges.end() && offset + size == next->offset;
+
+    if (merge_prev && merge_next) {
+        (next - 1)->size += size + next->size;
+        free_ranges.erase(next);
+    }
+    else if (merge_prev) {
+        (next - 1)->size += size;
+    }
+    else if (merge_next) {
+        next->offset = offset;
+        next->size += size;
+    }
+    else {
+        free_ranges.insert(next, Range{ offset, size });
+    }
+
+    used -= size;
+}
+
+void RangeAllocator::grow(vk::DeviceSize new_capacity) {
+    if (new_capacity <= capacity) {
+        return;
+    }
+
+    if (!free_ranges.empty() && free_ranges.back().offset + free_ranges.back().size == capacity) {
+        free_ranges.back().size += new_capacity - capacity;
+    }
+    else {
+        free_ranges.push_back(Range{ capacity, new_capacity - capacity });
+    }
+    capacity = new_capacity;
+}
+
+vk::DeviceSize RangeAllocator::largest_free_range() const {
+    vk::DeviceSize largest = 0;
+    for (const auto& range : free_ranges) {
+        largest = std::max(largest, range.size);
+    }
+    return largest;
+}
+
+void MemoryAllocator::init(vk::PhysicalDevice physical_device, vk::Device dev) {
+    TRACE("initializing memory allocator")
+    device = dev;
+    memory_properties = physical_device.getMemoryProperties();
+
+    pools.resize(memory_properties.memoryTypeCount * 2);
+    for (uint32_t type = 0; type < memory_properties.memoryTypeCount; type++) {
+        //don't let a single block eat a large part of a small heap (eg. 256MB BAR memory)
+        auto heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[type].heapIndex].size;
+        vk::DeviceSize block_size = std::min(DEFAULT_BLOCK_SIZE, heap_size / 8);
+
+        for (uint32_t kind = 0; kind < 2; kind++) {
+            auto& pool = pools[type * 2 + kind];
+            pool.memory_type = type;
+            pool.linear = kind == 0;
+            pool.block_size = block_size;
+        }
+    }
+}
+
+uint32_t MemoryAllocator::find_memory_type(uint32_t type_filter, vk::MemoryPropertyFlags props) const {
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        if (type_filter & (1 << i) &&
+            (memory_properties.memoryTypes[i].propertyFlags & props) == props) {
+            return i;
+        }
+    }
+    throw std::runtime_error("requested memory type not found");
+}
+
+uint32_t MemoryAllocator::create_block(MemoryPool& pool, vk::DeviceSize size, bool dedicated) {
+    vk::MemoryAllocateInfo alloc_info(size, pool.memory_type);
+
+    MemoryBlock block;
+    block.memory = device.allocateMemory(alloc_info);
+    block.ranges.init(size);
+    block.dedicated = dedicated;
+
+    auto flags = memory_properties.memoryTypes[pool.memory_type].propertyFlags;
+    if (flags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        block.mapped = device.mapMemory(block.memory, 0, VK_WHOLE_SIZE);
+    }
+
+    //reuse the slot of a block that was released earlier so Allocation::block stays valid
+    for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+        if (pool.blocks[i].memory == vk::DeviceMemory(nullptr)) {
+            pool.blocks[i] = std::move(block);
+            return i;
+        }
+    }
+
+    pool.blocks.push_back(std::move(block));
+    return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+Allocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear) {
+    uint32_t memory_type = find_memory_type(requirements.memoryTypeBits, properties);
+    uint32_t pool_index = memory_type * 2 + (linear ? 0 : 1);
+    auto& pool = pools[pool_index];
+
+    Allocation allocation;
+    allocation.pool = pool_index;
+    allocation.size = requirements.size;
+
+    //big resources (4k textures, large vertex buffers) get a block of their own
+    //rather than fragmenting the shared blocks
+    if (requirements.size > pool.block_size / 2) {
+        allocation.block = create_block(pool, requirements.size, true);
+        auto& block = pool.blocks[allocation.block];
+        allocation.offset = block.ranges.allocate(requirements.size, 1);
+        allocation.memory = block.memory;
+        allocation.mapped = block.mapped;
+        block.allocation_count++;
+        return allocation;
+    }
+
+    for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+        auto& block = pool.blocks[i];
+        if (block.memory == vk::DeviceMemory(nullptr) || block.dedicated) {
+            continue;
+        }
+
+        auto offset = block.ranges.allocate(requirements.size, requirements.alignment);
+        if (offset != RangeAllocator::INVALID_OFFSET) {
+            block.allocation_count++;
+            allocation.memory = block.memory;
+            allocation.offset = offset;
+            allocation.block = i;
+            if (block.mapped != nullptr) {
+                allocation.mapped = static_cast<char*>(block.mapped) + offset;
+            }
+            return allocation;
+        }
+    }
+
+    allocation.block = create_block(pool, pool.block_size, false);
+    auto& block = pool.blocks[allocation.block];
+    allocation.offset = block.ranges.allocate(requirements.size, requirements.alignment);
+    allocation.memory = block.memory;
+    if (block.mapped != nullptr) {
+        allocation.mapped = static_cast<char*>(block.mapped) + allocation.offset;
+    }
+    block.allocation_count++;
+
+    return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation) {
+    if (!allocation.is_valid()) {
+        return;
+    }
+
+    auto& pool = pools.at(allocation.pool);
+    auto& block = pool.blocks.at(allocation.block);
+    block.ranges.free(allocation.offset, allocation.size);
+    block.allocation_count--;
+
+    //keep one empty shared block around per pool so alloc/free churn doesn't hit the driver
+    if (block.allocation_count == 0) {
+        bool release = block.dedicated;
+        if (!release) {
+            for (uint32_t i = 0; i < pool.blocks.size(); i++) {
+                const auto& other = pool.blocks[i];
+                if (i != allocation.block && other.memory != vk::DeviceMemory(nullptr) && !other.dedicated && other.allocation_count == 0) {
+                    release = true;
+                    break;
+                }
+            }
+        }
+
+        if (release) {
+            if (block.mapped != nullptr) {
+                device.unmapMemory(block.memory);
+                block.mapped = nullptr;
+            }
+            device.freeMemory(block.memory);
+            block.memory = nullptr;
+        }
+    }
+
+    allocation = Allocation{};
+}
+
+std::vector<MemoryBlockStats> MemoryAllocator::get_stats() const {
+    std::vector<MemoryBlockStats> stats;
+    for (const auto& pool : pools) {
+        for (const auto& block : pool.blocks) {
+            if (block.memory == vk::DeviceMemory(nullptr)) {
+                continue;
+            }
+            stats.push_back(MemoryBlockStats{
+                pool.memory_type,
+                pool.linear,
+                block.dedicated,
+                block.ranges.get_capacity(),
+                block.ranges.get_used(),
+                block.allocation_count,
+                block.ranges.free_range_count(),
+                block.ranges.largest_free_range()
+            });
+        }
+    }
+    return stats;
+}
+
+void MemoryAllocator::print_stats() const {
+    auto stats = get_stats();
+    vk::DeviceSize total_size = 0;
+    vk::DeviceSize total_used = 0;
+    uint32_t total_allocations = 0;
+
+    for (const auto& block : stats) {
+        DEBUG("memory block type " << block.memory_type
+            << (block.linear ? " linear" : " optimal")
+            << (block.dedicated ? " dedicated" : "")
+            << ": " << block.used << "/" << block.size << " bytes, "
+            << block.allocation_count << " allocations, "
+            << block.free_range_count << " free ranges, largest " << block.largest_free_range)
+        total_size += block.size;
+        total_used += block.used;
+        total_allocations += block.allocation_count;
+    }
+
+    DEBUG(stats.size() << " memory blocks, " << total_allocations << " allocations, "
+        << total_used << "/" << total_size << " bytes used")
+}
+
+void MemoryAllocator::close() {
+    for (auto& pool : pools) {
+        for (auto& block : pool.blocks) {
+            if (block.memory != vk::DeviceMemory(nullptr)) {
+                if (block.allocation_count > 0) {
+                    DEBUG("memory block type " << pool.memory_type << " still has " << block.allocation_count << " allocations on close")
+                }
+                if (block.mapped != nullptr) {
+                    device.unmapMemory(block.memory);
+                    block.mapped = nullptr;
+                }
+                device.freeMemory(block.memory);
+                block.memory = nullptr;
+            }
+        }
+        pool.blocks.clear();
+    }
+}
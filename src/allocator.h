@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+
+inline vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment) {
+    if (alignment <= 1) {
+        return value;
+    }
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+//first-fit free list over [0, capacity). freed ranges are merged with their neighbours
+class RangeAllocator {
+public:
+    static constexpr vk::DeviceSize INVALID_OFFSET = ~vk::DeviceSize(0);
+
+    void init(vk::DeviceSize capacity);
+    vk::DeviceSize allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+    void free(vk::DeviceSize offset, vk::DeviceSize size);
+    //extends the range to [0, capacity), existing allocations keep their offsets
+    void grow(vk::DeviceSize capacity);
+
+    vk::DeviceSize get_capacity() const {
+        return capacity;
+    }
+    vk::DeviceSize get_used() const {
+        return used;
+    }
+    bool is_empty() const {
+        return used == 0;
+    }
+    uint32_t free_range_count() const {
+        return static_cast<uint32_t>(free_ranges.size());
+    }
+    vk::DeviceSize largest_free_range() const;
+
+private:
+    struct Range {
+        vk::DeviceSize offset;
+        vk::DeviceSize size;
+    };
+
+    //sorted by offset
+    std::vector<Range> free_ranges;
+    vk::DeviceSize capacity = 0;
+    vk::DeviceSize used = 0;
+};
+
+struct Allocation {
+    vk::DeviceMemory memory = nullptr;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    uint32_t pool = 0;
+    uint32_t block = 0;
+    //points into the persistently mapped block for host visible memory, nullptr otherwise
+    void* mapped = nullptr;
+
+    bool is_valid() const {
+        return memory != vk::DeviceMemory(nullptr);
+    }
+};
+
+struct MemoryBlockStats {
+    uint32_t memory_type;
+    bool linear;
+    bool dedicated;
+    vk::DeviceSize size;
+    vk::DeviceSize used;
+    uint32_t allocation_count;
+    uint32_t free_range_count;
+    vk::DeviceSize largest_free_range;
+};
+
+//hands out sub-ranges of large vk::DeviceMemory blocks, one set of blocks per memory type.
+//buffers and optimal-tiling images are kept in separate blocks so we never have to
+//worry about bufferImageGranularity between neighbouring allocations.
+//host visible blocks stay mapped, so Allocation::mapped can be written at any time
+class MemoryAllocator {
+public:
+    static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024;
+
+    void init(vk::PhysicalDevice physical_device, vk::Device device);
+    void close();
+
+    //linear is true for buffers, false for optimal-tiling images
+    Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear);
+    void free(Allocation& allocation);
+
+    std::vector<MemoryBlockStats> get_stats() const;
+    void print_stats() const;
+
+private:
+    struct MemoryBlock {
+        vk::DeviceMemory memory = nullptr;
+        //host visible blocks are mapped once for their whole lifetime
+        void* mapped = nullptr;
+        RangeAllocator ranges;
+        uint32_t allocation_count = 0;
+        bool dedicated = false;
+    };
+
+    struct MemoryPool {
+        uint32_t memory_type = 0;
+        bool linear = true;
+        vk::DeviceSize block_size = DEFAULT_BLOCK_SIZE;
+        std::vector<MemoryBlock> blocks;
+    };
+
+    vk::Device device = nullptr;
+    vk::PhysicalDeviceMemoryProperties memory_properties;
+
+    //indexed by memory_type * 2 + (linear ? 0 : 1)
+    std::vector<MemoryPool> pools;
+
+    uint32_t find_memory_type(uint32_t type_filter, vk::MemoryPropertyFlags props) const;
+    uint32_t create_block(MemoryPool& pool, vk::DeviceSize size, bool dedicated);
+};
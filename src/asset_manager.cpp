@@ -1,8 +1,10 @@
 #include "asset_manager.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <thread>
 
 const std::string AssetManager::ASSETS_FILE_PATH = "assets/assets.json";
 
@@ -77,6 +79,32 @@ Model* AssetManager::get_model(const std::string& name)
 	return res;
 }
 
+PotentiallyVisibleSet* AssetManager::get_pvs(const std::string& name, const PvsSettings& settings)
+{
+	auto model = get_model(name);
+	if (model->pvs != nullptr) {
+		return model->pvs.get();
+	}
+
+	std::string path = models[name].path + ".pvs";
+	auto pvs = PotentiallyVisibleSet::load(path);
+	if (pvs != nullptr && !pvs->matches(*model, settings)) {
+		std::cout << "pvs of model " << name << " is out of date" << std::endl;
+		pvs = nullptr;
+	}
+
+	if (pvs == nullptr) {
+		std::cout << "baking pvs of model " << name << std::endl;
+		WorkerPool workers;
+		workers.init(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+		pvs = PotentiallyVisibleSet::bake(*model, workers, settings);
+		pvs->save(path);
+	}
+
+	model->pvs = std::move(pvs);
+	return model->pvs.get();
+}
+
 void AssetManager::close()
 {
 	textures.clear();
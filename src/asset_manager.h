@@ -33,6 +33,9 @@ public:
 	void register_texture(const std::string &name, const std::string& path, ColorSpace color_space);
 	Texture* get_texture(const std::string& name);
 	Model* get_model(const std::string& name);
+	//the model's pvs, read from <model path>.pvs or baked and saved there if that is
+	//missing or out of date
+	PotentiallyVisibleSet* get_pvs(const std::string& name, const PvsSettings& settings = {});
 	void close();
 private:
 	static const std::string ASSETS_FILE_PATH;
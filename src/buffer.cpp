@@ -1,5 +1,8 @@
 #include "buffer.h"
 #include "log.h"
+#include "upload.h"
+
+#include <stdexcept>
 
 void Buffer::init(vk::DeviceSize size, vk::BufferUsageFlags usage_flags, vk::MemoryPropertyFlags properties) {
 
@@ -13,38 +16,41 @@ void Buffer::init(vk::DeviceSize size, vk::BufferUsageFlags usage_flags, vk::Mem
     buffer = context.device.createBuffer(buffer_info);
 
     auto memory_reqs = context.device.getBufferMemoryRequirements(buffer);
-    auto memory_type = context.find_memory_type(memory_reqs.memoryTypeBits, properties);
-    vk::MemoryAllocateInfo alloc_info(memory_reqs.size, memory_type);
-
-    memory = context.device.allocateMemory(alloc_info);
-    context.device.bindBufferMemory(buffer, memory, 0);
+    allocation = context.allocator.allocate(memory_reqs, properties, true);
+    context.device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
 }
 
-void Buffer::copy(vk::CommandPool &command_pool, Buffer &dest) {
-    auto command = OneTimeSubmitCommand::create(context);
+void Buffer::copy(vk::CommandBuffer command_buffer, Buffer &dest) {
     vk::BufferCopy copy_info(0, 0, size);
-    command.buffer.copyBuffer(buffer, dest.buffer, 1, &copy_info);
-    command.execute();
+    command_buffer.copyBuffer(buffer, dest.buffer, 1, &copy_info);
 }
 
-Buffer Buffer::get_staging() {
-    Buffer staging(context);
-    staging.init(size,
-                vk::BufferUsageFlagBits::eTransferSrc,
-                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-
-    return std::move(staging);
+uint64_t Buffer::upload(const void* src) {
+    return context.upload_queue->upload_buffer(src, size, buffer, 0);
 }
 
 void Buffer::store(const void* src) {
-    void *data = context.device.mapMemory(memory, 0, size);
-    memcpy(data, src, (size_t)size);
-    context.device.unmapMemory(memory);
+    store(src, size, 0);
+}
+
+void Buffer::store(const void* src, vk::DeviceSize length, vk::DeviceSize offset) {
+    if (offset + length > size) {
+        throw std::out_of_range("buffer store past the end of the buffer");
+    }
+    memcpy(static_cast<char*>(data()) + offset, src, (size_t)length);
+}
+
+void* Buffer::data() {
+    if (allocation.mapped == nullptr) {
+        throw std::runtime_error("tried to write to a buffer that isn't host visible");
+    }
+    return allocation.mapped;
 }
 
 void Buffer::close() {
     if (buffer != vk::Buffer(nullptr)) {
         context.device.destroyBuffer(buffer);
-        context.device.freeMemory(memory);
+        context.allocator.free(allocation);
+        buffer = nullptr;
     }    
 }
\ No newline at end of file
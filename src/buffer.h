@@ -6,27 +6,27 @@
 class Buffer {
 public:
     vk::Buffer buffer;
-    vk::DeviceMemory memory;
+    Allocation allocation;
     vk::DeviceSize size;
 
-    Buffer(Context& ctx) : context(ctx), buffer(nullptr), memory(nullptr), size(0) {}
+    Buffer(Context& ctx) : context(ctx), buffer(nullptr), size(0) {}
 
     Buffer(const Buffer& other) = delete;
     Buffer(Buffer&& other) noexcept : Buffer(other.context) {
         buffer = other.buffer;
-        memory = other.memory;
+        allocation = other.allocation;
         size = other.size;
         other.buffer = nullptr;
-        other.memory = nullptr;
+        other.allocation = Allocation{};
     }
 
     Buffer& operator=(Buffer&& other) noexcept {
         if (&other != this) {
             buffer = other.buffer;
-            memory = other.memory;
+            allocation = other.allocation;
             size = other.size;
             other.buffer = nullptr;
-            other.memory = nullptr;
+            other.allocation = Allocation{};
             other.size = 0;
         }
 
@@ -36,9 +36,13 @@ public:
 
 
     void init(vk::DeviceSize size, vk::BufferUsageFlags usage_flags, vk::MemoryPropertyFlags properties);
-    void copy(vk::CommandPool &command_pool, Buffer &dest);
-    Buffer get_staging();
+    void copy(vk::CommandBuffer command_buffer, Buffer &dest);
+    //stages src through the upload queue and records the copy, returns the batch ticket
+    uint64_t upload(const void *src);
+    //host visible buffers are persistently mapped, these write straight into that mapping
     void store(const void *src);
+    void store(const void *src, vk::DeviceSize length, vk::DeviceSize offset);
+    void* data();
     void close();
 
 private:
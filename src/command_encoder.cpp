@@ -0,0 +1,146 @@
+#include "command_encoder.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+void EncoderStats::print() const {
+    DEBUG("commands issued " << issued() << ", elided " << elided()
+        << " (pipelines " << pipeline_binds << "/" << pipeline_binds_elided
+        << ", descriptor sets " << descriptor_set_binds << "/" << descriptor_set_binds_elided
+        << ", vertex buffers " << vertex_buffer_binds << "/" << vertex_buffer_binds_elided
+        << ", index buffers " << index_buffer_binds << "/" << index_buffer_binds_elided
+        << ", push constants " << push_constants << "/" << push_constants_elided
+        << "), " << draws << " draws")
+}
+
+EncoderStats& EncoderStats::operator+=(const EncoderStats& other) {
+    pipeline_binds += other.pipeline_binds;
+    pipeline_binds_elided += other.pipeline_binds_elided;
+    descriptor_set_binds += other.descriptor_set_binds;
+    descriptor_set_binds_elided += other.descriptor_set_binds_elided;
+    vertex_buffer_binds += other.vertex_buffer_binds;
+    vertex_buffer_binds_elided += other.vertex_buffer_binds_elided;
+    index_buffer_binds += other.index_buffer_binds;
+    index_buffer_binds_elided += other.index_buffer_binds_elided;
+    push_constants += other.push_constants;
+    push_constants_elided += other.push_constants_elided;
+    draws += other.draws;
+    return *this;
+}
+
+bool CommandEncoder::compatible(const std::vector<vk::DescriptorSetLayout>& bound, const Pipeline& pipeline, uint32_t slot) {
+    if (slot >= pipeline.set_layouts.size() || bound.size() != slot + 1) {
+        return false;
+    }
+    return std::equal(bound.begin(), bound.end(), pipeline.set_layouts.begin());
+}
+
+void CommandEncoder::bind_pipeline(const Pipeline& pipeline) {
+    if (pipeline.pipeline == bound_pipeline) {
+        stats.pipeline_binds_elided++;
+        return;
+    }
+
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.pipeline);
+    bound_pipeline = pipeline.pipeline;
+    stats.pipeline_binds++;
+}
+
+void CommandEncoder::bind_descriptor_set(const Pipeline& pipeline, uint32_t slot, vk::DescriptorSet set) {
+    if (slot >= MAX_DESCRIPTOR_SETS) {
+        throw std::out_of_range("descriptor set slot out of range");
+    }
+
+    auto& bound = bound_sets[slot];
+    if (bound.set == set && compatible(bound.layouts, pipeline, slot)) {
+        stats.descriptor_set_binds_elided++;
+        return;
+    }
+
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.layout, slot, 1, &set, 0, nullptr);
+    stats.descriptor_set_binds++;
+
+    bound.set = set;
+    bound.layouts.assign(pipeline.set_layouts.begin(), pipeline.set_layouts.begin() + slot + 1);
+
+    //binding with this layout disturbs any other slot the layout isn't compatible with
+    for (uint32_t i = 0; i < MAX_DESCRIPTOR_SETS; i++) {
+        if (i != slot && bound_sets[i].set != vk::DescriptorSet(nullptr) && !compatible(bound_sets[i].layouts, pipeline, i)) {
+            bound_sets[i] = BoundSet{};
+        }
+    }
+}
+
+void CommandEncoder::bind_vertex_buffer(uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset) {
+    if (binding >= MAX_VERTEX_BINDINGS) {
+        throw std::out_of_range("vertex buffer binding out of range");
+    }
+
+    auto& bound = bound_vertex_buffers[binding];
+    if (bound.buffer == buffer && bound.offset == offset) {
+        stats.vertex_buffer_binds_elided++;
+        return;
+    }
+
+    command_buffer.bindVertexBuffers(binding, 1, &buffer, &offset);
+    bound = BoundBuffer{ buffer, offset };
+    stats.vertex_buffer_binds++;
+}
+
+void CommandEncoder::bind_index_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::IndexType type) {
+    if (bound_index_buffer.buffer == buffer && bound_index_buffer.offset == offset && bound_index_type == type) {
+        stats.index_buffer_binds_elided++;
+        return;
+    }
+
+    command_buffer.bindIndexBuffer(buffer, offset, type);
+    bound_index_buffer = BoundBuffer{ buffer, offset };
+    bound_index_type = type;
+    stats.index_buffer_binds++;
+}
+
+void CommandEncoder::push_constants(const Pipeline& pipeline, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data) {
+    if (size > MAX_PUSH_CONSTANT_SIZE) {
+        throw std::out_of_range("push constants larger than the encoder tracks");
+    }
+
+    if (push_layout == pipeline.layout && push_stages == stages && push_offset == offset && push_size == size &&
+        memcmp(push_data.data(), data, size) == 0) {
+        stats.push_constants_elided++;
+        return;
+    }
+
+    command_buffer.pushConstants(pipeline.layout, stages, offset, size, data);
+    push_layout = pipeline.layout;
+    push_stages = stages;
+    push_offset = offset;
+    push_size = size;
+    memcpy(push_data.data(), data, size);
+    stats.push_constants++;
+}
+
+void CommandEncoder::draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+    command_buffer.drawIndexed(index_count, instance_count, first_index, vertex_offset, first_instance);
+    stats.draws++;
+}
+
+void CommandEncoder::draw_indexed_indirect(vk::Buffer buffer, vk::DeviceSize offset, uint32_t draw_count, uint32_t stride) {
+    command_buffer.drawIndexedIndirect(buffer, offset, draw_count, stride);
+    stats.draws++;
+}
+
+void CommandEncoder::draw_indexed_indirect_count(vk::Buffer buffer, vk::DeviceSize offset, vk::Buffer count_buffer, vk::DeviceSize count_offset, uint32_t max_draw_count, uint32_t stride) {
+    command_buffer.drawIndexedIndirectCount(buffer, offset, count_buffer, count_offset, max_draw_count, stride);
+    stats.draws++;
+}
+
+void CommandEncoder::reset() {
+    bound_pipeline = nullptr;
+    bound_sets = {};
+    bound_vertex_buffers = {};
+    bound_index_buffer = BoundBuffer{};
+    push_layout = nullptr;
+    push_size = 0;
+}
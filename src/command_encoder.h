@@ -0,0 +1,96 @@
+#pragma once
+
+#include "context.h"
+#include "pipeline.h"
+
+#include <array>
+
+//issued/elided counts for one recording
+struct EncoderStats {
+    uint32_t pipeline_binds = 0;
+    uint32_t pipeline_binds_elided = 0;
+    uint32_t descriptor_set_binds = 0;
+    uint32_t descriptor_set_binds_elided = 0;
+    uint32_t vertex_buffer_binds = 0;
+    uint32_t vertex_buffer_binds_elided = 0;
+    uint32_t index_buffer_binds = 0;
+    uint32_t index_buffer_binds_elided = 0;
+    uint32_t push_constants = 0;
+    uint32_t push_constants_elided = 0;
+    uint32_t draws = 0;
+
+    uint32_t issued() const {
+        return pipeline_binds + descriptor_set_binds + vertex_buffer_binds + index_buffer_binds + push_constants;
+    }
+    uint32_t elided() const {
+        return pipeline_binds_elided + descriptor_set_binds_elided + vertex_buffer_binds_elided + index_buffer_binds_elided + push_constants_elided;
+    }
+    void print() const;
+
+    //totals over several recordings, eg. the secondary command buffers of one frame
+    EncoderStats& operator+=(const EncoderStats& other);
+};
+
+//wraps a command buffer being recorded and drops binds that wouldn't change anything.
+//descriptor sets are tracked per slot together with the set layouts they were bound
+//against, so a set stays bound across pipeline changes only while the layouts agree
+//(vulkan's pipeline layout compatibility rules). every pipeline here shares one push
+//constant range, so that part of compatibility is taken for granted
+class CommandEncoder {
+public:
+    static constexpr uint32_t MAX_DESCRIPTOR_SETS = 4;
+    static constexpr uint32_t MAX_VERTEX_BINDINGS = 4;
+    static constexpr uint32_t MAX_PUSH_CONSTANT_SIZE = 128;
+
+    CommandEncoder(vk::CommandBuffer cb) : command_buffer(cb) {}
+
+    void bind_pipeline(const Pipeline& pipeline);
+    void bind_descriptor_set(const Pipeline& pipeline, uint32_t slot, vk::DescriptorSet set);
+    void bind_vertex_buffer(uint32_t binding, vk::Buffer buffer, vk::DeviceSize offset);
+    void bind_index_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::IndexType type);
+    void push_constants(const Pipeline& pipeline, vk::ShaderStageFlags stages, uint32_t offset, uint32_t size, const void* data);
+    void draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance);
+    //draw_count commands read from buffer, stride bytes apart
+    void draw_indexed_indirect(vk::Buffer buffer, vk::DeviceSize offset, uint32_t draw_count, uint32_t stride);
+    //same, with the number of commands read from count_buffer and capped at max_draw_count
+    void draw_indexed_indirect_count(vk::Buffer buffer, vk::DeviceSize offset, vk::Buffer count_buffer, vk::DeviceSize count_offset, uint32_t max_draw_count, uint32_t stride);
+
+    //forget everything bound, eg. after the command buffer was used directly
+    void reset();
+
+    vk::CommandBuffer get_command_buffer() const {
+        return command_buffer;
+    }
+    const EncoderStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    struct BoundSet {
+        vk::DescriptorSet set = nullptr;
+        //set layouts 0..slot of the pipeline layout it was bound with
+        std::vector<vk::DescriptorSetLayout> layouts;
+    };
+
+    struct BoundBuffer {
+        vk::Buffer buffer = nullptr;
+        vk::DeviceSize offset = 0;
+    };
+
+    vk::CommandBuffer command_buffer;
+    EncoderStats stats;
+
+    vk::Pipeline bound_pipeline = nullptr;
+    std::array<BoundSet, MAX_DESCRIPTOR_SETS> bound_sets;
+    std::array<BoundBuffer, MAX_VERTEX_BINDINGS> bound_vertex_buffers;
+    BoundBuffer bound_index_buffer;
+    vk::IndexType bound_index_type = vk::IndexType::eUint32;
+
+    vk::PipelineLayout push_layout = nullptr;
+    vk::ShaderStageFlags push_stages;
+    uint32_t push_offset = 0;
+    uint32_t push_size = 0;
+    std::array<uint8_t, MAX_PUSH_CONSTANT_SIZE> push_data;
+
+    static bool compatible(const std::vector<vk::DescriptorSetLayout>& bound, const Pipeline& pipeline, uint32_t slot);
+};
@@ -72,6 +72,19 @@ QueueFamilies Context::get_queue_families_from_device(vk::PhysicalDevice device,
         if(supports_present) {
             result.presentation = index;
         }
+
+        //dma engines show up as families with transfer but neither graphics nor compute.
+        //image uploads are split into row bands, so they have to take any copy offset
+        auto flags = families.at(index).queueFlags;
+        auto granularity = families.at(index).minImageTransferGranularity;
+        bool any_offset = granularity.width == 1 && granularity.height == 1 && granularity.depth == 1;
+        if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) && any_offset) {
+            result.transfer = index;
+        }
+    }
+
+    if (!result.transfer.has_value()) {
+        result.transfer = result.graphics;
     }
 
     return result;
@@ -102,7 +115,7 @@ void Context::init() {
         VK_MAKE_VERSION(0, 0, 1),
         "SVE",
         VK_MAKE_VERSION(0, 0, 1),
-        VK_API_VERSION_1_1);
+        VK_API_VERSION_1_2);
 
     uint32_t glfw_extension_count = 0;
     const char **glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
@@ -137,29 +150,3 @@ void Context::init() {
 void Context::close() {
     instance.destroy();
 }
-
-OneTimeSubmitCommand OneTimeSubmitCommand::create(Context& context)
-{
-    OneTimeSubmitCommand command(context);
-    vk::CommandBufferAllocateInfo alloc_info(context.command_pool, vk::CommandBufferLevel::ePrimary, 1);
-    command.buffer = context.device.allocateCommandBuffers(alloc_info)[0];
-
-    vk::CommandBufferBeginInfo begin_info(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-    command.buffer.begin(begin_info);
-
-    return command;
-}
-
-void OneTimeSubmitCommand::execute()
-{
-    buffer.end();
-
-    vk::SubmitInfo submit_info;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &buffer;
-
-    context.graphics_queue.submit(1, &submit_info, nullptr);
-    context.graphics_queue.waitIdle();
-
-    context.device.freeCommandBuffers(context.command_pool, 1, &buffer);
-}
@@ -7,23 +7,40 @@
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 
+#include "allocator.h"
 
 #include <vector>
 #include <optional>
 
-#define MAX_LIGHTDATA 16
-struct LightData {
-    alignas(16) glm::mat4 M;
-    alignas(16) glm::vec4 color;
+//only point lights so far, the shaders treat every light as one
+enum class LightType : uint32_t {
+    Point = 0
+};
+
+//one per light in the light storage buffer, see LightClusters
+struct LightRecord {
+    alignas(16) glm::vec3 position;
+    float range;
+    alignas(16) glm::vec3 color;
+    //a LightType
+    uint32_t type;
 };
 
 struct UniformBufferObject {
     alignas(16) glm::mat4 V;
     alignas(16) glm::mat4 P;
-    alignas(16) glm::mat4 M[256];
     alignas(16) glm::vec3 camera_position;
-    alignas(16) LightData lights[MAX_LIGHTDATA];
-    alignas(4) uint32_t num_lights;
+    //clusters along x, y and depth, and the light count
+    alignas(16) glm::uvec4 cluster_grid;
+    //cluster width and height in pixels, then scale and bias from log view depth to slice
+    alignas(16) glm::vec4 cluster_params;
+    //clip space back to world space, for positions rebuilt from depth
+    alignas(16) glm::mat4 inverse_VP;
+};
+
+//one per object in the object storage buffer, see Renderer::object_buffer
+struct ObjectData {
+    alignas(16) glm::mat4 M;
 };
 
 struct PushConstants {
@@ -33,12 +50,25 @@ struct PushConstants {
 struct QueueFamilies {
     std::optional<uint32_t> graphics;
     std::optional<uint32_t> presentation;
+    //transfer-only family if the device has one, otherwise the graphics family
+    std::optional<uint32_t> transfer;
 
     bool is_complete() {
         return graphics.has_value() && presentation.has_value();
     }
 };
 
+//optional device features, filled in when the logical device is created
+struct DeviceFeatures {
+    //several draws per indirect call with firstInstance set, needed for gpu culling
+    bool multi_draw_indirect = false;
+    //vkCmdDrawIndexedIndirectCount (vulkan 1.2)
+    bool draw_indirect_count = false;
+    //pipeline statistics queries, and whether they may stay active across secondary command buffers
+    bool pipeline_statistics = false;
+    bool inherited_queries = false;
+};
+
 struct SwapchainDetails {
     std::vector<vk::SurfaceFormatKHR> formats;
     std::vector<vk::PresentModeKHR> present_modes;
@@ -54,6 +84,8 @@ struct SwapchainDetails {
     vk::Extent2D choose_swap_extent(vk::Extent2D framebuffer_extent);
 };
 
+class UploadQueue;
+
 const std::vector<const char *>
     validation_layers = {
         "VK_LAYER_KHRONOS_validation"};
@@ -67,12 +99,15 @@ public:
     vk::PhysicalDevice physical_device;
     vk::Device device;
     QueueFamilies queue_families;
+    DeviceFeatures features;
     vk::Queue graphics_queue;
     vk::Queue presentation_queue;
+    vk::Queue transfer_queue;
     vk::SurfaceKHR surface;
     vk::Extent2D framebuffer_extent;
     bool framebuffer_resized = false;
-    vk::CommandPool command_pool = nullptr;
+    MemoryAllocator allocator;
+    UploadQueue* upload_queue = nullptr;
 
     void init();
     void close();
@@ -93,15 +128,3 @@ private:
 
     void init_validation_layers();
 };
-
-class OneTimeSubmitCommand {
-public:
-    vk::CommandBuffer buffer;
-
-    static OneTimeSubmitCommand create(Context& context);
-    void execute();
-private:
-    OneTimeSubmitCommand(Context& ctx) : context(ctx) {}
-    Context& context;
-};
-
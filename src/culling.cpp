@@ -0,0 +1,248 @@
+#include "culling.h"
+
+#include <glm/gtc/matrix_access.hpp>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+    //signed distance of a group of points to the plane, positive on the inside. a box's
+    //extents against the plane's absolute normal and zero w give how far it reaches towards it
+#if defined(__AVX__)
+    __m256 plane_distance(const glm::vec4& plane, __m256 x, __m256 y, __m256 z) {
+        return _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+            _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+    }
+#elif defined(CULLING_SSE)
+    __m128 plane_distance(const glm::vec4& plane, __m128 x, __m128 y, __m128 z) {
+        return _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+            _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+    }
+#else
+    float plane_distance(const glm::vec4& plane, float x, float y, float z) {
+        return x * plane.x + y * plane.y + z * plane.z + plane.w;
+    }
+#endif
+
+    glm::vec4 abs_normal(const glm::vec4& plane) {
+        return glm::vec4(std::abs(plane.x), std::abs(plane.y), std::abs(plane.z), 0.0f);
+    }
+
+    //adds the indices of the lanes set in mask for the group starting at first, leaving out
+    //the padding lanes past count
+    void append_lanes(uint32_t first, uint32_t mask, uint32_t count, uint32_t lanes, std::vector<uint32_t>& visible) {
+        if (count - first < lanes) {
+            mask &= (1u << (count - first)) - 1;
+        }
+        for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1) {
+            if (mask & 1) {
+                visible.push_back(first + lane);
+            }
+        }
+    }
+}
+
+Frustum Frustum::from_matrix(const glm::mat4& view_projection) {
+    glm::vec4 row0 = glm::row(view_projection, 0);
+    glm::vec4 row1 = glm::row(view_projection, 1);
+    glm::vec4 row2 = glm::row(view_projection, 2);
+    glm::vec4 row3 = glm::row(view_projection, 3);
+
+    Frustum frustum;
+    frustum.planes = {
+        row3 + row0,
+        row3 - row0,
+        row3 + row1,
+        row3 - row1,
+        row2,
+        row3 - row2
+    };
+    for (auto& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+void FrustumCuller::resize(uint32_t new_count) {
+    count = new_count;
+    uint32_t padded = (count + LANES - 1) / LANES * LANES;
+    center_x.resize(padded, 0.0f);
+    center_y.resize(padded, 0.0f);
+    center_z.resize(padded, 0.0f);
+    extent_x.resize(padded, 0.0f);
+    extent_y.resize(padded, 0.0f);
+    extent_z.resize(padded, 0.0f);
+    enabled_lanes.resize(padded / LANES, 0xFF);
+}
+
+void FrustumCuller::set_enabled(uint32_t index, bool enabled) {
+    auto bit = static_cast<uint8_t>(1u << (index % LANES));
+    if (enabled) {
+        enabled_lanes[index / LANES] |= bit;
+    }
+    else {
+        enabled_lanes[index / LANES] &= static_cast<uint8_t>(~bit);
+    }
+}
+
+void FrustumCuller::set_bounds(uint32_t index, const Bounds& bounds, const glm::mat4& M) {
+    glm::vec3 center = glm::vec3(M * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    glm::vec3 half = (bounds.max - bounds.min) * 0.5f;
+
+    //each world axis gets the extent projected from every object axis
+    glm::vec3 extent = glm::abs(glm::vec3(M[0])) * half.x +
+        glm::abs(glm::vec3(M[1])) * half.y +
+        glm::abs(glm::vec3(M[2])) * half.z;
+
+    center_x[index] = center.x;
+    center_y[index] = center.y;
+    center_z[index] = center.z;
+    extent_x[index] = extent.x;
+    extent_y[index] = extent.y;
+    extent_z[index] = extent.z;
+}
+
+//a box is outside if it is entirely behind any plane: distance of the center plus the
+//extent projected onto the plane normal is negative
+uint32_t FrustumCuller::test_lanes(const Frustum& frustum, uint32_t first) const {
+#if defined(__AVX__)
+    __m256 cx = _mm256_loadu_ps(&center_x[first]);
+    __m256 cy = _mm256_loadu_ps(&center_y[first]);
+    __m256 cz = _mm256_loadu_ps(&center_z[first]);
+    __m256 ex = _mm256_loadu_ps(&extent_x[first]);
+    __m256 ey = _mm256_loadu_ps(&extent_y[first]);
+    __m256 ez = _mm256_loadu_ps(&extent_z[first]);
+
+    __m256 outside = _mm256_setzero_ps();
+    for (const auto& plane : frustum.planes) {
+        __m256 reach = _mm256_add_ps(plane_distance(plane, cx, cy, cz), plane_distance(abs_normal(plane), ex, ey, ez));
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(reach, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    return ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xFF;
+#elif defined(CULLING_SSE)
+    uint32_t mask = 0;
+    for (uint32_t half = 0; half < 2; half++) {
+        uint32_t i = first + half * 4;
+        __m128 cx = _mm_loadu_ps(&center_x[i]);
+        __m128 cy = _mm_loadu_ps(&center_y[i]);
+        __m128 cz = _mm_loadu_ps(&center_z[i]);
+        __m128 ex = _mm_loadu_ps(&extent_x[i]);
+        __m128 ey = _mm_loadu_ps(&extent_y[i]);
+        __m128 ez = _mm_loadu_ps(&extent_z[i]);
+
+        __m128 outside = _mm_setzero_ps();
+        for (const auto& plane : frustum.planes) {
+            __m128 reach = _mm_add_ps(plane_distance(plane, cx, cy, cz), plane_distance(abs_normal(plane), ex, ey, ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(reach, _mm_setzero_ps()));
+        }
+        mask |= (~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xF) << (half * 4);
+    }
+    return mask;
+#else
+    uint32_t mask = 0;
+    for (uint32_t lane = 0; lane < LANES; lane++) {
+        uint32_t i = first + lane;
+        bool outside = false;
+        for (const auto& plane : frustum.planes) {
+            float reach = plane_distance(plane, center_x[i], center_y[i], center_z[i]) +
+                plane_distance(abs_normal(plane), extent_x[i], extent_y[i], extent_z[i]);
+            outside |= reach < 0.0f;
+        }
+        mask |= outside ? 0 : 1u << lane;
+    }
+    return mask;
+#endif
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible) {
+    visible.clear();
+
+    for (uint32_t first = 0; first < count; first += LANES) {
+        uint32_t enabled = enabled_lanes[first / LANES];
+        if (enabled != 0) {
+            append_lanes(first, test_lanes(frustum, first) & enabled, count, LANES, visible);
+        }
+    }
+
+    stats.tested = count;
+    stats.visible = static_cast<uint32_t>(visible.size());
+}
+
+void SphereCuller::resize(uint32_t new_count) {
+    count = new_count;
+    uint32_t padded = (count + LANES - 1) / LANES * LANES;
+    center_x.resize(padded, 0.0f);
+    center_y.resize(padded, 0.0f);
+    center_z.resize(padded, 0.0f);
+    radius.resize(padded, 0.0f);
+}
+
+void SphereCuller::set_sphere(uint32_t index, const glm::vec3& center, float r) {
+    center_x[index] = center.x;
+    center_y[index] = center.y;
+    center_z[index] = center.z;
+    radius[index] = r;
+}
+
+//a sphere is outside if its center is further than the radius behind any plane
+uint32_t SphereCuller::test_lanes(const Frustum& frustum, uint32_t first) const {
+#if defined(__AVX__)
+    __m256 cx = _mm256_loadu_ps(&center_x[first]);
+    __m256 cy = _mm256_loadu_ps(&center_y[first]);
+    __m256 cz = _mm256_loadu_ps(&center_z[first]);
+    __m256 r = _mm256_loadu_ps(&radius[first]);
+
+    __m256 outside = _mm256_setzero_ps();
+    for (const auto& plane : frustum.planes) {
+        __m256 reach = _mm256_add_ps(plane_distance(plane, cx, cy, cz), r);
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(reach, _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    return ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xFF;
+#elif defined(CULLING_SSE)
+    uint32_t mask = 0;
+    for (uint32_t half = 0; half < 2; half++) {
+        uint32_t i = first + half * 4;
+        __m128 cx = _mm_loadu_ps(&center_x[i]);
+        __m128 cy = _mm_loadu_ps(&center_y[i]);
+        __m128 cz = _mm_loadu_ps(&center_z[i]);
+        __m128 r = _mm_loadu_ps(&radius[i]);
+
+        __m128 outside = _mm_setzero_ps();
+        for (const auto& plane : frustum.planes) {
+            __m128 reach = _mm_add_ps(plane_distance(plane, cx, cy, cz), r);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(reach, _mm_setzero_ps()));
+        }
+        mask |= (~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xF) << (half * 4);
+    }
+    return mask;
+#else
+    uint32_t mask = 0;
+    for (uint32_t lane = 0; lane < LANES; lane++) {
+        uint32_t i = first + lane;
+        bool outside = false;
+        for (const auto& plane : frustum.planes) {
+            outside |= plane_distance(plane, center_x[i], center_y[i], center_z[i]) + radius[i] < 0.0f;
+        }
+        mask |= outside ? 0 : 1u << lane;
+    }
+    return mask;
+#endif
+}
+
+void SphereCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible) {
+    visible.clear();
+
+    for (uint32_t first = 0; first < count; first += LANES) {
+        append_lanes(first, test_lanes(frustum, first), count, LANES, visible);
+    }
+
+    stats.tested = count;
+    stats.visible = static_cast<uint32_t>(visible.size());
+}
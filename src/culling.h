@@ -0,0 +1,100 @@
+#pragma once
+
+#include "geometry.h"
+
+#include <array>
+#include <vector>
+
+//world space planes facing inwards, xyz normal and w distance
+struct Frustum {
+    std::array<glm::vec4, 6> planes;
+
+    //gribb/hartmann extraction from a projection * view matrix with 0..1 depth
+    static Frustum from_matrix(const glm::mat4& view_projection);
+};
+
+struct CullingStats {
+    uint32_t tested = 0;
+    uint32_t visible = 0;
+
+    uint32_t culled() const {
+        return tested - visible;
+    }
+};
+
+//world space bounding boxes of every object, kept as one array per component (center and
+//half extent on each axis) so the kernel tests 8 boxes per step: one avx register per
+//component, or two sse ones when the build doesn't enable avx
+class FrustumCuller {
+public:
+    static constexpr uint32_t LANES = 8;
+
+    //count objects, new ones start out as an empty box at the origin
+    void resize(uint32_t count);
+    //moves the object's box to world space, an axis aligned box around the transformed one
+    void set_bounds(uint32_t index, const Bounds& bounds, const glm::mat4& M);
+    //disabled objects are never visible and groups of LANES disabled ones aren't tested at
+    //all. objects start out enabled
+    void set_enabled(uint32_t index, bool enabled);
+
+    //fills visible with the indices of boxes at least partly inside the frustum
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+
+    //world space box from set_bounds
+    glm::vec3 get_center(uint32_t index) const {
+        return glm::vec3(center_x[index], center_y[index], center_z[index]);
+    }
+    glm::vec3 get_extent(uint32_t index) const {
+        return glm::vec3(extent_x[index], extent_y[index], extent_z[index]);
+    }
+
+    const CullingStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    uint32_t count = 0;
+    //padded to a multiple of LANES
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> extent_x;
+    std::vector<float> extent_y;
+    std::vector<float> extent_z;
+    //bit per lane, one byte per group of LANES
+    std::vector<uint8_t> enabled_lanes;
+    CullingStats stats;
+
+    //bit per lane, set if that box is visible
+    uint32_t test_lanes(const Frustum& frustum, uint32_t first) const;
+};
+
+//bounding spheres kept the same way, one array per component, for lights. 8 spheres per
+//step against the frustum planes
+class SphereCuller {
+public:
+    static constexpr uint32_t LANES = 8;
+
+    //count spheres, new ones start out as a point at the origin
+    void resize(uint32_t count);
+    void set_sphere(uint32_t index, const glm::vec3& center, float radius);
+
+    //fills visible with the indices of spheres at least partly inside the frustum
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible);
+
+    const CullingStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    uint32_t count = 0;
+    //padded to a multiple of LANES
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> radius;
+    CullingStats stats;
+
+    //bit per lane, set if that sphere is visible
+    uint32_t test_lanes(const Frustum& frustum, uint32_t first) const;
+};
@@ -0,0 +1,78 @@
+#include "deferred_lighting.h"
+#include "log.h"
+
+void DeferredLighting::init() {
+    TRACE("initializing deferred lighting")
+
+    std::array<vk::DescriptorSetLayoutBinding, 4> bindings;
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i] = vk::DescriptorSetLayoutBinding(i, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment, nullptr);
+    }
+    vk::DescriptorSetLayoutCreateInfo create_info({}, static_cast<uint32_t>(bindings.size()), bindings.data());
+    descriptor_set_layout = context.device.createDescriptorSetLayout(create_info);
+
+    //read with texelFetch, one texel per pixel
+    vk::SamplerCreateInfo sampler_info({},
+        vk::Filter::eNearest,
+        vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        0.0f,
+        false,
+        1.0f,
+        false,
+        vk::CompareOp::eAlways,
+        0.0f,
+        0.0f,
+        vk::BorderColor::eFloatOpaqueWhite,
+        false);
+    sampler = context.device.createSampler(sampler_info);
+}
+
+void DeferredLighting::close() {
+    close_pass();
+    context.device.destroySampler(sampler);
+    context.device.destroyDescriptorSetLayout(descriptor_set_layout);
+}
+
+void DeferredLighting::init_pass(vk::Extent2D extent, vk::RenderPass render_pass, vk::DescriptorSetLayout global_layout,
+    const std::array<vk::ImageView, 4>& views) {
+    PipelineOptions options;
+    options.full_screen = true;
+    pipeline.init(extent, render_pass, { global_layout, descriptor_set_layout }, options);
+
+    vk::DescriptorPoolSize pool_size(vk::DescriptorType::eCombinedImageSampler, static_cast<uint32_t>(views.size()));
+    vk::DescriptorPoolCreateInfo pool_info({}, 1, 1, &pool_size);
+    descriptor_pool = context.device.createDescriptorPool(pool_info);
+
+    vk::DescriptorSetAllocateInfo allocate_info(descriptor_pool, 1, &descriptor_set_layout);
+    descriptor_set = context.device.allocateDescriptorSets(allocate_info).at(0);
+
+    std::array<vk::DescriptorImageInfo, 4> image_infos;
+    std::array<vk::WriteDescriptorSet, 4> writes;
+    for (uint32_t i = 0; i < views.size(); i++) {
+        image_infos[i] = vk::DescriptorImageInfo(sampler, views[i], vk::ImageLayout::eShaderReadOnlyOptimal);
+        writes[i] = vk::WriteDescriptorSet(descriptor_set, i, 0, 1, vk::DescriptorType::eCombinedImageSampler, &image_infos[i], nullptr, nullptr);
+    }
+    context.device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void DeferredLighting::close_pass() {
+    if (pipeline.pipeline != vk::Pipeline(nullptr)) {
+        pipeline.close();
+    }
+    if (descriptor_pool != vk::DescriptorPool(nullptr)) {
+        context.device.destroyDescriptorPool(descriptor_pool);
+        descriptor_pool = nullptr;
+    }
+    descriptor_set = nullptr;
+}
+
+void DeferredLighting::record(vk::CommandBuffer command_buffer, vk::DescriptorSet global_set) {
+    std::array<vk::DescriptorSet, 2> sets{ global_set, descriptor_set };
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.layout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+    command_buffer.draw(3, 1, 0, 0);
+}
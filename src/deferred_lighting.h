@@ -0,0 +1,40 @@
+#pragma once
+
+#include "context.h"
+#include "pipeline.h"
+
+#include <array>
+
+//the lighting half of deferred shading. the g-buffer pass has the materials write albedo,
+//normal and roughness/metallic next to depth, then one triangle over the screen runs
+//lighting_direct once per pixel that was drawn, see deferred_lighting_frag.glsl. the
+//images belong to the render graph, set 1 samples them
+class DeferredLighting {
+public:
+    //the g-buffer's color attachments, in the order the pass writes them
+    static constexpr vk::Format ALBEDO_FORMAT = vk::Format::eR8G8B8A8Unorm;
+    static constexpr vk::Format NORMAL_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+    static constexpr vk::Format MATERIAL_FORMAT = vk::Format::eR8G8Unorm;
+
+    DeferredLighting(Context& ctx) : context(ctx), pipeline(ctx, "deferred_lighting") {}
+    DeferredLighting(const DeferredLighting& other) = delete;
+
+    void init();
+    void close();
+    //pipeline and descriptor set for the graph's current lighting pass and images, until
+    //close_pass. views are albedo, normal, material and depth
+    void init_pass(vk::Extent2D extent, vk::RenderPass render_pass, vk::DescriptorSetLayout global_layout,
+        const std::array<vk::ImageView, 4>& views);
+    void close_pass();
+
+    //inside the lighting pass, with the g-buffer and depth in shader read only layout
+    void record(vk::CommandBuffer command_buffer, vk::DescriptorSet global_set);
+
+private:
+    Context& context;
+    Pipeline pipeline;
+    vk::DescriptorSetLayout descriptor_set_layout = nullptr;
+    vk::Sampler sampler = nullptr;
+    vk::DescriptorPool descriptor_pool = nullptr;
+    vk::DescriptorSet descriptor_set = nullptr;
+};
@@ -0,0 +1,128 @@
+#include "depth_pyramid.h"
+#include "log.h"
+
+#include <algorithm>
+#include <array>
+
+vk::Extent2D DepthPyramid::get_extent(vk::Extent2D depth_extent) {
+    auto previous_power_of_two = [](uint32_t value) {
+        uint32_t result = 1;
+        while (result * 2 <= value) {
+            result *= 2;
+        }
+        return result;
+    };
+    return vk::Extent2D(previous_power_of_two(depth_extent.width), previous_power_of_two(depth_extent.height));
+}
+
+uint32_t DepthPyramid::get_mip_levels(vk::Extent2D extent) {
+    uint32_t levels = 1;
+    uint32_t size = std::max(extent.width, extent.height);
+    while (size > 1) {
+        size /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+void DepthPyramid::init() {
+    TRACE("initializing depth pyramid")
+
+    std::array<vk::DescriptorSetLayoutBinding, 2> bindings{
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute, nullptr)
+    };
+    vk::DescriptorSetLayoutCreateInfo create_info({}, static_cast<uint32_t>(bindings.size()), bindings.data());
+    descriptor_set_layout = context.device.createDescriptorSetLayout(create_info);
+
+    pipeline.init({ descriptor_set_layout }, sizeof(DepthPyramidPushConstants));
+
+    vk::SamplerCreateInfo sampler_info({},
+        vk::Filter::eNearest,
+        vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        0.0f,
+        false,
+        1.0f,
+        false,
+        vk::CompareOp::eAlways,
+        0.0f,
+        VK_LOD_CLAMP_NONE,
+        vk::BorderColor::eFloatOpaqueWhite,
+        false);
+    sampler = context.device.createSampler(sampler_info);
+}
+
+void DepthPyramid::close() {
+    close_views();
+    context.device.destroySampler(sampler);
+    pipeline.close();
+    context.device.destroyDescriptorSetLayout(descriptor_set_layout);
+}
+
+void DepthPyramid::init_views(vk::ImageView depth_view, vk::Extent2D depth_extent, const std::vector<vk::ImageView>& mip_views, vk::Extent2D extent) {
+    auto levels = static_cast<uint32_t>(mip_views.size());
+
+    std::array<vk::DescriptorPoolSize, 2> pool_sizes{
+        vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, levels),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageImage, levels)
+    };
+    vk::DescriptorPoolCreateInfo pool_info({}, levels, static_cast<uint32_t>(pool_sizes.size()), pool_sizes.data());
+    descriptor_pool = context.device.createDescriptorPool(pool_info);
+
+    std::vector<vk::DescriptorSetLayout> layouts(levels, descriptor_set_layout);
+    vk::DescriptorSetAllocateInfo allocate_info(descriptor_pool, levels, layouts.data());
+    descriptor_sets = context.device.allocateDescriptorSets(allocate_info);
+
+    level_sizes.clear();
+    vk::Extent2D source_extent = depth_extent;
+    vk::Extent2D level_extent = extent;
+    for (uint32_t level = 0; level < levels; level++) {
+        //the depth buffer is sampled in shader read only layout, the levels stay in general
+        vk::DescriptorImageInfo source_info(sampler,
+            level == 0 ? depth_view : mip_views[level - 1],
+            level == 0 ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eGeneral);
+        vk::DescriptorImageInfo destination_info(nullptr, mip_views[level], vk::ImageLayout::eGeneral);
+
+        std::array<vk::WriteDescriptorSet, 2> writes{
+            vk::WriteDescriptorSet(descriptor_sets[level], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &source_info, nullptr, nullptr),
+            vk::WriteDescriptorSet(descriptor_sets[level], 1, 0, 1, vk::DescriptorType::eStorageImage, &destination_info, nullptr, nullptr)
+        };
+        context.device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+        level_sizes.push_back({ source_extent.width, source_extent.height, level_extent.width, level_extent.height });
+        source_extent = level_extent;
+        level_extent = vk::Extent2D(std::max(level_extent.width / 2, 1u), std::max(level_extent.height / 2, 1u));
+    }
+}
+
+void DepthPyramid::close_views() {
+    if (descriptor_pool != vk::DescriptorPool(nullptr)) {
+        context.device.destroyDescriptorPool(descriptor_pool);
+        descriptor_pool = nullptr;
+    }
+    descriptor_sets.clear();
+    level_sizes.clear();
+}
+
+void DepthPyramid::record(vk::CommandBuffer command_buffer) {
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.pipeline);
+
+    for (uint32_t level = 0; level < descriptor_sets.size(); level++) {
+        const auto& sizes = level_sizes[level];
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.layout, 0, 1, &descriptor_sets[level], 0, nullptr);
+        command_buffer.pushConstants(pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(sizes), &sizes);
+        command_buffer.dispatch((sizes.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (sizes.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+        //the next level reads this one, the render graph takes care of the last
+        if (level + 1 == descriptor_sets.size()) {
+            break;
+        }
+        vk::MemoryBarrier barrier(vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+            {}, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+}
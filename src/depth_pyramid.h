@@ -0,0 +1,53 @@
+#pragma once
+
+#include "context.h"
+#include "pipeline.h"
+
+#include <vector>
+
+struct DepthPyramidPushConstants {
+    uint32_t source_width;
+    uint32_t source_height;
+    uint32_t width;
+    uint32_t height;
+};
+
+//hierarchical z buffer for occlusion culling. every texel holds the farthest depth of the
+//area it covers, level 0 is the largest power of two that fits into the depth buffer and
+//each level halves the one before it, down to 1x1. built with one compute dispatch per
+//level, see depth_pyramid_comp.glsl. the images themselves belong to the render graph
+class DepthPyramid {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 8;
+    static constexpr vk::Format FORMAT = vk::Format::eR32Sfloat;
+
+    DepthPyramid(Context& ctx) : context(ctx), pipeline(ctx, "depth_pyramid") {}
+    DepthPyramid(const DepthPyramid& other) = delete;
+
+    static vk::Extent2D get_extent(vk::Extent2D depth_extent);
+    static uint32_t get_mip_levels(vk::Extent2D extent);
+
+    void init();
+    void close();
+    //descriptor sets for the graph's current images, until close_views
+    void init_views(vk::ImageView depth_view, vk::Extent2D depth_extent, const std::vector<vk::ImageView>& mip_views, vk::Extent2D extent);
+    void close_views();
+
+    //the depth buffer must be readable and the pyramid in general layout
+    void record(vk::CommandBuffer command_buffer);
+
+    //nearest filtering, for texelFetch of any level
+    vk::Sampler get_sampler() const {
+        return sampler;
+    }
+
+private:
+    Context& context;
+    ComputePipeline pipeline;
+    vk::DescriptorSetLayout descriptor_set_layout = nullptr;
+    vk::Sampler sampler = nullptr;
+    vk::DescriptorPool descriptor_pool = nullptr;
+    //one per level, reading the depth buffer or the level above
+    std::vector<vk::DescriptorSet> descriptor_sets;
+    std::vector<DepthPyramidPushConstants> level_sizes;
+};
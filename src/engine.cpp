@@ -28,6 +28,8 @@ void Engine::execute_frame()
 void Engine::close()
 {
 	renderer.wait_for_idle();
+	context.allocator.print_stats();
+	renderer.print_stats();
 	for (auto& object : objects) {
 		object->close();
 	}
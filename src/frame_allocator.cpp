@@ -0,0 +1,54 @@
+#include "frame_allocator.h"
+#include "log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void FrameAllocator::init(uint32_t frame_count, vk::DeviceSize size) {
+    auto limits = context.physical_device.getProperties().limits;
+    uniform_alignment = std::max<vk::DeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+    storage_alignment = std::max<vk::DeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+
+    //keep every segment start aligned for both uniform and storage descriptors
+    frame_size = align_up(size, std::max(uniform_alignment, storage_alignment));
+
+    buffer.init(frame_size * frame_count,
+        vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    current_frame = 0;
+    head = 0;
+}
+
+void FrameAllocator::close() {
+    buffer.close();
+}
+
+void FrameAllocator::begin_frame(uint32_t frame) {
+    current_frame = frame;
+    head = 0;
+}
+
+FrameAllocation FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    vk::DeviceSize offset = align_up(head, alignment);
+    if (offset + size > frame_size) {
+        throw std::runtime_error("frame allocator out of space");
+    }
+    head = offset + size;
+
+    vk::DeviceSize buffer_offset = frame_offset(current_frame) + offset;
+    return FrameAllocation{
+        buffer.buffer,
+        buffer_offset,
+        size,
+        static_cast<char*>(buffer.data()) + buffer_offset
+    };
+}
+
+FrameAllocation FrameAllocator::allocate_uniform(vk::DeviceSize size) {
+    return allocate(size, uniform_alignment);
+}
+
+FrameAllocation FrameAllocator::allocate_storage(vk::DeviceSize size) {
+    return allocate(size, storage_alignment);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "context.h"
+#include "buffer.h"
+
+struct FrameAllocation {
+    vk::Buffer buffer;
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+    void* data;
+
+    template<class T> T* as() {
+        return reinterpret_cast<T*>(data);
+    }
+};
+
+//linear allocator over one persistently mapped buffer, split into a segment per frame.
+//begin_frame() rewinds that frame's segment, so everything handed out is only valid
+//until the same frame index comes round again
+class FrameAllocator {
+public:
+    FrameAllocator(Context& ctx) : context(ctx), buffer(ctx) {}
+    FrameAllocator(const FrameAllocator& other) = delete;
+
+    void init(uint32_t frame_count, vk::DeviceSize frame_size);
+    void close();
+
+    void begin_frame(uint32_t frame);
+    FrameAllocation allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+    FrameAllocation allocate_uniform(vk::DeviceSize size);
+    FrameAllocation allocate_storage(vk::DeviceSize size);
+
+    vk::Buffer get_buffer() const {
+        return buffer.buffer;
+    }
+    vk::DeviceSize frame_offset(uint32_t frame) const {
+        return frame * frame_size;
+    }
+    vk::DeviceSize get_used() const {
+        return head;
+    }
+
+private:
+    Context& context;
+    Buffer buffer;
+    vk::DeviceSize frame_size = 0;
+    vk::DeviceSize uniform_alignment = 1;
+    vk::DeviceSize storage_alignment = 1;
+    uint32_t current_frame = 0;
+    vk::DeviceSize head = 0;
+};
@@ -1,5 +1,8 @@
 #include "geometry.h"
 
+#include <algorithm>
+#include <cmath>
+
 //adapted from http://foundationsofgameenginedev.com/FGED2-sample.pdf
 void RecalculateTangents(Mesh& mesh)
 {
@@ -45,4 +48,29 @@ void RecalculateTangents(Mesh& mesh)
         // w component flips the bitangent if needed?
         //tangentArray[i].w = (Dot(Cross(t, b), n) > 0.0F) ? 1.0F : -1.0F;
     }
-}
\ No newline at end of file
+}
+
+Bounds calculate_bounds(const Mesh& mesh)
+{
+    Bounds bounds;
+    if (mesh.vertices.empty()) {
+        return bounds;
+    }
+
+    bounds.min = mesh.vertices[0].pos;
+    bounds.max = mesh.vertices[0].pos;
+    for (const auto& vertex : mesh.vertices) {
+        bounds.min = glm::min(bounds.min, vertex.pos);
+        bounds.max = glm::max(bounds.max, vertex.pos);
+    }
+
+    glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius_squared = 0.0f;
+    for (const auto& vertex : mesh.vertices) {
+        glm::vec3 offset = vertex.pos - center;
+        radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+    }
+    bounds.sphere = glm::vec4(center, std::sqrt(radius_squared));
+
+    return bounds;
+}
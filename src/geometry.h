@@ -56,9 +56,19 @@ struct Vertex {
     }
 };
 
+//object space bounds of a mesh
+struct Bounds {
+    glm::vec3 min{ 0.0f };
+    glm::vec3 max{ 0.0f };
+    //center in xyz, radius in w
+    glm::vec4 sphere{ 0.0f };
+};
+
 struct Mesh {
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    //filled in by the importers, see calculate_bounds
+    Bounds bounds;
 };
 
 const Mesh QUAD = {
@@ -66,6 +76,10 @@ const Mesh QUAD = {
      {{0.5f, -0.5f, 0.0f}, {0.0f, 1.0f, 0.0f, 1.0f}, {0.0f, 0.0f}},
      {{0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 1.0f, 1.0f}, {0.0f, 1.0f}},
      {{-0.5f, 0.5f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}},
-    {0, 1, 2, 2, 3, 0}};
+    {0, 1, 2, 2, 3, 0},
+    {{-0.5f, -0.5f, 0.0f}, {0.5f, 0.5f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.70710678f}}};
 
-void RecalculateTangents(Mesh& mesh);
\ No newline at end of file
+void RecalculateTangents(Mesh& mesh);
+//box and sphere around every vertex. the sphere is centered on the box, which is close
+//enough for culling without an iterative fit
+Bounds calculate_bounds(const Mesh& mesh);
\ No newline at end of file
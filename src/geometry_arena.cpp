@@ -0,0 +1,227 @@
+#include "geometry_arena.h"
+#include "upload.h"
+#include "log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void GeometryArena::init() {
+    TRACE("initializing geometry arena")
+    create_buffers(vertex_buffer, index_buffer, INITIAL_VERTEX_CAPACITY, INITIAL_INDEX_CAPACITY);
+    vertex_ranges.init(INITIAL_VERTEX_CAPACITY);
+    index_ranges.init(INITIAL_INDEX_CAPACITY);
+}
+
+void GeometryArena::close() {
+    vertex_buffer.close();
+    index_buffer.close();
+    ranges.clear();
+    live.clear();
+    free_handles.clear();
+}
+
+void GeometryArena::create_buffers(Buffer& vertices, Buffer& indices, uint32_t vertex_capacity, uint32_t index_capacity) {
+    vertices.init(static_cast<vk::DeviceSize>(vertex_capacity) * sizeof(Vertex),
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eDeviceLocal);
+    indices.init(static_cast<vk::DeviceSize>(index_capacity) * sizeof(uint32_t),
+        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eDeviceLocal);
+}
+
+void GeometryArena::transfer_barrier(vk::CommandBuffer command_buffer) {
+    //uploads recorded earlier in the batch may still be writing the ranges we copy
+    vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite);
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void GeometryArena::replace_buffers(Buffer&& vertices, Buffer&& indices) {
+    //the old buffers may still be read by frames in flight or by the copy we just recorded
+    auto& uploads = *context.upload_queue;
+    uploads.wait(uploads.flush());
+    context.device.waitIdle();
+
+    vertex_buffer.close();
+    index_buffer.close();
+    vertex_buffer = std::move(vertices);
+    index_buffer = std::move(indices);
+    version++;
+}
+
+void GeometryArena::grow(uint32_t vertex_capacity, uint32_t index_capacity) {
+    DEBUG("growing geometry arena to " << vertex_capacity << " vertices, " << index_capacity << " indices")
+
+    Buffer vertices(context);
+    Buffer indices(context);
+    create_buffers(vertices, indices, vertex_capacity, index_capacity);
+
+    //ranges keep their offsets, so the old contents can be copied over wholesale.
+    //the arena is owned by the graphics family once uploads are acquired, so copy there
+    auto command_buffer = context.upload_queue->get_graphics_command_buffer();
+    transfer_barrier(command_buffer);
+    vertex_buffer.copy(command_buffer, vertices);
+    index_buffer.copy(command_buffer, indices);
+    transfer_barrier(command_buffer);
+
+    //grow the free lists by appending the new space at the end
+    vertex_ranges.grow(vertex_capacity);
+    index_ranges.grow(index_capacity);
+
+    replace_buffers(std::move(vertices), std::move(indices));
+}
+
+GeometryHandle GeometryArena::allocate(const Mesh& mesh) {
+    uint32_t vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+    uint32_t index_count = static_cast<uint32_t>(mesh.indices.size());
+
+    vk::DeviceSize first_vertex = 0;
+    vk::DeviceSize first_index = 0;
+    if (!try_allocate(vertex_count, index_count, first_vertex, first_index)) {
+        uint32_t vertex_capacity = static_cast<uint32_t>(vertex_ranges.get_capacity()) * 2;
+        uint32_t index_capacity = static_cast<uint32_t>(index_ranges.get_capacity()) * 2;
+        while (vertex_capacity - vertex_ranges.get_used() < vertex_count) {
+            vertex_capacity *= 2;
+        }
+        while (index_capacity - index_ranges.get_used() < index_count) {
+            index_capacity *= 2;
+        }
+        grow(vertex_capacity, index_capacity);
+
+        if (!try_allocate(vertex_count, index_count, first_vertex, first_index)) {
+            throw std::runtime_error("geometry arena out of space after growing");
+        }
+    }
+
+    GeometryRange range{
+        static_cast<uint32_t>(first_vertex),
+        vertex_count,
+        static_cast<uint32_t>(first_index),
+        index_count,
+        0,
+        mesh.bounds.sphere
+    };
+
+    auto& uploads = *context.upload_queue;
+    uploads.upload_buffer(mesh.vertices.data(), sizeof(Vertex) * vertex_count, vertex_buffer.buffer, sizeof(Vertex) * range.first_vertex);
+    range.upload_ticket = uploads.upload_buffer(mesh.indices.data(), sizeof(uint32_t) * index_count, index_buffer.buffer, sizeof(uint32_t) * range.first_index);
+
+    GeometryHandle handle;
+    if (free_handles.empty()) {
+        handle = static_cast<GeometryHandle>(ranges.size());
+        ranges.push_back(range);
+        live.push_back(true);
+    }
+    else {
+        handle = free_handles.back();
+        free_handles.pop_back();
+        ranges[handle] = range;
+        live[handle] = true;
+    }
+
+    return handle;
+}
+
+bool GeometryArena::try_allocate(uint32_t vertex_count, uint32_t index_count, vk::DeviceSize& first_vertex, vk::DeviceSize& first_index) {
+    first_vertex = 0;
+    first_index = 0;
+
+    if (vertex_count > 0) {
+        first_vertex = vertex_ranges.allocate(vertex_count, 1);
+        if (first_vertex == RangeAllocator::INVALID_OFFSET) {
+            return false;
+        }
+    }
+
+    if (index_count > 0) {
+        first_index = index_ranges.allocate(index_count, 1);
+        if (first_index == RangeAllocator::INVALID_OFFSET) {
+            if (vertex_count > 0) {
+                vertex_ranges.free(first_vertex, vertex_count);
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void GeometryArena::free(GeometryHandle handle) {
+    if (handle == INVALID_HANDLE || !live.at(handle)) {
+        return;
+    }
+
+    const auto& range = ranges[handle];
+    if (range.vertex_count > 0) {
+        vertex_ranges.free(range.first_vertex, range.vertex_count);
+    }
+    if (range.index_count > 0) {
+        index_ranges.free(range.first_index, range.index_count);
+    }
+    live[handle] = false;
+    free_handles.push_back(handle);
+}
+
+bool GeometryArena::needs_compaction() const {
+    //lots of small holes that together could hold a big mesh
+    auto free_vertices = vertex_ranges.get_capacity() - vertex_ranges.get_used();
+    return vertex_ranges.free_range_count() > 64 && vertex_ranges.largest_free_range() < free_vertices / 2;
+}
+
+void GeometryArena::compact() {
+    DEBUG("compacting geometry arena")
+
+    uint32_t vertex_capacity = static_cast<uint32_t>(vertex_ranges.get_capacity());
+    uint32_t index_capacity = static_cast<uint32_t>(index_ranges.get_capacity());
+
+    Buffer vertices(context);
+    Buffer indices(context);
+    create_buffers(vertices, indices, vertex_capacity, index_capacity);
+
+    //copying inside one buffer would need non-overlapping regions, so pack into fresh buffers
+    std::vector<vk::BufferCopy> vertex_copies;
+    std::vector<vk::BufferCopy> index_copies;
+    uint32_t vertex_head = 0;
+    uint32_t index_head = 0;
+
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (!live[i]) {
+            continue;
+        }
+        auto& range = ranges[i];
+        if (range.vertex_count > 0) {
+            vertex_copies.push_back(vk::BufferCopy(sizeof(Vertex) * range.first_vertex, sizeof(Vertex) * vertex_head, sizeof(Vertex) * range.vertex_count));
+        }
+        if (range.index_count > 0) {
+            index_copies.push_back(vk::BufferCopy(sizeof(uint32_t) * range.first_index, sizeof(uint32_t) * index_head, sizeof(uint32_t) * range.index_count));
+        }
+        range.first_vertex = vertex_head;
+        range.first_index = index_head;
+        vertex_head += range.vertex_count;
+        index_head += range.index_count;
+    }
+
+    auto command_buffer = context.upload_queue->get_graphics_command_buffer();
+    transfer_barrier(command_buffer);
+    if (!vertex_copies.empty()) {
+        command_buffer.copyBuffer(vertex_buffer.buffer, vertices.buffer, static_cast<uint32_t>(vertex_copies.size()), vertex_copies.data());
+    }
+    if (!index_copies.empty()) {
+        command_buffer.copyBuffer(index_buffer.buffer, indices.buffer, static_cast<uint32_t>(index_copies.size()), index_copies.data());
+    }
+
+    vertex_ranges.init(vertex_capacity);
+    index_ranges.init(index_capacity);
+    if (vertex_head > 0) {
+        vertex_ranges.allocate(vertex_head, 1);
+    }
+    if (index_head > 0) {
+        index_ranges.allocate(index_head, 1);
+    }
+
+    replace_buffers(std::move(vertices), std::move(indices));
+}
+
+void GeometryArena::bind(CommandEncoder& encoder) const {
+    encoder.bind_vertex_buffer(0, vertex_buffer.buffer, 0);
+    encoder.bind_index_buffer(index_buffer.buffer, 0, vk::IndexType::eUint32);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "context.h"
+#include "buffer.h"
+#include "geometry.h"
+#include "command_encoder.h"
+
+typedef uint32_t GeometryHandle;
+
+struct GeometryRange {
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    uint32_t first_index;
+    uint32_t index_count;
+    uint64_t upload_ticket;
+    //object space bounding sphere, radius in w
+    glm::vec4 bounds;
+};
+
+//one device local vertex buffer and one index buffer shared by every mesh.
+//meshes get a range of each, drawn with drawIndexed(index_count, 1, first_index, first_vertex).
+//handles stay valid when the arena grows or compacts, the ranges behind them move
+class GeometryArena {
+public:
+    static constexpr uint32_t INITIAL_VERTEX_CAPACITY = 1024 * 1024;
+    static constexpr uint32_t INITIAL_INDEX_CAPACITY = 4 * 1024 * 1024;
+    static constexpr GeometryHandle INVALID_HANDLE = ~0u;
+
+    GeometryArena(Context& ctx) :
+        context(ctx),
+        vertex_buffer(ctx),
+        index_buffer(ctx) {}
+    GeometryArena(const GeometryArena& other) = delete;
+
+    void init();
+    void close();
+
+    GeometryHandle allocate(const Mesh& mesh);
+    void free(GeometryHandle handle);
+    const GeometryRange& get_range(GeometryHandle handle) const {
+        return ranges.at(handle);
+    }
+
+    //moves every live range to the front of fresh buffers. stalls the device, so only
+    //call it from a point where that's acceptable (eg. after a level unload)
+    void compact();
+    bool needs_compaction() const;
+
+    void bind(CommandEncoder& encoder) const;
+
+    //bumped whenever the buffers or ranges move, recorded draws are stale after that
+    uint32_t get_version() const {
+        return version;
+    }
+
+private:
+    Context& context;
+    Buffer vertex_buffer;
+    Buffer index_buffer;
+    RangeAllocator vertex_ranges;
+    RangeAllocator index_ranges;
+
+    std::vector<GeometryRange> ranges;
+    std::vector<bool> live;
+    std::vector<GeometryHandle> free_handles;
+    uint32_t version = 0;
+
+    bool try_allocate(uint32_t vertex_count, uint32_t index_count, vk::DeviceSize& first_vertex, vk::DeviceSize& first_index);
+    void create_buffers(Buffer& vertices, Buffer& indices, uint32_t vertex_capacity, uint32_t index_capacity);
+    void grow(uint32_t vertex_capacity, uint32_t index_capacity);
+    void transfer_barrier(vk::CommandBuffer command_buffer);
+    void replace_buffers(Buffer&& vertices, Buffer&& indices);
+};
@@ -0,0 +1,251 @@
+#include "gpu_culling.h"
+#include "log.h"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+void OcclusionStats::print() const {
+    DEBUG("gpu culling tested " << tested << " objects, " << frustum_culled << " outside the frustum, "
+        << occluded << " occluded, " << visible << " visible, " << late_draws << " drawn late")
+}
+
+void GpuCulling::init(vk::DescriptorSetLayout global_layout) {
+    TRACE("initializing gpu culling")
+
+    std::array<vk::DescriptorSetLayoutBinding, 6> bindings{
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+        vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+        vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+        vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute, nullptr),
+        vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute, nullptr)
+    };
+    vk::DescriptorSetLayoutCreateInfo create_info({}, static_cast<uint32_t>(bindings.size()), bindings.data());
+    descriptor_set_layout = context.device.createDescriptorSetLayout(create_info);
+
+    pipeline.init({ global_layout, descriptor_set_layout }, sizeof(CullPushConstants));
+}
+
+void GpuCulling::close() {
+    pipeline.close();
+    context.device.destroyDescriptorSetLayout(descriptor_set_layout);
+}
+
+void GpuCulling::init_buffers(uint32_t image_count, uint32_t count, vk::DescriptorPool pool) {
+    objects.init(image_count, count);
+    commands.init(image_count, count * PHASE_COUNT);
+    //at most one batch per object
+    counts.init(image_count, count * PHASE_COUNT);
+    visibility.init(image_count, count);
+    statistics.init(image_count, 1);
+    statistics_written.assign(image_count, false);
+
+    std::vector<vk::DescriptorSetLayout> layouts(image_count, descriptor_set_layout);
+    vk::DescriptorSetAllocateInfo allocate_info(pool, image_count, layouts.data());
+    descriptor_sets = context.device.allocateDescriptorSets(allocate_info);
+    object_counts.assign(image_count, 0);
+    batches.assign(image_count, {});
+    for (uint32_t i = 0; i < image_count; i++) {
+        write_descriptors(i);
+    }
+}
+
+void GpuCulling::close_buffers() {
+    //the sets go with the renderer's descriptor pool
+    descriptor_sets.clear();
+    object_counts.clear();
+    batches.clear();
+    objects.close();
+    commands.close();
+    counts.close();
+    visibility.close();
+    statistics.close();
+    statistics_written.clear();
+}
+
+void GpuCulling::write_descriptors(uint32_t image) {
+    std::array<vk::DescriptorBufferInfo, 5> infos{
+        objects.descriptor_info(image),
+        commands.descriptor_info(image),
+        counts.descriptor_info(image),
+        visibility.descriptor_info(image),
+        statistics.descriptor_info(image)
+    };
+    std::vector<vk::WriteDescriptorSet> writes(infos.size());
+    for (uint32_t i = 0; i < infos.size(); i++) {
+        writes[i] = vk::WriteDescriptorSet(descriptor_sets[image],
+            i,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            &infos[i],
+            nullptr);
+    }
+
+    //the pyramid comes with the render graph, which may not have been built yet
+    vk::DescriptorImageInfo pyramid_info(pyramid_sampler, pyramid_view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    if (pyramid_view != vk::ImageView(nullptr)) {
+        writes.push_back(vk::WriteDescriptorSet(descriptor_sets[image],
+            5,
+            0,
+            1,
+            vk::DescriptorType::eCombinedImageSampler,
+            &pyramid_info,
+            nullptr,
+            nullptr));
+    }
+    context.device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+bool GpuCulling::reserve(uint32_t image, uint32_t count) {
+    bool objects_grown = objects.reserve(image, count);
+    bool commands_grown = commands.reserve(image, count * PHASE_COUNT);
+    bool counts_grown = counts.reserve(image, count * PHASE_COUNT);
+    bool visibility_grown = visibility.reserve(image, count);
+    if (objects_grown || commands_grown || counts_grown || visibility_grown) {
+        write_descriptors(image);
+        return true;
+    }
+    return false;
+}
+
+void GpuCulling::set_depth_pyramid(vk::ImageView view, vk::Sampler sampler, vk::Extent2D extent, uint32_t levels) {
+    pyramid_view = view;
+    pyramid_sampler = sampler;
+    pyramid_extent = extent;
+    pyramid_levels = levels;
+    //the renderer has waited for the device before rebuilding the graph
+    for (uint32_t i = 0; i < descriptor_sets.size(); i++) {
+        write_descriptors(i);
+    }
+}
+
+void GpuCulling::begin(uint32_t image) {
+    current_image = image;
+    entries = objects.data<CullObjectData>(image);
+    object_counts.at(image) = 0;
+    batches.at(image).clear();
+    //the entries are about to change order, so start with nothing visible. the late phase
+    //draws everything that is for the first frame
+    std::memset(visibility.data<uint32_t>(image), 0, sizeof(uint32_t) * visibility.get_capacity(image));
+}
+
+uint32_t GpuCulling::begin_batch() {
+    auto& image_batches = batches[current_image];
+    image_batches.push_back(Batch{ object_counts[current_image], 0 });
+    return static_cast<uint32_t>(image_batches.size() - 1);
+}
+
+void GpuCulling::push(uint32_t object_index, const GeometryRange& range) {
+    auto& image_batches = batches[current_image];
+    auto& object_count = object_counts[current_image];
+    if (image_batches.empty()) {
+        throw std::runtime_error("culling object pushed outside a batch");
+    }
+    if (object_count >= objects.get_capacity(current_image)) {
+        throw std::runtime_error("culling buffer not reserved for this many objects");
+    }
+
+    auto& batch = image_batches.back();
+    auto& entry = entries[object_count];
+    entry.bounds = range.bounds;
+    entry.object_index = object_index;
+    entry.batch = static_cast<uint32_t>(image_batches.size() - 1);
+    entry.first_command = batch.first;
+    entry.index_count = range.index_count;
+    entry.first_index = range.first_index;
+    entry.vertex_offset = static_cast<int32_t>(range.first_vertex);
+
+    batch.count++;
+    object_count++;
+}
+
+void GpuCulling::record_cull(vk::CommandBuffer command_buffer, uint32_t image, vk::DescriptorSet global_set, uint32_t phase) {
+    uint32_t object_count = object_counts.at(image);
+    if (object_count == 0) {
+        return;
+    }
+    auto batch_count = static_cast<uint32_t>(batches[image].size());
+
+    //the early phase starts the frame, it resets both phases' counts and the statistics
+    bool compact = context.features.draw_indirect_count;
+    if (phase == EARLY) {
+        std::vector<vk::BufferMemoryBarrier> clear_barriers;
+        auto clear = [&](vk::Buffer buffer, vk::DeviceSize size) {
+            command_buffer.fillBuffer(buffer, 0, size, 0);
+            clear_barriers.push_back(vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite,
+                vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                buffer,
+                0,
+                VK_WHOLE_SIZE));
+        };
+        if (compact) {
+            clear(counts.get_buffer(image), sizeof(uint32_t) * batch_count * PHASE_COUNT);
+        }
+        clear(statistics.get_buffer(image), sizeof(OcclusionStats));
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+            {}, 0, nullptr, static_cast<uint32_t>(clear_barriers.size()), clear_barriers.data(), 0, nullptr);
+    }
+
+    std::array<vk::DescriptorSet, 2> sets{ global_set, descriptor_sets[image] };
+    command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.pipeline);
+    command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.layout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+
+    CullPushConstants constants{
+        object_count,
+        compact ? 1u : 0u,
+        phase,
+        phase * object_count,
+        phase * batch_count,
+        pyramid_extent.width,
+        pyramid_extent.height,
+        pyramid_levels
+    };
+    command_buffer.pushConstants(pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+    command_buffer.dispatch((object_count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    if (phase == LATE) {
+        vk::BufferMemoryBarrier read_barrier(vk::AccessFlagBits::eShaderWrite,
+            vk::AccessFlagBits::eHostRead,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            statistics.get_buffer(image),
+            0,
+            VK_WHOLE_SIZE);
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+            {}, 0, nullptr, 1, &read_barrier, 0, nullptr);
+        statistics_written.at(image) = true;
+    }
+}
+
+void GpuCulling::draw_batch(CommandEncoder& encoder, uint32_t image, uint32_t index, uint32_t phase) {
+    const auto& image_batches = batches.at(image);
+    const auto& batch = image_batches.at(index);
+    if (batch.count == 0) {
+        return;
+    }
+
+    auto stride = static_cast<uint32_t>(sizeof(vk::DrawIndexedIndirectCommand));
+    vk::DeviceSize offset = stride * (batch.first + phase * object_counts[image]);
+    if (context.features.draw_indirect_count) {
+        auto count_index = index + phase * static_cast<uint32_t>(image_batches.size());
+        encoder.draw_indexed_indirect_count(commands.get_buffer(image), offset,
+            counts.get_buffer(image), sizeof(uint32_t) * count_index,
+            batch.count, stride);
+    }
+    else {
+        encoder.draw_indexed_indirect(commands.get_buffer(image), offset, batch.count, stride);
+    }
+}
+
+bool GpuCulling::read_stats(uint32_t image, OcclusionStats& stats) {
+    if (image >= statistics_written.size() || !statistics_written[image]) {
+        return false;
+    }
+    stats = statistics.data<OcclusionStats>(image)[0];
+    return true;
+}
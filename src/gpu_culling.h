@@ -0,0 +1,146 @@
+#pragma once
+
+#include "context.h"
+#include "pipeline.h"
+#include "per_image_buffer.h"
+#include "geometry_arena.h"
+#include "command_encoder.h"
+
+//one per drawable object in the culling input, see cull_comp.glsl
+struct CullObjectData {
+    //object space bounding sphere, radius in w
+    alignas(16) glm::vec4 bounds;
+    uint32_t object_index;
+    uint32_t batch;
+    //first command slot of the batch
+    uint32_t first_command;
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t padding[2];
+};
+
+struct CullPushConstants {
+    uint32_t object_count;
+    //non zero when visible draws are compacted and counted, see GpuCulling
+    uint32_t compact;
+    uint32_t phase;
+    //where the phase's commands and counts start
+    uint32_t command_offset;
+    uint32_t count_offset;
+    uint32_t pyramid_width;
+    uint32_t pyramid_height;
+    uint32_t pyramid_levels;
+};
+
+//written by the late phase, see cull_comp.glsl
+struct OcclusionStats {
+    uint32_t tested = 0;
+    uint32_t frustum_culled = 0;
+    uint32_t occluded = 0;
+    uint32_t visible = 0;
+    //visible objects drawn in the late phase, because they weren't visible before
+    uint32_t late_draws = 0;
+    uint32_t padding[3] = {};
+
+    void print() const;
+};
+
+//gpu driven drawing. every drawable object gets an entry with its bounds and arena ranges,
+//grouped into batches that share a pipeline and material. each frame a compute pass culls the
+//entries against the view frustum and writes a VkDrawIndexedIndirectCommand and the object
+//index (into the instance buffer, set 0 binding 2) for each survivor, then every batch is one
+//indirect draw. entries are kept per swapchain image and only written again when the set of
+//objects changes, so the cpu doesn't look at individual objects per frame.
+//
+//with drawIndirectCount the visible draws of a batch are packed at its front and counted on
+//the gpu. without it every object keeps its slot and culled ones are drawn with no instances
+//
+//occlusion culling runs in two phases against a depth pyramid (see DepthPyramid). the early
+//phase draws what was visible the last time this image was drawn. the pyramid is built from
+//that depth, then the late phase tests everything in the frustum against it, remembers what
+//is visible and draws what the early phase missed. each phase has its own half of the command,
+//count and instance buffers. visibility is kept per swapchain image, so it lags a few frames
+//behind, which only costs some extra draws
+class GpuCulling {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+    static constexpr uint32_t EARLY = 0;
+    static constexpr uint32_t LATE = 1;
+    static constexpr uint32_t PHASE_COUNT = 2;
+
+    GpuCulling(Context& ctx) :
+        context(ctx),
+        pipeline(ctx, "cull"),
+        objects(ctx, sizeof(CullObjectData)),
+        commands(ctx, sizeof(vk::DrawIndexedIndirectCommand),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer),
+        counts(ctx, sizeof(uint32_t),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst),
+        visibility(ctx, sizeof(uint32_t)),
+        statistics(ctx, sizeof(OcclusionStats),
+            vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst) {}
+    GpuCulling(const GpuCulling& other) = delete;
+
+    //global_layout is the renderer's set 0, the shader reads the camera and object
+    //matrices from it and writes the instance indices
+    void init(vk::DescriptorSetLayout global_layout);
+    void close();
+    //per swapchain buffers, their descriptor sets come out of the renderer's pool
+    void init_buffers(uint32_t image_count, uint32_t object_count, vk::DescriptorPool pool);
+    void close_buffers();
+
+    //makes room for object_count objects, returns true if a buffer was replaced and the
+    //image's entries have to be written again
+    bool reserve(uint32_t image, uint32_t object_count);
+    //the level views of the pyramid the late phase tests against, rebuilt with the render graph
+    void set_depth_pyramid(vk::ImageView view, vk::Sampler sampler, vk::Extent2D extent, uint32_t levels);
+
+    //rewriting an image's entries: begin, then each batch followed by its objects
+    void begin(uint32_t image);
+    uint32_t begin_batch();
+    void push(uint32_t object_index, const GeometryRange& range);
+
+    //every frame and phase: record_cull before the render pass and draw_batch for every batch
+    //inside it. the render graph puts the barrier between the two. the early phase goes first
+    void record_cull(vk::CommandBuffer command_buffer, uint32_t image, vk::DescriptorSet global_set, uint32_t phase);
+    //the batch's pipeline, set 0 and material set must already be bound
+    void draw_batch(CommandEncoder& encoder, uint32_t image, uint32_t batch, uint32_t phase);
+
+    //statistics of the image's last frame, false if it has none yet. the image's last frame
+    //must have finished
+    bool read_stats(uint32_t image, OcclusionStats& stats);
+
+private:
+    struct Batch {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    Context& context;
+    ComputePipeline pipeline;
+    vk::DescriptorSetLayout descriptor_set_layout = nullptr;
+    std::vector<vk::DescriptorSet> descriptor_sets;
+
+    PerImageBuffer objects;
+    PerImageBuffer commands;
+    PerImageBuffer counts;
+    //per entry, non zero if the late phase found it visible
+    PerImageBuffer visibility;
+    PerImageBuffer statistics;
+    std::vector<bool> statistics_written;
+
+    vk::ImageView pyramid_view = nullptr;
+    vk::Sampler pyramid_sampler = nullptr;
+    vk::Extent2D pyramid_extent;
+    uint32_t pyramid_levels = 0;
+
+    //per swapchain image
+    std::vector<uint32_t> object_counts;
+    std::vector<std::vector<Batch>> batches;
+
+    uint32_t current_image = 0;
+    CullObjectData* entries = nullptr;
+
+    void write_descriptors(uint32_t image);
+};
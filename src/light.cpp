@@ -2,6 +2,17 @@
 
 #include "light.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+
+float Light::get_range() const
+{
+	if (range > 0.0f) {
+		return range;
+	}
+	float brightness = std::max(color.r, std::max(color.g, color.b));
+	return std::sqrt(std::max(brightness, 0.0f) / MIN_RADIANCE);
+}
 
 Light& LightManager::create_light()
 {
@@ -9,14 +20,25 @@ Light& LightManager::create_light()
 	return lights.back();
 }
 
-void LightManager::assign_lightdata(UniformBufferObject& ubo)
+void LightManager::update()
 {
-	int i = 0;
-	for (const auto& light : lights) {
-		ubo.lights[i++] = {
-			light.transform.matrix(),
-			light.color
-		};
+	if (records.size() != lights.size()) {
+		records.resize(lights.size());
+		culler.resize(static_cast<uint32_t>(lights.size()));
+		//force a rebuild of every slot
+		light_versions.assign(lights.size(), ~0u);
 	}
-	ubo.num_lights = i;
-}
\ No newline at end of file
+
+	for (uint32_t i = 0; i < lights.size(); i++) {
+		const auto& light = lights[i];
+		if (light_versions[i] != light.get_version()) {
+			auto& record = records[i];
+			record.position = glm::vec3(light.transform.matrix()[3]);
+			record.range = light.get_range();
+			record.color = glm::vec3(light.get_color());
+			record.type = static_cast<uint32_t>(LightType::Point);
+			culler.set_sphere(i, record.position, record.range);
+			light_versions[i] = light.get_version();
+		}
+	}
+}
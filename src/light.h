@@ -2,18 +2,63 @@
 
 #include "context.h"
 #include "transform.h"
+#include "culling.h"
 
 class Light {
 public:
+	//falloff reaching this is where an automatic range ends
+	static constexpr float MIN_RADIANCE = 0.01f;
+
 	Light() : transform({}), color(0) {}
 	Transform transform;
-	glm::vec4 color;
 
+	const glm::vec4& get_color() const {
+		return color;
+	}
+	void set_color(const glm::vec4& c) {
+		color = c;
+		property_version++;
+	}
+	//0 picks a range from the color's brightness
+	void set_range(float r) {
+		range = r;
+		property_version++;
+	}
+	//nothing past this is lit, which is what lets lights be sorted into clusters
+	float get_range() const;
+	//changes whenever the transform, color or range does
+	uint32_t get_version() const {
+		return transform.get_version() + property_version;
+	}
+
+private:
+	glm::vec4 color;
+	float range = 0.0f;
+	uint32_t property_version = 0;
 };
 
 class LightManager {
 public:
 	std::vector<Light> lights;
 	Light& create_light();
-	void assign_lightdata(UniformBufferObject& ubo);
-};
\ No newline at end of file
+	//rebuilds the spheres and records of lights that changed since the last call, the rest
+	//come from a cache
+	void update();
+	//indices of the lights whose range reaches into the frustum, as of the last update
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) {
+		culler.cull(frustum, visible);
+	}
+	//what the shaders read of every light, indexed like lights
+	const std::vector<LightRecord>& get_records() const {
+		return records;
+	}
+	const CullingStats& get_culling_stats() const {
+		return culler.get_stats();
+	}
+
+private:
+	//positions and ranges, an array per component
+	SphereCuller culler;
+	std::vector<LightRecord> records;
+	std::vector<uint32_t> light_versions;
+};
@@ -0,0 +1,138 @@
+#include "light_clusters.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+void LightClusterStats::print() const {
+    DEBUG("light clusters: " << visible_lights << " of " << lights << " lights visible, " << assigned_lights << " assigned, "
+        << indices << " cluster entries, at most " << max_cluster_lights << " lights per cluster")
+}
+
+void LightClusters::init(uint32_t image_count) {
+    lights.init(image_count, 0);
+    clusters.init(image_count, CLUSTER_COUNT);
+    indices.init(image_count, CLUSTER_COUNT);
+}
+
+void LightClusters::close() {
+    lights.close();
+    clusters.close();
+    indices.close();
+}
+
+bool LightClusters::update(uint32_t image, const std::vector<LightRecord>& records, const std::vector<uint32_t>& visible,
+    const glm::mat4& V, const glm::mat4& P, float near_clip, float far_clip, vk::Extent2D extent) {
+    //the buffer and the cluster lists only hold the visible lights
+    auto light_count = static_cast<uint32_t>(visible.size());
+    float tile_width = std::ceil(extent.width / static_cast<float>(TILES_X));
+    float tile_height = std::ceil(extent.height / static_cast<float>(TILES_Y));
+    //slice = log(depth / near) / log(far / near) * SLICES
+    float depth_scale = SLICES / std::log(far_clip / near_clip);
+    float depth_bias = -std::log(near_clip) * depth_scale;
+    grid = glm::uvec4(TILES_X, TILES_Y, SLICES, light_count);
+    params = glm::vec4(tile_width, tile_height, depth_scale, depth_bias);
+
+    auto get_slice = [&](float depth) {
+        float slice = std::floor(std::log(depth) * depth_scale + depth_bias);
+        return static_cast<uint32_t>(std::clamp(slice, 0.0f, static_cast<float>(SLICES - 1)));
+    };
+    auto get_tile = [](float position, float size, uint32_t count) {
+        return static_cast<uint32_t>(std::clamp(std::floor(position / size), 0.0f, static_cast<float>(count - 1)));
+    };
+
+    stats = LightClusterStats{};
+    stats.lights = static_cast<uint32_t>(records.size());
+    stats.visible_lights = light_count;
+    ranges.resize(light_count);
+    counts.assign(CLUSTER_COUNT, 0);
+    glm::vec2 screen_size(static_cast<float>(extent.width), static_cast<float>(extent.height));
+    for (uint32_t i = 0; i < light_count; i++) {
+        const auto& light = records[visible[i]];
+        auto& range = ranges[i];
+        //empty unless the light reaches into the frustum
+        range.min = glm::uvec3(1);
+        range.max = glm::uvec3(0);
+
+        glm::vec3 center = glm::vec3(V * glm::vec4(light.position, 1.0f));
+        float depth = -center.z;
+        float depth_min = std::max(depth - light.range, near_clip);
+        float depth_max = std::min(depth + light.range, far_clip);
+        if (light.range <= 0.0f || depth_min > depth_max) {
+            continue;
+        }
+
+        //the box around the sphere, cut to the depths in the frustum, is in front of the
+        //camera, so its corners bound it on screen
+        glm::vec2 screen_min(FLT_MAX);
+        glm::vec2 screen_max(-FLT_MAX);
+        for (uint32_t corner = 0; corner < 8; corner++) {
+            glm::vec3 position(
+                center.x + (corner & 1 ? light.range : -light.range),
+                center.y + (corner & 2 ? light.range : -light.range),
+                corner & 4 ? -depth_min : -depth_max);
+            glm::vec4 clip = P * glm::vec4(position, 1.0f);
+            glm::vec2 screen = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * screen_size;
+            screen_min = glm::min(screen_min, screen);
+            screen_max = glm::max(screen_max, screen);
+        }
+        if (screen_max.x < 0.0f || screen_max.y < 0.0f || screen_min.x >= screen_size.x || screen_min.y >= screen_size.y) {
+            continue;
+        }
+
+        range.min = glm::uvec3(get_tile(screen_min.x, tile_width, TILES_X), get_tile(screen_min.y, tile_height, TILES_Y), get_slice(depth_min));
+        range.max = glm::uvec3(get_tile(screen_max.x, tile_width, TILES_X), get_tile(screen_max.y, tile_height, TILES_Y), get_slice(depth_max));
+        for (uint32_t z = range.min.z; z <= range.max.z; z++) {
+            for (uint32_t y = range.min.y; y <= range.max.y; y++) {
+                for (uint32_t x = range.min.x; x <= range.max.x; x++) {
+                    counts[x + TILES_X * (y + TILES_Y * z)]++;
+                }
+            }
+        }
+        stats.assigned_lights++;
+    }
+
+    //each cluster's list starts where the one before ends
+    uint32_t total = 0;
+    for (auto count : counts) {
+        total += count;
+        stats.max_cluster_lights = std::max(stats.max_cluster_lights, count);
+    }
+    stats.indices = total;
+
+    bool lights_grown = lights.reserve(image, light_count);
+    bool indices_grown = indices.reserve(image, total);
+
+    auto light_records = lights.data<LightRecord>(image);
+    for (uint32_t i = 0; i < light_count; i++) {
+        light_records[i] = records[visible[i]];
+    }
+    auto cluster_records = clusters.data<ClusterRecord>(image);
+    uint32_t offset = 0;
+    for (uint32_t c = 0; c < CLUSTER_COUNT; c++) {
+        cluster_records[c] = ClusterRecord{ offset, counts[c] };
+        offset += counts[c];
+        //now where the next index goes
+        counts[c] = cluster_records[c].offset;
+    }
+
+    auto light_indices = indices.data<uint32_t>(image);
+    for (uint32_t i = 0; i < light_count; i++) {
+        const auto& range = ranges[i];
+        for (uint32_t z = range.min.z; z <= range.max.z; z++) {
+            for (uint32_t y = range.min.y; y <= range.max.y; y++) {
+                for (uint32_t x = range.min.x; x <= range.max.x; x++) {
+                    light_indices[counts[x + TILES_X * (y + TILES_Y * z)]++] = i;
+                }
+            }
+        }
+    }
+
+    return lights_grown || indices_grown;
+}
+
+void LightClusters::fill_globals(UniformBufferObject& ubo) const {
+    ubo.cluster_grid = grid;
+    ubo.cluster_params = params;
+}
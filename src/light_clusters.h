@@ -0,0 +1,83 @@
+#pragma once
+
+#include "context.h"
+#include "per_image_buffer.h"
+
+#include <array>
+#include <vector>
+
+//where a cluster's light indices start in the index buffer and how many there are
+struct ClusterRecord {
+    uint32_t offset;
+    uint32_t count;
+};
+
+struct LightClusterStats {
+    uint32_t lights = 0;
+    //lights that passed frustum culling, only these are uploaded
+    uint32_t visible_lights = 0;
+    //lights in range of any cluster, and the index entries they took
+    uint32_t assigned_lights = 0;
+    uint32_t indices = 0;
+    uint32_t max_cluster_lights = 0;
+
+    void print() const;
+};
+
+//clustered forward lighting. the view frustum is split into a grid of TILES_X * TILES_Y
+//screen tiles and SLICES depth slices, spaced exponentially between the near and far plane.
+//every frame each visible light's sphere is turned into the range of clusters its screen space box
+//and depth range overlap, and every cluster gets a list of those lights. the fragment
+//shaders find their cluster from gl_FragCoord and the view depth and only loop over its
+//list, see lighting.glsl.
+//
+//lights (set 0 binding 3), clusters (binding 4) and the light index lists (binding 5) are
+//per image buffers written on the cpu
+class LightClusters {
+public:
+    static constexpr uint32_t TILES_X = 16;
+    static constexpr uint32_t TILES_Y = 9;
+    static constexpr uint32_t SLICES = 24;
+    static constexpr uint32_t CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+    LightClusters(Context& ctx) :
+        lights(ctx, sizeof(LightRecord)),
+        clusters(ctx, sizeof(ClusterRecord)),
+        indices(ctx, sizeof(uint32_t)) {}
+    LightClusters(const LightClusters& other) = delete;
+
+    void init(uint32_t image_count);
+    void close();
+
+    //assigns the visible lights to the clusters of a camera and writes the image's buffers,
+    //with only the visible records in the light buffer. returns true if a buffer was
+    //replaced and the image's descriptors have to be written again
+    bool update(uint32_t image, const std::vector<LightRecord>& records, const std::vector<uint32_t>& visible,
+        const glm::mat4& V, const glm::mat4& P, float near_clip, float far_clip, vk::Extent2D extent);
+    //the grid of the last update, for the globals
+    void fill_globals(UniformBufferObject& ubo) const;
+
+    //lights, clusters and light indices, bindings 3 to 5
+    std::array<vk::DescriptorBufferInfo, 3> descriptor_infos(uint32_t image) const {
+        return { lights.descriptor_info(image), clusters.descriptor_info(image), indices.descriptor_info(image) };
+    }
+    const LightClusterStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    //clusters a light overlaps, inclusive
+    struct ClusterRange {
+        glm::uvec3 min;
+        glm::uvec3 max;
+    };
+
+    PerImageBuffer lights;
+    PerImageBuffer clusters;
+    PerImageBuffer indices;
+    glm::uvec4 grid{ TILES_X, TILES_Y, SLICES, 0 };
+    glm::vec4 params{ 1.0f };
+    std::vector<ClusterRange> ranges;
+    std::vector<uint32_t> counts;
+    LightClusterStats stats;
+};
@@ -32,6 +32,10 @@ private:
     MeshObject* plane2;
     Light* point_light;
     float plane2_rot = 0.0f;
+    //P toggles the depth prepass, for comparing fragment shader invocations
+    bool prepass_key_down = false;
+    //G toggles deferred shading, to compare it with forward on the same scene
+    bool deferred_key_down = false;
     ColoredMaterial *colored_mat;
     glm::vec4 color{0.0f, 0.0f, 1.0f, 1.0f};
 };
@@ -42,14 +46,20 @@ void Application::run() {
 
     auto &scene = engine.create_sceneobject();
     auto model = engine.asset_manager.get_model("city-scene");
+    //the city is static, draws outside the camera's pvs cell are skipped
+    engine.asset_manager.get_pvs("city-scene");
     scene.load_model(engine, model);
+    //and never moves, so the lights only draw its shadows again when they move
+    scene.set_static(true);
+    //its big low poly buildings hide most of the city on the cpu culling path
+    scene.set_occluders(20.0f, 2048);
 
     point_light = &engine.renderer.get_light_manager().create_light();
-    point_light->color = glm::vec4(50, 50, 50, 1);
-    point_light->transform.position = glm::vec3(3.0, 20.0, 3.0);
+    point_light->set_color(glm::vec4(50, 50, 50, 1));
+    point_light->transform.set_position(glm::vec3(3.0, 20.0, 3.0));
     auto &point_light2 = engine.renderer.get_light_manager().create_light();
-    point_light2.color = glm::vec4(20, 70, 50, 1);
-    point_light2.transform.position = glm::vec3(10.0, 3.0, 3.0);
+    point_light2.set_color(glm::vec4(20, 70, 50, 1));
+    point_light2.transform.set_position(glm::vec3(10.0, 3.0, 3.0));
 
 
     //auto hydrant = engine.asset_manager.get_model("fire-hydrant");
@@ -59,13 +69,13 @@ void Application::run() {
     //plane->mesh_renderer->load(hydrant->meshes.at("Object_0_0"));
     //auto hydrant = engine.asset_manager.get_model("cube");
     //plane->mesh_renderer->load(hydrant->meshes.at("defaultobject"));
-    //plane->transform.scale = glm::vec3(0.05, 0.05, 0.05);
+    //plane->transform.set_scale(glm::vec3(0.05, 0.05, 0.05));
     //plane->transform.set_rotation(glm::vec3(glm::radians(90.0), 0, 0));
-    //plane->transform.position = glm::vec3(0, 0, -1.0f);
+    //plane->transform.set_position(glm::vec3(0, 0, -1.0f));
 
     //plane2 = &engine.create_meshobject();
     //plane2->mesh_renderer->load(QUAD);
-    //plane2->transform.position = glm::vec3(0, 0, -0.3);
+    //plane2->transform.set_position(glm::vec3(0, 0, -0.3));
 
     init_window(800, 600);
     engine.init(*window);
@@ -97,8 +107,8 @@ void Application::run() {
     engine.camera->aspect = window->width / (float)window->height;
     engine.camera->near_clip = 0.1f;
     engine.camera->far_clip = 100.0;
-    engine.camera->transform.position = glm::vec3(20.0f, 20.0f, 20.0f);
-    engine.camera->transform.rotation = glm::quatLookAt(glm::normalize(glm::vec3(0) - glm::vec3(40.0)), glm::vec3(0, 1, 0));
+    engine.camera->transform.set_position(glm::vec3(20.0f, 20.0f, 20.0f));
+    engine.camera->transform.set_rotation(glm::quatLookAt(glm::normalize(glm::vec3(0) - glm::vec3(40.0)), glm::vec3(0, 1, 0)));
 
     main_loop();
     
@@ -106,10 +116,21 @@ void Application::run() {
 }
 
 void Application::update() {
+    bool prepass_key = window->is_key_down(GLFW_KEY_P);
+    if (prepass_key && !prepass_key_down) {
+        engine.renderer.set_depth_prepass(!engine.renderer.get_depth_prepass());
+    }
+    prepass_key_down = prepass_key;
+    bool deferred_key = window->is_key_down(GLFW_KEY_G);
+    if (deferred_key && !deferred_key_down) {
+        engine.renderer.set_deferred(!engine.renderer.get_deferred());
+    }
+    deferred_key_down = deferred_key;
+
     //plane_rot = plane_rot + glm::radians(90.0f) * engine.clock.delta_time;
     //plane->transform.set_rotation(glm::vec3(glm::radians(90.0), 0, plane_rot));
     
-    //point_light->transform.position.y += engine.clock.delta_time * 1.0;
+    //point_light->transform.set_position(point_light->transform.get_position() + glm::vec3(0, engine.clock.delta_time * 1.0, 0));
 
     //plane2_rot = plane2_rot - glm::radians(90.0f) * engine.clock.delta_time;
     //plane2->transform.set_rotation(glm::vec3(0, 0, plane2_rot));
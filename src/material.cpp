@@ -1,5 +1,7 @@
 #include "material.h"
 
+#include <algorithm>
+
 
 void MaterialType::init_descriptor_set_layout() {
 	std::cout << "initing mattype " << name << std::endl;
@@ -56,18 +58,44 @@ void MaterialType::init_descriptor_set_layout() {
 	}
 }
 
-void MaterialType::init(vk::Extent2D extent, vk::RenderPass renderpass, vk::DescriptorSetLayout global_layout) {
-	init_descriptor_set_layout();
-	rebuild_pipeline(extent, renderpass, global_layout);
+void MaterialType::rebuild_pipeline(vk::Extent2D extent, vk::RenderPass renderpass, vk::DescriptorSetLayout global_layout)
+{
+	std::vector<vk::DescriptorSetLayout> layouts{ global_layout };
+	if (descriptor_set_layout != vk::DescriptorSetLayout(nullptr)) {
+		layouts.push_back(descriptor_set_layout);
+	}
+
+	//only the fragment closest to the camera passes once the prepass has written depth
+	PipelineOptions prepassed;
+	prepassed.depth_compare = vk::CompareOp::eEqual;
+	prepassed.depth_write = false;
+
+	pipeline.init(extent, renderpass, layouts);
+	prepassed_pipeline.init(extent, renderpass, layouts, prepassed);
 }
 
-void MaterialType::rebuild_pipeline(vk::Extent2D extent, vk::RenderPass renderpass, vk::DescriptorSetLayout global_layout)
+void MaterialType::init_gbuffer_pipeline(vk::Extent2D extent, vk::RenderPass renderpass, vk::DescriptorSetLayout global_layout, bool depth_prepass)
 {
-	if (descriptor_set_layout == vk::DescriptorSetLayout(nullptr)) {
-		pipeline.init(extent, renderpass, { global_layout });
+	std::vector<vk::DescriptorSetLayout> layouts{ global_layout };
+	if (descriptor_set_layout != vk::DescriptorSetLayout(nullptr)) {
+		layouts.push_back(descriptor_set_layout);
 	}
-	else {
-		pipeline.init(extent, renderpass, { global_layout, descriptor_set_layout });
+
+	//albedo, normal and roughness/metallic, which blending would only mix up
+	PipelineOptions options;
+	options.fragment_prefix = name + "_gbuffer";
+	options.color_attachments = 3;
+	options.blend = false;
+	if (depth_prepass) {
+		options.depth_compare = vk::CompareOp::eEqual;
+		options.depth_write = false;
+	}
+	gbuffer_pipeline.init(extent, renderpass, layouts, options);
+}
+
+void MaterialType::close_gbuffer_pipeline() {
+	if (gbuffer_pipeline.pipeline != vk::Pipeline(nullptr)) {
+		gbuffer_pipeline.close();
 	}
 }
 
@@ -80,18 +108,27 @@ void MaterialType::close_layout()
 
 void MaterialType::close_pipeline() {
 	pipeline.close();
+	prepassed_pipeline.close();
 }
 
 void MaterialManager::init()
 {
 	MaterialType basic_material(context, "basic");
+	basic_material.id = 0;
 	material_types.insert(std::make_pair("basic", std::move(basic_material)));
 
-	MaterialType colored_material(context, "colored");
+	MaterialType colored_material(context, "colored", true);
+	colored_material.id = 1;
 	material_types.insert(std::make_pair("colored", std::move(colored_material)));
 
-	MaterialType standard_material(context, "standard");
+	MaterialType standard_material(context, "standard", true);
+	standard_material.id = 2;
 	material_types.insert(std::make_pair("standard", std::move(standard_material)));
+
+	//the render graph may build g-buffer pipelines before the others
+	for (auto& type : material_types) {
+		type.second.init_descriptor_set_layout();
+	}
 }
 
 void MaterialManager::close_layouts()
@@ -108,6 +145,22 @@ void MaterialManager::close_pipelines()
 	}
 }
 
+void MaterialManager::update_dirty()
+{
+	for (auto material : dirty_materials) {
+		material->update_if_dirty();
+	}
+	dirty_materials.clear();
+}
+
+void Material::mark_dirty()
+{
+	if (!dirty && dirty_list != nullptr) {
+		dirty_list->push_back(this);
+	}
+	dirty = true;
+}
+
 vk::DescriptorSet Material::get_descriptor_set()
 {
 	return descriptor_set;
@@ -126,6 +179,7 @@ void BasicMaterial::init_descriptor_set(vk::DescriptorPool& descriptor_pool, Ass
 
 	auto img = asset_manager.get_texture(albedo_texture);
 	vk::DescriptorImageInfo image_info(img->sampler, img->image_view, img->get_layout());
+	upload_ticket = img->upload_ticket;
 
 	std::array<vk::WriteDescriptorSet, 1> writes{
 			vk::WriteDescriptorSet(descriptor_set,
@@ -174,7 +228,7 @@ void ColoredMaterial::update_if_dirty() {
 
 void ColoredMaterial::set_color(glm::vec4 color) {
 	uniforms.color = color;
-	dirty = true;
+	mark_dirty();
 }
 
 void ColoredMaterial::init() {
@@ -219,6 +273,7 @@ void StandardMaterial::init_descriptor_set(vk::DescriptorPool& descriptor_pool,
 	vk::DescriptorImageInfo normal_image_info(normal_tex->sampler, normal_tex->image_view, normal_tex->get_layout());
 	auto props_tex = asset_manager.get_texture(pbr_map);
 	vk::DescriptorImageInfo props_image_info(props_tex->sampler, props_tex->image_view, props_tex->get_layout());
+	upload_ticket = std::max({ albedo_tex->upload_ticket, normal_tex->upload_ticket, props_tex->upload_ticket });
 
 	//TODO: use dynamic here
 	vk::DescriptorBufferInfo buffer_info(uniform_buffer.buffer, 0, sizeof(Uniforms));
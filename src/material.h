@@ -9,30 +9,52 @@ class MaterialType {
 public:
 	std::string name;
 	Pipeline pipeline;
+	//same shaders for after a depth prepass: depth equal and no depth writes
+	Pipeline prepassed_pipeline;
+	//writes the g-buffer instead of shading, for deferred shading. only exists while the
+	//render graph has a g-buffer pass, see has_gbuffer
+	Pipeline gbuffer_pipeline;
 	vk::DescriptorSetLayout descriptor_set_layout;
+	//draw sort key id, assigned by MaterialManager
+	uint32_t id = 0;
 
-	MaterialType(Context& ctx, std::string mat_name) : 
+	//gbuffer if the type comes with a shader/<name>_gbuffer_frag.spv
+	MaterialType(Context& ctx, std::string mat_name, bool gbuffer = false) : 
 		context(ctx),
 		pipeline(ctx, mat_name),
-		name(mat_name) {}
+		prepassed_pipeline(ctx, mat_name),
+		gbuffer_pipeline(ctx, mat_name),
+		name(mat_name),
+		gbuffer(gbuffer) {}
 
 	MaterialType(const MaterialType& other) = delete;
 	MaterialType(MaterialType&& other): 
 		context(other.context), 
 		pipeline(other.pipeline),
-		name(other.name) {
+		prepassed_pipeline(other.prepassed_pipeline),
+		gbuffer_pipeline(other.gbuffer_pipeline),
+		name(other.name),
+		id(other.id),
+		gbuffer(other.gbuffer) {
 		descriptor_set_layout = other.descriptor_set_layout;
 		other.descriptor_set_layout = nullptr;
 	}
 	
-	void init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, vk::DescriptorSetLayout global_layout);
+	void init_descriptor_set_layout();
 	void close_pipeline();
 	void rebuild_pipeline(vk::Extent2D viewport_extent, vk::RenderPass renderpass, vk::DescriptorSetLayout global_layout);
 	void close_layout();
 
+	//types without a g-buffer shader are drawn forward in deferred mode
+	bool has_gbuffer() const {
+		return gbuffer;
+	}
+	void init_gbuffer_pipeline(vk::Extent2D viewport_extent, vk::RenderPass renderpass, vk::DescriptorSetLayout global_layout, bool depth_prepass);
+	void close_gbuffer_pipeline();
+
 private:
 	Context& context;
-	void init_descriptor_set_layout();
+	bool gbuffer;
 };
 
 
@@ -46,12 +68,22 @@ public:
 	Material(Material& other) = delete;
 
 	MaterialType& material_type;
-	Pipeline &get_pipeline() const {
-		return material_type.pipeline;
+	//draw sort key id, assigned by MaterialManager
+	uint32_t id = 0;
+	//the g-buffer pipeline is built for whether there is a prepass or not
+	Pipeline &get_pipeline(bool depth_prepass = false, bool gbuffer = false) const {
+		if (gbuffer) {
+			return material_type.gbuffer_pipeline;
+		}
+		return depth_prepass ? material_type.prepassed_pipeline : material_type.pipeline;
 	}
 
 	vk::DescriptorSet get_descriptor_set();
 	void remove_descriptor_set();
+	//latest upload batch of the textures in the descriptor set
+	uint64_t get_upload_ticket() const {
+		return upload_ticket;
+	}
 
     virtual void init(){};
     virtual void close() {};
@@ -63,6 +95,14 @@ protected:
 	Context& context;
 	vk::DescriptorSet descriptor_set;
 	bool dirty;
+	uint64_t upload_ticket = 0;
+
+	//queues the material for MaterialManager::update_dirty
+	void mark_dirty();
+
+private:
+	friend class MaterialManager;
+	std::vector<Material*>* dirty_list = nullptr;
 };
 
 class BasicMaterial : public Material {
@@ -122,14 +162,20 @@ public:
 	template<class T> std::unique_ptr<T> get_instance(const std::string& type) {
 		auto& mt = material_types.at(type);
 		auto res = std::make_unique<T>(context, mt);
+		res->dirty_list = &dirty_materials;
+		res->id = next_material_id++;
         res->init();
         return res;
     }
 
     void init();
+	//pushes changed material parameters to their buffers
+	void update_dirty();
 	void close_layouts();
 	void close_pipelines();
 
 private:
 	Context& context;
-};
+	std::vector<Material*> dirty_materials;
+	uint32_t next_material_id = 0;
+};
\ No newline at end of file
@@ -8,29 +8,8 @@ void MeshRenderer::load(const Mesh &msh)
 
 void MeshRenderer::init(Renderer &renderer)
 {
-    //vertex buffer
-    vk::DeviceSize size = sizeof(Vertex) * mesh->vertices.size();
-
-    vertex_buffer.init(size,
-        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-    Buffer vstaging = vertex_buffer.get_staging();
-    vstaging.store(mesh->vertices.data());
-    vstaging.copy(context.command_pool, vertex_buffer);
-    vstaging.close();
-
-    //index_buffer
-    size = sizeof(mesh->indices[0]) * mesh->indices.size();
-
-    index_buffer.init(size,
-        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-        vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-    Buffer istaging = index_buffer.get_staging();
-    istaging.store(mesh->indices.data());
-    istaging.copy(context.command_pool, index_buffer);
-    istaging.close();
+    mesh_cache = &renderer.get_mesh_cache();
+    geometry = mesh_cache->acquire(*mesh);
 
     //add to renderers list
     renderer.register_mesh(this);
@@ -38,15 +17,19 @@ void MeshRenderer::init(Renderer &renderer)
 
 void MeshRenderer::close()
 {
-    index_buffer.close();
-    vertex_buffer.close();
+    if (mesh_cache != nullptr && geometry != GeometryArena::INVALID_HANDLE) {
+        mesh_cache->release(*mesh);
+        geometry = GeometryArena::INVALID_HANDLE;
+    }
+}
+
+uint64_t MeshRenderer::get_upload_ticket() const
+{
+    return mesh_cache->get_arena().get_range(geometry).upload_ticket;
 }
 
-void MeshRenderer::command_buffer(vk::CommandBuffer& command_buffer)
+void MeshRenderer::command_buffer(CommandEncoder& encoder, uint32_t first_instance, uint32_t instance_count)
 {
-    vk::Buffer vertex_buffers[] = { vertex_buffer.buffer };
-    vk::DeviceSize offsets[] = { 0 };
-    command_buffer.bindVertexBuffers(0, 1, vertex_buffers, offsets);
-    command_buffer.bindIndexBuffer(index_buffer.buffer, 0, vk::IndexType::eUint32);
-    command_buffer.drawIndexed(static_cast<uint32_t>(mesh->indices.size()), 1, 0, 0, 0);
+    const auto& range = mesh_cache->get_arena().get_range(geometry);
+    encoder.draw_indexed(range.index_count, instance_count, range.first_index, static_cast<int32_t>(range.first_vertex), first_instance);
 }
\ No newline at end of file
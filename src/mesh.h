@@ -2,23 +2,38 @@
 #include "geometry.h"
 #include "buffer.h"
 #include "material.h"
+#include "transform.h"
+#include "mesh_cache.h"
 
 class Renderer;
 class Material;
+class PotentiallyVisibleSet;
 
 class MeshRenderer {
 public:
 	MeshRenderer(Context& ctx) : 
 		context(ctx), 
-		vertex_buffer(ctx), 
-		index_buffer(ctx), 
 		mesh(nullptr),
 		material(nullptr) {};
 
-	Buffer vertex_buffer;
-	Buffer index_buffer;
 	const Mesh *mesh;
 	Material *material;
+	//owner's transform, tracked by the renderer so only changes reach the object buffer
+	Transform *transform = nullptr;
+	//slot in the object buffer, assigned by Renderer::register_mesh
+	uint32_t object_index = 0;
+	//vertex and index ranges in the renderer's geometry arena, shared with every
+	//other renderer of the same mesh
+	GeometryHandle geometry = GeometryArena::INVALID_HANDLE;
+	//drawn into the software occlusion buffer on the cpu path, for large simple meshes
+	//like walls and terrain
+	bool occluder = false;
+	//doesn't move, its shadows are cached per light. may be changed at any time, the shadow
+	//atlas picks it up on the next frame
+	bool is_static = false;
+	//the owning model's pvs and this object's node in it, nullptr if it has none
+	const PotentiallyVisibleSet* pvs = nullptr;
+	uint32_t pvs_node = 0;
 	
 	MeshRenderer(MeshRenderer& other) = delete;
 
@@ -26,10 +41,16 @@ public:
 	void init(Renderer &renderer);
 	void close();
 
-	void command_buffer(vk::CommandBuffer& cb);
+	//batch holding the vertex and index uploads
+	uint64_t get_upload_ticket() const;
+
+	//arena buffers must already be bound. draws instance_count instances whose object
+	//indices start at first_instance in the instance buffer
+	void command_buffer(CommandEncoder& encoder, uint32_t first_instance, uint32_t instance_count);
 
 private:
 	Context& context;
+	MeshCache* mesh_cache = nullptr;
 	
 
 };
\ No newline at end of file
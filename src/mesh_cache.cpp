@@ -0,0 +1,42 @@
+#include "mesh_cache.h"
+#include "log.h"
+
+#include <stdexcept>
+
+GeometryHandle MeshCache::acquire(const Mesh& mesh) {
+    reference_count++;
+
+    auto it = entries.find(&mesh);
+    if (it != entries.end()) {
+        it->second.references++;
+        return it->second.handle;
+    }
+
+    auto handle = arena.allocate(mesh);
+    entries[&mesh] = Entry{ handle, 1 };
+    return handle;
+}
+
+void MeshCache::release(const Mesh& mesh) {
+    auto it = entries.find(&mesh);
+    if (it == entries.end()) {
+        throw std::runtime_error("released a mesh that isn't in the mesh cache");
+    }
+
+    reference_count--;
+    if (--it->second.references == 0) {
+        arena.free(it->second.handle);
+        entries.erase(it);
+    }
+}
+
+void MeshCache::close() {
+    if (!entries.empty()) {
+        DEBUG("mesh cache still holds " << entries.size() << " meshes on close")
+    }
+    for (auto& entry : entries) {
+        arena.free(entry.second.handle);
+    }
+    entries.clear();
+    reference_count = 0;
+}
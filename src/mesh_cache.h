@@ -0,0 +1,39 @@
+#pragma once
+
+#include "geometry_arena.h"
+
+#include <unordered_map>
+
+//keeps one arena allocation per Mesh no matter how many renderers draw it.
+//meshes are owned by their Model, so the Mesh address is a stable key
+class MeshCache {
+public:
+    MeshCache(GeometryArena& geometry_arena) : arena(geometry_arena) {}
+    MeshCache(const MeshCache& other) = delete;
+
+    //uploads the mesh the first time it is seen
+    GeometryHandle acquire(const Mesh& mesh);
+    //frees the arena range when the last user lets go
+    void release(const Mesh& mesh);
+    void close();
+
+    GeometryArena& get_arena() {
+        return arena;
+    }
+    uint32_t get_unique_count() const {
+        return static_cast<uint32_t>(entries.size());
+    }
+    uint32_t get_reference_count() const {
+        return reference_count;
+    }
+
+private:
+    struct Entry {
+        GeometryHandle handle;
+        uint32_t references;
+    };
+
+    GeometryArena& arena;
+    std::unordered_map<const Mesh*, Entry> entries;
+    uint32_t reference_count = 0;
+};
@@ -99,6 +99,7 @@ std::unique_ptr<Model> Model::load_fbx(Context& context, const std::string& path
 				mesh.indices.push_back(static_cast<uint32_t>(amesh->mFaces[f].mIndices[2]));
 			}
 
+			mesh.bounds = calculate_bounds(mesh);
 			model->meshes[amesh->mName.C_Str()] = mesh;
 			std::cout << "mesh " << amesh->mName.C_Str() << std::endl;
 		}
@@ -207,6 +208,7 @@ void load_meshes(Model* model, tinygltf::Model& gltf) {
 			assert(accessor.type == TINYGLTF_TYPE_SCALAR);
 
 			RecalculateTangents(m);
+			m.bounds = calculate_bounds(m);
 
 			model->meshes[mesh.name + "_" + std::to_string(prim_index++)] = m;
 		}
@@ -226,11 +228,11 @@ SceneNode* load_node(Model* model, tinygltf::Model& gltf, uint32_t index, const
 	if (node.matrix.empty()) {
 		//pos,rot,scale
 		if(node.translation.size() > 0)
-			scene_node.transform.position = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+			scene_node.transform.set_position(glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
 		if(node.rotation.size() > 0)
-			scene_node.transform.rotation = glm::quat(node.rotation[0], node.rotation[1], node.rotation[2], node.rotation[3]);
+			scene_node.transform.set_rotation(glm::quat(node.rotation[0], node.rotation[1], node.rotation[2], node.rotation[3]));
 		if(node.scale.size() > 0)
-			scene_node.transform.scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+			scene_node.transform.set_scale(glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
 	}
 	else {
 		//matrix
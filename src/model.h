@@ -3,6 +3,7 @@
 #include "context.h"
 #include "texture.h"
 #include "transform.h"
+#include "pvs.h"
 
 struct SceneNode {
 	std::vector<SceneNode*> children;
@@ -17,7 +18,8 @@ public:
 	std::unordered_map<std::string, Texture> textures;
 	std::unordered_map<std::string, SceneNode> nodes;
 	SceneNode scene_root;
-	
+	//baked or loaded by AssetManager::get_pvs, nullptr until then
+	std::unique_ptr<PotentiallyVisibleSet> pvs;
 
 	static std::unique_ptr<Model> load_fbx(Context &context, const std::string& path);
 	static std::unique_ptr<Model> load_gltf(Context& context, const std::string& path);
@@ -2,6 +2,8 @@
 #include "log.h"
 #include "engine.h"
 
+#include <algorithm>
+
 glm::mat4 Camera::view()
 {
 	return glm::inverse(transform.matrix());
@@ -17,7 +19,13 @@ glm::mat4 Camera::projection()
 	return p;
 }
 
+Frustum Camera::frustum()
+{
+	return Frustum::from_matrix(projection() * view());
+}
+
 void MeshObject::init(Engine& engine) {
+	mesh_renderer->transform = &transform;
 	mesh_renderer->init(engine.renderer);
 }
 
@@ -48,7 +56,34 @@ void SceneObject::load_model(Engine &engine, Model* model)
 		auto &mo = engine.create_meshobject();
 		mo.transform = node.second.transform;
 		mo.mesh_renderer->load(model->meshes.at(node.second.mesh));
+		if (model->pvs != nullptr) {
+			mo.mesh_renderer->pvs = model->pvs.get();
+			mo.mesh_renderer->pvs_node = model->pvs->get_node_index(node.first);
+		}
 		
 		mesh_objects[node.second.name] = &mo;
 	}
 }
+
+void SceneObject::set_static(bool is_static)
+{
+	for (auto& mesh_object : mesh_objects) {
+		mesh_object.second->set_static(is_static);
+	}
+}
+
+void SceneObject::set_occluders(float min_size, uint32_t max_vertices)
+{
+	for (auto& mesh_object : mesh_objects) {
+		auto mesh = mesh_object.second->mesh_renderer->mesh;
+		if (mesh == nullptr || mesh->vertices.size() > max_vertices) {
+			continue;
+		}
+		//size of the world space box around the transformed one
+		glm::mat4 M = mesh_object.second->transform.matrix();
+		glm::vec3 size = mesh->bounds.max - mesh->bounds.min;
+		glm::vec3 world_size = glm::abs(glm::vec3(M[0])) * size.x + glm::abs(glm::vec3(M[1])) * size.y + glm::abs(glm::vec3(M[2])) * size.z;
+		float largest = std::max(world_size.x, std::max(world_size.y, world_size.z));
+		mesh_object.second->set_occluder(largest >= min_size);
+	}
+}
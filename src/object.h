@@ -3,6 +3,7 @@
 #include "transform.h"
 #include "mesh.h"
 #include "model.h"
+#include "culling.h"
 
 class Renderer;
 class Engine;
@@ -35,6 +36,15 @@ public:
 	void init(Engine& engine) override;
 
 	void close() override;
+
+	//see MeshRenderer::occluder
+	void set_occluder(bool occluder) {
+		mesh_renderer->occluder = occluder;
+	}
+	//see MeshRenderer::is_static
+	void set_static(bool is_static) {
+		mesh_renderer->is_static = is_static;
+	}
 };
 
 class SceneObject : public Object {
@@ -45,6 +55,11 @@ public:
 
 	void init(Engine& engine) override;
 	void load_model(Engine &engine, Model* model);
+	//every mesh object loaded so far
+	void set_static(bool is_static);
+	//flags the loaded meshes at least min_size across in world space and with at most
+	//max_vertices as occluders, see MeshRenderer::occluder
+	void set_occluders(float min_size, uint32_t max_vertices);
 
 	std::unordered_map<std::string, MeshObject *> mesh_objects;
 	std::vector<std::unique_ptr<Material>> materials;
@@ -61,5 +76,6 @@ public:
 
 	glm::mat4 view();
 	glm::mat4 projection();
+	Frustum frustum();
 
 };
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "occlusion_culler.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+    constexpr uint32_t TILE_PIXELS = OcclusionCuller::TILE_WIDTH * OcclusionCuller::TILE_HEIGHT;
+    //boxes are tested in chunks this big, one per job
+    constexpr uint32_t TEST_CHUNK = 256;
+}
+
+void OcclusionCullerStats::print() const {
+    DEBUG("software occlusion drew " << triangles << " triangles of " << occluders << " occluders, culled "
+        << occluded << " of " << tested << " objects")
+}
+
+void OcclusionCuller::init(uint32_t w, uint32_t h) {
+    tiles_x = (w + TILE_WIDTH - 1) / TILE_WIDTH;
+    tiles_y = (h + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    width = tiles_x * TILE_WIDTH;
+    height = tiles_y * TILE_HEIGHT;
+
+    depth.assign(tiles_x * tiles_y * TILE_PIXELS, 1.0f);
+    tile_max.assign(tiles_x * tiles_y, 1.0f);
+    bins.assign(tiles_x * tiles_y, {});
+}
+
+void OcclusionCuller::begin(const glm::mat4& vp) {
+    view_projection = vp;
+    triangles.clear();
+    for (auto& bin : bins) {
+        bin.clear();
+    }
+    stats = OcclusionCullerStats{};
+}
+
+glm::vec3 OcclusionCuller::to_screen(const glm::vec4& clip) const {
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    return glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z);
+}
+
+void OcclusionCuller::add_occluder(const glm::mat4& M, const void* positions, uint32_t stride, uint32_t vertex_count,
+    const uint32_t* indices, uint32_t index_count) {
+    glm::mat4 MVP = view_projection * M;
+    auto bytes = static_cast<const uint8_t*>(positions);
+    clip_positions.resize(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        auto position = reinterpret_cast<const float*>(bytes + static_cast<size_t>(i) * stride);
+        clip_positions[i] = MVP * glm::vec4(position[0], position[1], position[2], 1.0f);
+    }
+    stats.occluders++;
+
+    for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+        const glm::vec4* clip[3] = { &clip_positions[indices[i]], &clip_positions[indices[i + 1]], &clip_positions[indices[i + 2]] };
+        if (clip[0]->z < 0.0f || clip[1]->z < 0.0f || clip[2]->z < 0.0f ||
+            clip[0]->w <= 0.0f || clip[1]->w <= 0.0f || clip[2]->w <= 0.0f) {
+            continue;
+        }
+
+        glm::vec3 s[3] = { to_screen(*clip[0]), to_screen(*clip[1]), to_screen(*clip[2]) };
+        float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+        if (std::abs(area) < 1e-6f) {
+            continue;
+        }
+        //either winding, the edge functions want one
+        if (area < 0.0f) {
+            std::swap(s[1], s[2]);
+            area = -area;
+        }
+
+        //pixels whose centers can be inside
+        Triangle triangle;
+        triangle.min_x = std::max(static_cast<int>(std::ceil(std::min({ s[0].x, s[1].x, s[2].x }) - 0.5f)), 0);
+        triangle.min_y = std::max(static_cast<int>(std::ceil(std::min({ s[0].y, s[1].y, s[2].y }) - 0.5f)), 0);
+        triangle.max_x = std::min(static_cast<int>(std::floor(std::max({ s[0].x, s[1].x, s[2].x }) - 0.5f)), static_cast<int>(width) - 1);
+        triangle.max_y = std::min(static_cast<int>(std::floor(std::max({ s[0].y, s[1].y, s[2].y }) - 0.5f)), static_cast<int>(height) - 1);
+        if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y) {
+            continue;
+        }
+
+        for (uint32_t e = 0; e < 3; e++) {
+            const auto& a = s[e];
+            const auto& b = s[(e + 1) % 3];
+            triangle.edge_x[e] = a.y - b.y;
+            triangle.edge_y[e] = b.x - a.x;
+            triangle.edge_c[e] = (b.y - a.y) * a.x - (b.x - a.x) * a.y;
+        }
+
+        //depth is linear in screen space after the perspective divide
+        glm::vec3 normal = glm::cross(s[1] - s[0], s[2] - s[0]);
+        triangle.depth_x = -normal.x / normal.z;
+        triangle.depth_y = -normal.y / normal.z;
+        triangle.depth_c = s[0].z - triangle.depth_x * s[0].x - triangle.depth_y * s[0].y;
+
+        auto index = static_cast<uint32_t>(triangles.size());
+        triangles.push_back(triangle);
+        for (uint32_t ty = triangle.min_y / TILE_HEIGHT; ty <= triangle.max_y / TILE_HEIGHT; ty++) {
+            for (uint32_t tx = triangle.min_x / TILE_WIDTH; tx <= triangle.max_x / TILE_WIDTH; tx++) {
+                bins[ty * tiles_x + tx].push_back(index);
+            }
+        }
+    }
+}
+
+void OcclusionCuller::rasterize(WorkerPool& workers) {
+    stats.triangles = static_cast<uint32_t>(triangles.size());
+    if (!has_occluders()) {
+        return;
+    }
+
+    workers.parallel_for(tiles_y, [&](uint32_t row) {
+        for (uint32_t tx = 0; tx < tiles_x; tx++) {
+            rasterize_tile(row * tiles_x + tx);
+        }
+    });
+}
+
+void OcclusionCuller::rasterize_tile(uint32_t tile) {
+    int tile_x = static_cast<int>((tile % tiles_x) * TILE_WIDTH);
+    int tile_y = static_cast<int>((tile / tiles_x) * TILE_HEIGHT);
+    float* pixels = &depth[static_cast<size_t>(tile) * TILE_PIXELS];
+    std::fill(pixels, pixels + TILE_PIXELS, 1.0f);
+
+    for (auto index : bins[tile]) {
+        const auto& t = triangles[index];
+        int min_x = std::max(t.min_x, tile_x) - tile_x;
+        int max_x = std::min(t.max_x, tile_x + static_cast<int>(TILE_WIDTH) - 1) - tile_x;
+        int min_y = std::max(t.min_y, tile_y) - tile_y;
+        int max_y = std::min(t.max_y, tile_y + static_cast<int>(TILE_HEIGHT) - 1) - tile_y;
+
+        //lanes outside the triangle's box are outside the triangle too, the edge functions
+        //leave them alone
+        for (int y = min_y; y <= max_y; y++) {
+            float* row = pixels + y * TILE_WIDTH;
+            float py = static_cast<float>(tile_y + y) + 0.5f;
+            for (int x = min_x / LANES * LANES; x <= max_x; x += LANES) {
+                float px = static_cast<float>(tile_x + x) + 0.5f;
+#if defined(__AVX__)
+                __m256 xs = _mm256_add_ps(_mm256_set1_ps(px), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+                __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (uint32_t e = 0; e < 3; e++) {
+                    __m256 value = _mm256_add_ps(_mm256_mul_ps(xs, _mm256_set1_ps(t.edge_x[e])), _mm256_set1_ps(py * t.edge_y[e] + t.edge_c[e]));
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(value, _mm256_setzero_ps(), _CMP_GE_OQ));
+                }
+                __m256 z = _mm256_add_ps(_mm256_mul_ps(xs, _mm256_set1_ps(t.depth_x)), _mm256_set1_ps(py * t.depth_y + t.depth_c));
+                __m256 old = _mm256_loadu_ps(row + x);
+                _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, z), inside));
+#elif defined(OCCLUSION_SSE)
+                for (uint32_t half = 0; half < 2; half++) {
+                    __m128 xs = _mm_add_ps(_mm_set1_ps(px + half * 4.0f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+                    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    for (uint32_t e = 0; e < 3; e++) {
+                        __m128 value = _mm_add_ps(_mm_mul_ps(xs, _mm_set1_ps(t.edge_x[e])), _mm_set1_ps(py * t.edge_y[e] + t.edge_c[e]));
+                        inside = _mm_and_ps(inside, _mm_cmpge_ps(value, _mm_setzero_ps()));
+                    }
+                    __m128 z = _mm_add_ps(_mm_mul_ps(xs, _mm_set1_ps(t.depth_x)), _mm_set1_ps(py * t.depth_y + t.depth_c));
+                    __m128 old = _mm_loadu_ps(row + x + half * 4);
+                    __m128 nearer = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x + half * 4, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+#else
+                for (uint32_t lane = 0; lane < LANES; lane++) {
+                    float lane_x = px + lane;
+                    bool inside = true;
+                    for (uint32_t e = 0; e < 3; e++) {
+                        inside &= lane_x * t.edge_x[e] + py * t.edge_y[e] + t.edge_c[e] >= 0.0f;
+                    }
+                    if (inside) {
+                        row[x + lane] = std::min(row[x + lane], lane_x * t.depth_x + py * t.depth_y + t.depth_c);
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    tile_max[tile] = *std::max_element(pixels, pixels + TILE_PIXELS);
+}
+
+void OcclusionCuller::cull(WorkerPool& workers, const FrustumCuller& boxes, std::vector<uint32_t>& visible) {
+    stats.tested = static_cast<uint32_t>(visible.size());
+    stats.occluded = 0;
+    if (!has_occluders() || visible.empty()) {
+        return;
+    }
+
+    keep.assign(visible.size(), 1);
+    auto count = static_cast<uint32_t>(visible.size());
+    workers.parallel_for((count + TEST_CHUNK - 1) / TEST_CHUNK, [&](uint32_t chunk) {
+        uint32_t last = std::min((chunk + 1) * TEST_CHUNK, count);
+        for (uint32_t i = chunk * TEST_CHUNK; i < last; i++) {
+            keep[i] = test_box(boxes.get_center(visible[i]), boxes.get_extent(visible[i])) ? 1 : 0;
+        }
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i < visible.size(); i++) {
+        if (keep[i]) {
+            visible[kept++] = visible[i];
+        }
+    }
+    stats.occluded = static_cast<uint32_t>(visible.size() - kept);
+    visible.resize(kept);
+}
+
+//the box's screen rectangle is compared against its nearest depth. it is hidden if every
+//pixel under the rectangle holds something nearer
+bool OcclusionCuller::test_box(glm::vec3 center, glm::vec3 extent) const {
+    glm::vec2 screen_min(static_cast<float>(width), static_cast<float>(height));
+    glm::vec2 screen_max(0.0f);
+    float nearest = 1.0f;
+    for (uint32_t i = 0; i < 8; i++) {
+        glm::vec3 corner = center + extent * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+        glm::vec4 clip = view_projection * glm::vec4(corner, 1.0f);
+        //crosses the near plane, too close to say
+        if (clip.w <= 0.0f || clip.z < 0.0f) {
+            return true;
+        }
+        glm::vec3 screen = to_screen(clip);
+        screen_min = glm::min(screen_min, glm::vec2(screen));
+        screen_max = glm::max(screen_max, glm::vec2(screen));
+        nearest = std::min(nearest, screen.z);
+    }
+
+    int min_x = std::max(static_cast<int>(std::floor(screen_min.x)), 0);
+    int min_y = std::max(static_cast<int>(std::floor(screen_min.y)), 0);
+    int max_x = std::min(static_cast<int>(std::floor(screen_max.x)), static_cast<int>(width) - 1);
+    int max_y = std::min(static_cast<int>(std::floor(screen_max.y)), static_cast<int>(height) - 1);
+    if (min_x > max_x || min_y > max_y) {
+        return true;
+    }
+
+    for (int ty = min_y / static_cast<int>(TILE_HEIGHT); ty <= max_y / static_cast<int>(TILE_HEIGHT); ty++) {
+        for (int tx = min_x / static_cast<int>(TILE_WIDTH); tx <= max_x / static_cast<int>(TILE_WIDTH); tx++) {
+            uint32_t tile = ty * tiles_x + tx;
+            //all of the tile is nearer
+            if (tile_max[tile] < nearest) {
+                continue;
+            }
+
+            int tile_x = tx * TILE_WIDTH;
+            int tile_y = ty * TILE_HEIGHT;
+            int first_x = std::max(min_x, tile_x) - tile_x;
+            int last_x = std::min(max_x, tile_x + static_cast<int>(TILE_WIDTH) - 1) - tile_x;
+            int first_y = std::max(min_y, tile_y) - tile_y;
+            int last_y = std::min(max_y, tile_y + static_cast<int>(TILE_HEIGHT) - 1) - tile_y;
+            const float* pixels = &depth[static_cast<size_t>(tile) * TILE_PIXELS];
+
+            for (int y = first_y; y <= last_y; y++) {
+                const float* row = pixels + y * TILE_WIDTH;
+                for (int x = first_x / LANES * LANES; x <= last_x; x += LANES) {
+                    //lanes inside the rectangle
+                    uint32_t lanes = 0xFF;
+                    if (x < first_x) {
+                        lanes &= 0xFFu << (first_x - x);
+                    }
+                    if (x + static_cast<int>(LANES) - 1 > last_x) {
+                        lanes &= 0xFFu >> (x + LANES - 1 - last_x);
+                    }
+#if defined(__AVX__)
+                    __m256 behind = _mm256_cmp_ps(_mm256_loadu_ps(row + x), _mm256_set1_ps(nearest), _CMP_GE_OQ);
+                    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(behind));
+#elif defined(OCCLUSION_SSE)
+                    uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), _mm_set1_ps(nearest)))) |
+                        static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x + 4), _mm_set1_ps(nearest)))) << 4;
+#else
+                    uint32_t mask = 0;
+                    for (uint32_t lane = 0; lane < LANES; lane++) {
+                        mask |= row[x + lane] >= nearest ? 1u << lane : 0;
+                    }
+#endif
+                    if (mask & lanes) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "culling.h"
+#include "worker_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+struct OcclusionCullerStats {
+    uint32_t occluders = 0;
+    //occluder triangles left after near plane and screen rejection
+    uint32_t triangles = 0;
+    uint32_t tested = 0;
+    uint32_t occluded = 0;
+
+    void print() const;
+};
+
+//software occlusion culling for the cpu path. a few large meshes flagged as occluders are
+//rasterized into a small depth buffer, then the boxes that survived frustum culling are
+//tested against it and dropped if they are behind everything drawn there.
+//
+//the buffer is split into tiles, rasterized one tile row per job with no shared writes.
+//inside a tile, rows are processed 8 pixels at a time: edge functions give a coverage mask
+//per group and only covered lanes take the nearer depth. every tile also keeps its farthest
+//depth, so most tests end at the tile level. same avx/sse/scalar choice as FrustumCuller.
+//
+//nothing here touches vulkan, it only needs a view projection matrix
+class OcclusionCuller {
+public:
+    static constexpr uint32_t LANES = 8;
+    static constexpr uint32_t TILE_WIDTH = 32;
+    static constexpr uint32_t TILE_HEIGHT = 16;
+
+    //the size is rounded up to whole tiles
+    void init(uint32_t width, uint32_t height);
+
+    //forgets the last frame's occluders
+    void begin(const glm::mat4& view_projection);
+    //positions are stride bytes apart. triangles crossing the near plane are left out, which
+    //only means less gets culled
+    void add_occluder(const glm::mat4& M, const void* positions, uint32_t stride, uint32_t vertex_count,
+        const uint32_t* indices, uint32_t index_count);
+    //clears the depth buffer and draws every occluder added since begin
+    void rasterize(WorkerPool& workers);
+    //removes the entries of visible whose box in boxes is hidden, keeping the order
+    void cull(WorkerPool& workers, const FrustumCuller& boxes, std::vector<uint32_t>& visible);
+
+    bool has_occluders() const {
+        return !triangles.empty();
+    }
+    const OcclusionCullerStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    //screen space, set up so every edge function is positive inside
+    struct Triangle {
+        float edge_x[3];
+        float edge_y[3];
+        float edge_c[3];
+        //depth plane, z = depth_x * x + depth_y * y + depth_c
+        float depth_x;
+        float depth_y;
+        float depth_c;
+        int min_x;
+        int min_y;
+        int max_x;
+        int max_y;
+    };
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t tiles_x = 0;
+    uint32_t tiles_y = 0;
+    glm::mat4 view_projection{ 1.0f };
+    //tile after tile, each TILE_WIDTH * TILE_HEIGHT pixels in rows
+    std::vector<float> depth;
+    std::vector<float> tile_max;
+    std::vector<Triangle> triangles;
+    //triangles overlapping each tile
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<glm::vec4> clip_positions;
+    std::vector<uint8_t> keep;
+    OcclusionCullerStats stats;
+
+    void rasterize_tile(uint32_t tile);
+    //true if any part of the box might be in front of the depth buffer
+    bool test_box(glm::vec3 center, glm::vec3 extent) const;
+    //screen space pixel coordinates from clip space
+    glm::vec3 to_screen(const glm::vec4& clip) const;
+};
@@ -0,0 +1,58 @@
+#include "per_image_buffer.h"
+#include "log.h"
+
+void PerImageBuffer::init(uint32_t image_count, uint32_t element_count) {
+    TRACE("initializing per image buffers")
+    uint32_t capacity = INITIAL_CAPACITY;
+    while (capacity < element_count) {
+        capacity *= 2;
+    }
+
+    buffers.clear();
+    capacities.clear();
+    for (uint32_t i = 0; i < image_count; i++) {
+        buffers.emplace_back(context);
+        create_buffer(buffers.back(), capacity);
+        capacities.push_back(capacity);
+    }
+}
+
+void PerImageBuffer::close() {
+    for (auto& buffer : buffers) {
+        buffer.close();
+    }
+    buffers.clear();
+    capacities.clear();
+}
+
+void PerImageBuffer::create_buffer(Buffer& buffer, uint32_t capacity) {
+    buffer.init(element_size * capacity,
+        usage,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+bool PerImageBuffer::reserve(uint32_t image, uint32_t count) {
+    uint32_t capacity = capacities.at(image);
+    if (count <= capacity) {
+        return false;
+    }
+
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    DEBUG("growing per image buffer " << image << " to " << capacity << " elements")
+
+    //the caller has waited for this image's last frame, nothing on the gpu reads the old buffer
+    Buffer grown(context);
+    create_buffer(grown, capacity);
+    grown.store(buffers[image].data(), buffers[image].size, 0);
+
+    buffers[image].close();
+    buffers[image] = std::move(grown);
+    capacities[image] = capacity;
+    return true;
+}
+
+vk::DescriptorBufferInfo PerImageBuffer::descriptor_info(uint32_t image) const {
+    return vk::DescriptorBufferInfo(buffers.at(image).buffer, 0, VK_WHOLE_SIZE);
+}
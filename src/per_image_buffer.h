@@ -0,0 +1,48 @@
+#pragma once
+
+#include "context.h"
+#include "buffer.h"
+
+//array of fixed size elements with one host visible storage buffer per swapchain image,
+//so one image's copy can be written while the others are still being drawn. used for
+//per-object data (set 0 binding 1), per-instance object indices (set 0 binding 2) and
+//the gpu culling inputs and outputs.
+//buffers grow by doubling, which replaces the buffer, so that image's descriptor has to
+//be rewritten
+class PerImageBuffer {
+public:
+    static constexpr uint32_t INITIAL_CAPACITY = 1024;
+
+    PerImageBuffer(Context& ctx, vk::DeviceSize element, vk::BufferUsageFlags usage_flags = vk::BufferUsageFlagBits::eStorageBuffer) :
+        context(ctx),
+        element_size(element),
+        usage(usage_flags) {}
+    PerImageBuffer(const PerImageBuffer& other) = delete;
+
+    void init(uint32_t image_count, uint32_t element_count);
+    void close();
+
+    //makes room for count elements in the image's buffer, keeping what was already written.
+    //returns true if the buffer was replaced
+    bool reserve(uint32_t image, uint32_t count);
+    template<class T> T* data(uint32_t image) {
+        return static_cast<T*>(buffers.at(image).data());
+    }
+    vk::DescriptorBufferInfo descriptor_info(uint32_t image) const;
+    vk::Buffer get_buffer(uint32_t image) const {
+        return buffers.at(image).buffer;
+    }
+
+    uint32_t get_capacity(uint32_t image) const {
+        return capacities.at(image);
+    }
+
+private:
+    Context& context;
+    vk::DeviceSize element_size;
+    vk::BufferUsageFlags usage;
+    std::vector<Buffer> buffers;
+    std::vector<uint32_t> capacities;
+
+    void create_buffer(Buffer& buffer, uint32_t capacity);
+};
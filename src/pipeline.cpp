@@ -2,6 +2,7 @@
 #include "log.h"
 #include "geometry.h"
 
+#include <array>
 #include <fstream>
 #include <iostream>
 
@@ -20,23 +21,27 @@ std::vector<char> readFile(const std::string& filename) {
     return buffer;
 }
 
-vk::ShaderModule Pipeline::load_shader(const std::vector<char> &bytes) {
+static vk::ShaderModule load_shader(vk::Device device, const std::vector<char> &bytes) {
     vk::ShaderModuleCreateInfo create_info{};
     create_info.codeSize = bytes.size();
     create_info.pCode = reinterpret_cast<const uint32_t*>(bytes.data());
 
-    vk::ShaderModule shader = context.device.createShaderModule(create_info);
+    vk::ShaderModule shader = device.createShaderModule(create_info);
     return shader;
 }
 
-void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, const std::vector<vk::DescriptorSetLayout>& descriptor_set_layouts) {
+void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, const std::vector<vk::DescriptorSetLayout>& descriptor_set_layouts, const PipelineOptions& options) {
     TRACE("initializing pipeline");
 
     auto vert_code = readFile("shader/" + prefix + "_vert.spv");
-    auto frag_code = readFile("shader/" + prefix + "_frag.spv");
+    auto vert = load_shader(context.device, vert_code);
 
-    auto vert = load_shader(vert_code);
-    auto frag = load_shader(frag_code);
+    //depth only pipelines run no fragment shader at all
+    vk::ShaderModule frag = nullptr;
+    if (!options.depth_only) {
+        auto frag_code = readFile("shader/" + (options.fragment_prefix.empty() ? prefix : options.fragment_prefix) + "_frag.spv");
+        frag = load_shader(context.device, frag_code);
+    }
 
     vk::PipelineShaderStageCreateInfo vert_info{};
     vert_info.stage = vk::ShaderStageFlagBits::eVertex;
@@ -53,10 +58,16 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     auto binding_description = Vertex::binding_description();
     auto attributes_description = Vertex::attribute_description();
 
+    //the position is attribute 0, the rest of the vertex is skipped by the stride
+    uint32_t attribute_count = options.depth_only ? 1 : static_cast<uint32_t>(attributes_description.size());
+    if (options.full_screen) {
+        attribute_count = 0;
+    }
+
     vk::PipelineVertexInputStateCreateInfo input_info{};
-    input_info.vertexBindingDescriptionCount = 1;
+    input_info.vertexBindingDescriptionCount = options.full_screen ? 0 : 1;
     input_info.pVertexBindingDescriptions = &binding_description;
-    input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes_description.size());
+    input_info.vertexAttributeDescriptionCount = attribute_count;
     input_info.pVertexAttributeDescriptions = attributes_description.data();
 
     vk::PipelineInputAssemblyStateCreateInfo assembly_info (
@@ -82,17 +93,18 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     viewport_info.scissorCount = 1;
     viewport_info.pScissors = &scissor;
 
+    bool depth_bias = options.depth_bias_constant != 0.0f || options.depth_bias_slope != 0.0f;
     vk::PipelineRasterizationStateCreateInfo rasterizer_info(
         {},
         {},
         {},
         vk::PolygonMode::eFill,
-        vk::CullModeFlagBits::eBack,
+        options.full_screen ? vk::CullModeFlagBits::eNone : vk::CullModeFlagBits::eBack,
         vk::FrontFace::eCounterClockwise,
-        {},
-        0.0f,
-        0.0f,
+        depth_bias,
+        options.depth_bias_constant,
         0.0f,
+        options.depth_bias_slope,
         1.0f);
 
     vk::PipelineMultisampleStateCreateInfo multisampling_info{};
@@ -106,7 +118,7 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     //per-framebuffer blending
     vk::PipelineColorBlendAttachmentState color_blend{};
     color_blend.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
-    color_blend.blendEnable = VK_TRUE;
+    color_blend.blendEnable = options.blend;
     color_blend.srcColorBlendFactor = vk::BlendFactor::eSrcAlpha;
     color_blend.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
     color_blend.colorBlendOp = vk::BlendOp::eAdd;
@@ -114,12 +126,15 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     color_blend.dstAlphaBlendFactor = vk::BlendFactor::eZero;
     color_blend.alphaBlendOp = vk::BlendOp::eAdd;
 
+    //the same for every attachment
+    std::vector<vk::PipelineColorBlendAttachmentState> color_blends(options.depth_only ? 0 : options.color_attachments, color_blend);
+
     //global blending
     vk::PipelineColorBlendStateCreateInfo color_blend_info{};
     color_blend_info.logicOpEnable = VK_FALSE;
     color_blend_info.logicOp = vk::LogicOp::eCopy;
-    color_blend_info.attachmentCount = 1;
-    color_blend_info.pAttachments = &color_blend;
+    color_blend_info.attachmentCount = static_cast<uint32_t>(color_blends.size());
+    color_blend_info.pAttachments = color_blends.data();
     color_blend_info.blendConstants[0] = 0.0f;
     color_blend_info.blendConstants[1] = 0.0f; 
     color_blend_info.blendConstants[2] = 0.0f; 
@@ -137,10 +152,13 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     dynamicState.pDynamicStates = dynamicStates;
     */
 
+    std::array<vk::DynamicState, 2> dynamic_states{ vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+    vk::PipelineDynamicStateCreateInfo dynamic_info({}, static_cast<uint32_t>(dynamic_states.size()), dynamic_states.data());
+
     vk::PipelineDepthStencilStateCreateInfo depth_info{};
-    depth_info.depthTestEnable = VK_TRUE;
-    depth_info.depthWriteEnable = VK_TRUE;
-    depth_info.depthCompareOp = vk::CompareOp::eLess;
+    depth_info.depthTestEnable = !options.full_screen;
+    depth_info.depthWriteEnable = options.depth_write && !options.full_screen;
+    depth_info.depthCompareOp = options.depth_compare;
     depth_info.depthBoundsTestEnable = VK_FALSE;
     depth_info.maxDepthBounds = 1.0f;
     depth_info.minDepthBounds = 0.0f;
@@ -155,9 +173,10 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     layout_info.pPushConstantRanges = &push_constant;
 
     layout = context.device.createPipelineLayout(layout_info);
+    set_layouts = descriptor_set_layouts;
 
     vk::GraphicsPipelineCreateInfo pipeline_info {};
-    pipeline_info.stageCount =2;
+    pipeline_info.stageCount = options.depth_only ? 1 : 2;
     pipeline_info.pStages = stages;
     pipeline_info.pVertexInputState = &input_info;
     pipeline_info.pInputAssemblyState = &assembly_info;
@@ -166,7 +185,7 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     pipeline_info.pMultisampleState = &multisampling_info;
     pipeline_info.pDepthStencilState = &depth_info;
     pipeline_info.pColorBlendState = &color_blend_info;
-    pipeline_info.pDynamicState = nullptr;
+    pipeline_info.pDynamicState = options.dynamic_viewport ? &dynamic_info : nullptr;
     pipeline_info.layout = layout;
     pipeline_info.renderPass = renderpass;
     pipeline_info.subpass = 0;
@@ -179,10 +198,55 @@ void Pipeline::init(vk::Extent2D viewport_extent, vk::RenderPass renderpass, con
     pipeline = context.device.createGraphicsPipeline(nullptr, pipeline_info);
 #endif
     context.device.destroyShaderModule(vert);
-    context.device.destroyShaderModule(frag);
+    if (frag != vk::ShaderModule(nullptr)) {
+        context.device.destroyShaderModule(frag);
+    }
 }
 
 void Pipeline::close() {
     context.device.destroyPipeline(pipeline);
     context.device.destroyPipelineLayout(layout);
-}
\ No newline at end of file
+    pipeline = nullptr;
+    layout = nullptr;
+}
+
+void ComputePipeline::init(const std::vector<vk::DescriptorSetLayout>& descriptor_set_layouts, uint32_t push_constant_size) {
+    TRACE("initializing compute pipeline " << name);
+
+    auto code = readFile("shader/" + name + "_comp.spv");
+    auto shader = load_shader(context.device, code);
+
+    vk::PipelineShaderStageCreateInfo stage_info{};
+    stage_info.stage = vk::ShaderStageFlagBits::eCompute;
+    stage_info.module = shader;
+    stage_info.pName = "main";
+
+    vk::PushConstantRange push_constant(vk::ShaderStageFlagBits::eCompute, 0, push_constant_size);
+
+    vk::PipelineLayoutCreateInfo layout_info{};
+    layout_info.setLayoutCount = static_cast<uint32_t>(descriptor_set_layouts.size());
+    layout_info.pSetLayouts = descriptor_set_layouts.data();
+    layout_info.pushConstantRangeCount = push_constant_size > 0 ? 1 : 0;
+    layout_info.pPushConstantRanges = &push_constant;
+
+    layout = context.device.createPipelineLayout(layout_info);
+    set_layouts = descriptor_set_layouts;
+
+    vk::ComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.stage = stage_info;
+    pipeline_info.layout = layout;
+    pipeline_info.basePipelineHandle = nullptr;
+    pipeline_info.basePipelineIndex = -1;
+
+#ifdef _WIN32
+    pipeline = context.device.createComputePipeline(nullptr, pipeline_info).value;
+#else
+    pipeline = context.device.createComputePipeline(nullptr, pipeline_info);
+#endif
+    context.device.destroyShaderModule(shader);
+}
+
+void ComputePipeline::close() {
+    context.device.destroyPipeline(pipeline);
+    context.device.destroyPipelineLayout(layout);
+}
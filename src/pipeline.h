@@ -1,18 +1,57 @@
 #pragma once
 #include "context.h"
 
+#include <string>
+
+struct PipelineOptions {
+    vk::CompareOp depth_compare = vk::CompareOp::eLess;
+    bool depth_write = true;
+    //only a vertex shader reading positions and no color attachments, for depth prepasses
+    bool depth_only = false;
+    //fragment shader from shader/<fragment_prefix>_frag.spv instead of the pipeline's own,
+    //so variants of a material can share its vertex shader
+    std::string fragment_prefix;
+    uint32_t color_attachments = 1;
+    bool blend = true;
+    //no vertex input, culling or depth test, for one triangle covering the screen
+    bool full_screen = false;
+    //viewport and scissor are set while recording, for drawing into tiles of an atlas
+    bool dynamic_viewport = false;
+    //depth offset of constant units plus slope times the polygon's depth slope, off at 0
+    float depth_bias_constant = 0.0f;
+    float depth_bias_slope = 0.0f;
+};
+
 class Pipeline {
 public:
     vk::PipelineLayout layout;
     vk::Pipeline pipeline;
+    //what the layout was created from, used to tell which bound descriptor sets survive a pipeline change
+    std::vector<vk::DescriptorSetLayout> set_layouts;
     std::string prefix;
-    void init(vk::Extent2D viewport, vk::RenderPass renderpass, const std::vector<vk::DescriptorSetLayout> &descriptor_set_layouts);
+    void init(vk::Extent2D viewport, vk::RenderPass renderpass, const std::vector<vk::DescriptorSetLayout> &descriptor_set_layouts, const PipelineOptions &options = {});
     void close();
     Pipeline(Context &ctx, const std::string &shader_prefix) : 
         context(ctx),
         prefix(shader_prefix) {};
 
 private:
-    vk::ShaderModule load_shader(const std::vector<char> &bytes);
+    Context &context;
+};
+
+//a single compute shader, loaded from shader/<name>_comp.spv
+class ComputePipeline {
+public:
+    vk::PipelineLayout layout;
+    vk::Pipeline pipeline;
+    std::vector<vk::DescriptorSetLayout> set_layouts;
+    std::string name;
+    void init(const std::vector<vk::DescriptorSetLayout> &descriptor_set_layouts, uint32_t push_constant_size);
+    void close();
+    ComputePipeline(Context &ctx, const std::string &shader_name) :
+        context(ctx),
+        name(shader_name) {};
+
+private:
     Context &context;
 };
\ No newline at end of file
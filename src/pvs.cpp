@@ -0,0 +1,516 @@
+#include "pvs.h"
+#include "model.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+namespace {
+    constexpr char MAGIC[4] = { 'P', 'V', 'S', '3' };
+
+    //fixed sample points in a unit cell, the corners, the face centres and the centre
+    constexpr float FIXED_SAMPLES[15][3] = {
+        { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 1.0f, 0.0f },
+        { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f },
+        { 0.5f, 0.5f, 0.0f }, { 0.5f, 0.5f, 1.0f }, { 0.5f, 0.0f, 0.5f }, { 0.5f, 1.0f, 0.5f },
+        { 0.0f, 0.5f, 0.5f }, { 1.0f, 0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f }
+    };
+    constexpr uint32_t FIXED_SAMPLE_COUNT = sizeof(FIXED_SAMPLES) / sizeof(FIXED_SAMPLES[0]);
+
+    struct BakeTriangle {
+        glm::vec3 v0;
+        glm::vec3 e1;
+        glm::vec3 e2;
+        uint32_t node;
+    };
+
+    struct BvhNode {
+        glm::vec3 min;
+        glm::vec3 max;
+        //leaves hold count triangles from first in the bvh's order, inner nodes have count 0
+        //and their children at first and first + 1
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    //bounding volume hierarchy over every triangle of the model being baked, split at the
+    //median centroid along the longest axis
+    class Bvh {
+    public:
+        static constexpr uint32_t LEAF_SIZE = 4;
+        static constexpr uint32_t NO_HIT = ~0u;
+
+        explicit Bvh(const std::vector<BakeTriangle>& bake_triangles) : triangles(bake_triangles) {
+            auto count = static_cast<uint32_t>(triangles.size());
+            order.resize(count);
+            centroids.resize(count);
+            for (uint32_t i = 0; i < count; i++) {
+                const auto& t = triangles[i];
+                order[i] = i;
+                centroids[i] = t.v0 + (t.e1 + t.e2) / 3.0f;
+            }
+            nodes.reserve(2 * static_cast<size_t>(count) + 1);
+            nodes.emplace_back();
+            if (count > 0) {
+                build(0, 0, count);
+            }
+        }
+
+        //node of the nearest triangle along the ray closer than max_distance, NO_HIT if none
+        uint32_t cast(const glm::vec3& origin, const glm::vec3& direction, float max_distance) const {
+            if (triangles.empty()) {
+                return NO_HIT;
+            }
+
+            glm::vec3 inverse = 1.0f / direction;
+            float closest = max_distance;
+            uint32_t hit = NO_HIT;
+            uint32_t stack[64];
+            uint32_t stack_size = 0;
+            stack[stack_size++] = 0;
+            while (stack_size > 0) {
+                const auto& node = nodes[stack[--stack_size]];
+                glm::vec3 t0 = (node.min - origin) * inverse;
+                glm::vec3 t1 = (node.max - origin) * inverse;
+                glm::vec3 lower = glm::min(t0, t1);
+                glm::vec3 upper = glm::max(t0, t1);
+                float enter = std::max(std::max(lower.x, lower.y), std::max(lower.z, 0.0f));
+                float exit = std::min(std::min(upper.x, upper.y), std::min(upper.z, closest));
+                if (enter > exit) {
+                    continue;
+                }
+
+                if (node.count == 0) {
+                    stack[stack_size++] = node.first;
+                    stack[stack_size++] = node.first + 1;
+                    continue;
+                }
+
+                //moller trumbore
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    const auto& t = triangles[order[i]];
+                    glm::vec3 p = glm::cross(direction, t.e2);
+                    float determinant = glm::dot(t.e1, p);
+                    if (std::abs(determinant) < 1e-12f) {
+                        continue;
+                    }
+                    float inverse_determinant = 1.0f / determinant;
+                    glm::vec3 s = origin - t.v0;
+                    float u = glm::dot(s, p) * inverse_determinant;
+                    if (u < 0.0f || u > 1.0f) {
+                        continue;
+                    }
+                    glm::vec3 q = glm::cross(s, t.e1);
+                    float v = glm::dot(direction, q) * inverse_determinant;
+                    if (v < 0.0f || u + v > 1.0f) {
+                        continue;
+                    }
+                    float distance = glm::dot(t.e2, q) * inverse_determinant;
+                    if (distance > 1e-4f && distance < closest) {
+                        closest = distance;
+                        hit = t.node;
+                    }
+                }
+            }
+            return hit;
+        }
+
+    private:
+        const std::vector<BakeTriangle>& triangles;
+        std::vector<uint32_t> order;
+        std::vector<glm::vec3> centroids;
+        std::vector<BvhNode> nodes;
+
+        void build(uint32_t index, uint32_t first, uint32_t count) {
+            glm::vec3 min(FLT_MAX);
+            glm::vec3 max(-FLT_MAX);
+            glm::vec3 centroid_min(FLT_MAX);
+            glm::vec3 centroid_max(-FLT_MAX);
+            for (uint32_t i = first; i < first + count; i++) {
+                const auto& t = triangles[order[i]];
+                for (auto vertex : { t.v0, t.v0 + t.e1, t.v0 + t.e2 }) {
+                    min = glm::min(min, vertex);
+                    max = glm::max(max, vertex);
+                }
+                centroid_min = glm::min(centroid_min, centroids[order[i]]);
+                centroid_max = glm::max(centroid_max, centroids[order[i]]);
+            }
+            nodes[index].min = min;
+            nodes[index].max = max;
+
+            if (count <= LEAF_SIZE) {
+                nodes[index].first = first;
+                nodes[index].count = count;
+                return;
+            }
+
+            glm::vec3 size = centroid_max - centroid_min;
+            int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+            uint32_t half = count / 2;
+            std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                [&](uint32_t a, uint32_t b) {
+                    return centroids[a][axis] < centroids[b][axis];
+                });
+
+            auto left = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+            nodes.emplace_back();
+            nodes[index].first = left;
+            nodes[index].count = 0;
+            build(left, first, half);
+            build(left + 1, first + half, count - half);
+        }
+    };
+
+    template<class T> void write_value(std::ofstream& file, const T& value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<class T> void read_value(std::ifstream& file, T& value) {
+        file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    }
+
+    //64 bit fnv-1a
+    struct Hasher {
+        uint64_t hash = 14695981039346656037ull;
+
+        void add(const void* bytes, size_t size) {
+            auto p = static_cast<const uint8_t*>(bytes);
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ p[i]) * 1099511628211ull;
+            }
+        }
+        template<class T> void add(const T& value) {
+            add(&value, sizeof(T));
+        }
+    };
+}
+
+std::vector<std::string> PotentiallyVisibleSet::get_mesh_nodes(const Model& model) {
+    std::vector<std::string> names;
+    for (const auto& node : model.nodes) {
+        if (!node.second.mesh.empty()) {
+            names.push_back(node.first);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+uint64_t PotentiallyVisibleSet::get_fingerprint(const Model& model, const std::vector<std::string>& nodes, const PvsSettings& settings) {
+    Hasher hasher;
+    hasher.add(settings.cell_size);
+    hasher.add(settings.max_cells);
+    hasher.add(settings.samples_per_cell);
+    hasher.add(settings.rays_per_node);
+    hasher.add(settings.dilation);
+    for (const auto& name : nodes) {
+        const auto& node = model.nodes.at(name);
+        const auto& mesh = model.meshes.at(node.mesh);
+        hasher.add(name.data(), name.size());
+        hasher.add(node.transform.matrix());
+        hasher.add(static_cast<uint64_t>(mesh.vertices.size()));
+        hasher.add(static_cast<uint64_t>(mesh.indices.size()));
+        hasher.add(mesh.bounds.min);
+        hasher.add(mesh.bounds.max);
+    }
+    return hasher.hash;
+}
+
+std::unique_ptr<PotentiallyVisibleSet> PotentiallyVisibleSet::bake(const Model& model, WorkerPool& workers, const PvsSettings& settings) {
+    auto pvs = std::make_unique<PotentiallyVisibleSet>();
+    pvs->node_names = get_mesh_nodes(model);
+    pvs->fingerprint = get_fingerprint(model, pvs->node_names, settings);
+    auto node_count = static_cast<uint32_t>(pvs->node_names.size());
+
+    //world space triangles, each node's in one run
+    std::vector<BakeTriangle> triangles;
+    std::vector<uint32_t> node_first(node_count);
+    std::vector<uint32_t> node_triangles(node_count);
+    std::vector<glm::vec3> node_min(node_count, glm::vec3(FLT_MAX));
+    std::vector<glm::vec3> node_max(node_count, glm::vec3(-FLT_MAX));
+    glm::vec3 scene_min(FLT_MAX);
+    glm::vec3 scene_max(-FLT_MAX);
+    for (uint32_t n = 0; n < node_count; n++) {
+        const auto& node = model.nodes.at(pvs->node_names[n]);
+        const auto& mesh = model.meshes.at(node.mesh);
+        glm::mat4 M = node.transform.matrix();
+
+        std::vector<glm::vec3> positions;
+        positions.reserve(mesh.vertices.size());
+        for (const auto& vertex : mesh.vertices) {
+            positions.push_back(glm::vec3(M * glm::vec4(vertex.pos, 1.0f)));
+            node_min[n] = glm::min(node_min[n], positions.back());
+            node_max[n] = glm::max(node_max[n], positions.back());
+        }
+        scene_min = glm::min(scene_min, node_min[n]);
+        scene_max = glm::max(scene_max, node_max[n]);
+
+        node_first[n] = static_cast<uint32_t>(triangles.size());
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            const auto& a = positions[mesh.indices[i]];
+            const auto& b = positions[mesh.indices[i + 1]];
+            const auto& c = positions[mesh.indices[i + 2]];
+            triangles.push_back(BakeTriangle{ a, b - a, c - a, n });
+        }
+        node_triangles[n] = static_cast<uint32_t>(triangles.size()) - node_first[n];
+    }
+
+    //running sum of the areas over each node's triangles, so ray targets are spread evenly
+    //over the node's surface instead of crowding on its small triangles
+    std::vector<float> area_sums(triangles.size());
+    for (uint32_t n = 0; n < node_count; n++) {
+        float sum = 0.0f;
+        for (uint32_t i = node_first[n]; i < node_first[n] + node_triangles[n]; i++) {
+            sum += 0.5f * glm::length(glm::cross(triangles[i].e1, triangles[i].e2));
+            area_sums[i] = sum;
+        }
+    }
+
+    //nothing to see, every position is outside the empty grid
+    if (triangles.empty()) {
+        pvs->offsets.assign(1, 0);
+        return pvs;
+    }
+
+    glm::vec3 size = scene_max - scene_min;
+    float cell_size = settings.cell_size;
+    glm::uvec3 dimensions;
+    while (true) {
+        dimensions = glm::max(glm::uvec3(glm::ceil(size / cell_size)), glm::uvec3(1));
+        if (static_cast<uint64_t>(dimensions.x) * dimensions.y * dimensions.z <= settings.max_cells) {
+            break;
+        }
+        cell_size *= 1.25f;
+    }
+    pvs->origin = scene_min;
+    pvs->cell_size = cell_size;
+    pvs->dimensions = dimensions;
+
+    uint32_t cell_count = pvs->get_cell_count();
+    TRACE("baking pvs of " << node_count << " nodes and " << triangles.size() << " triangles in "
+        << dimensions.x << "x" << dimensions.y << "x" << dimensions.z << " cells of " << cell_size)
+
+    Bvh bvh(triangles);
+    size_t byte_count = (node_count + 7) / 8;
+    std::vector<std::vector<uint8_t>> cell_bits(cell_count);
+    workers.parallel_for(cell_count, [&](uint32_t cell) {
+        glm::uvec3 coordinates(cell % dimensions.x, (cell / dimensions.x) % dimensions.y, cell / (dimensions.x * dimensions.y));
+        glm::vec3 cell_min = scene_min + glm::vec3(coordinates) * cell_size;
+        glm::vec3 cell_max = cell_min + glm::vec3(cell_size);
+
+        auto& bits = cell_bits[cell];
+        bits.assign(byte_count, 0);
+        auto set = [&](uint32_t n) {
+            bits[n >> 3] |= static_cast<uint8_t>(1u << (n & 7));
+        };
+
+        //anything reaching into the cell may be right in front of the camera
+        for (uint32_t n = 0; n < node_count; n++) {
+            if (glm::all(glm::lessThanEqual(node_min[n], cell_max)) && glm::all(glm::greaterThanEqual(node_max[n], cell_min))) {
+                set(n);
+            }
+        }
+
+        //seeded by cell, so baking the same model twice gives the same file
+        std::mt19937 random(cell);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (uint32_t sample = 0; sample < FIXED_SAMPLE_COUNT + settings.samples_per_cell; sample++) {
+            glm::vec3 offset = sample < FIXED_SAMPLE_COUNT ?
+                glm::vec3(FIXED_SAMPLES[sample][0], FIXED_SAMPLES[sample][1], FIXED_SAMPLES[sample][2]) :
+                glm::vec3(unit(random), unit(random), unit(random));
+            glm::vec3 point = cell_min + offset * cell_size;
+            for (uint32_t n = 0; n < node_count; n++) {
+                if (is_visible(bits, n) || node_triangles[n] == 0) {
+                    continue;
+                }
+
+                uint32_t first = node_first[n];
+                uint32_t last = first + node_triangles[n];
+                float total_area = area_sums[last - 1];
+                for (uint32_t ray = 0; ray < settings.rays_per_node; ray++) {
+                    //picked by area, a node of only degenerate triangles by index
+                    float pick = unit(random);
+                    uint32_t index = first + std::min(static_cast<uint32_t>(pick * node_triangles[n]), node_triangles[n] - 1);
+                    if (total_area > 0.0f) {
+                        auto it = std::upper_bound(area_sums.begin() + first, area_sums.begin() + last, pick * total_area);
+                        index = std::min(static_cast<uint32_t>(it - area_sums.begin()), last - 1);
+                    }
+                    const auto& t = triangles[index];
+                    float u = unit(random);
+                    float v = unit(random);
+                    if (u + v > 1.0f) {
+                        u = 1.0f - u;
+                        v = 1.0f - v;
+                    }
+                    glm::vec3 target = t.v0 + t.e1 * u + t.e2 * v;
+                    glm::vec3 direction = target - point;
+                    float distance = glm::length(direction);
+                    if (distance < 1e-4f) {
+                        set(n);
+                        break;
+                    }
+
+                    //missing everything means the target was lost to precision, count it
+                    uint32_t hit = bvh.cast(point, direction / distance, distance * 1.001f + 1e-3f);
+                    if (hit == n || hit == Bvh::NO_HIT) {
+                        set(n);
+                        break;
+                    }
+                }
+            }
+        }
+    });
+
+    //a camera near a cell's border sees about what the neighbour's samples saw, merging
+    //them in covers openings only a few rays of either cell found
+    std::vector<std::vector<uint8_t>> compressed(cell_count);
+    auto reach = static_cast<int>(settings.dilation);
+    workers.parallel_for(cell_count, [&](uint32_t cell) {
+        glm::ivec3 coordinates(cell % dimensions.x, (cell / dimensions.x) % dimensions.y, cell / (dimensions.x * dimensions.y));
+        glm::ivec3 lower = glm::max(coordinates - reach, glm::ivec3(0));
+        glm::ivec3 upper = glm::min(coordinates + reach, glm::ivec3(dimensions) - 1);
+        std::vector<uint8_t> bits(byte_count, 0);
+        for (int z = lower.z; z <= upper.z; z++) {
+            for (int y = lower.y; y <= upper.y; y++) {
+                for (int x = lower.x; x <= upper.x; x++) {
+                    const auto& neighbour = cell_bits[x + dimensions.x * (y + dimensions.y * z)];
+                    for (size_t i = 0; i < byte_count; i++) {
+                        bits[i] |= neighbour[i];
+                    }
+                }
+            }
+        }
+        compress(bits, compressed[cell]);
+    });
+
+    pvs->offsets.reserve(cell_count + 1);
+    for (const auto& cell : compressed) {
+        pvs->offsets.push_back(static_cast<uint32_t>(pvs->data.size()));
+        pvs->data.insert(pvs->data.end(), cell.begin(), cell.end());
+    }
+    pvs->offsets.push_back(static_cast<uint32_t>(pvs->data.size()));
+    TRACE("baked pvs into " << pvs->data.size() << " bytes, " << static_cast<size_t>(cell_count) * ((node_count + 7) / 8) << " uncompressed")
+    return pvs;
+}
+
+//a zero byte is followed by how many zero bytes it stands for
+void PotentiallyVisibleSet::compress(const std::vector<uint8_t>& bits, std::vector<uint8_t>& out) {
+    out.clear();
+    for (size_t i = 0; i < bits.size(); i++) {
+        if (bits[i] != 0) {
+            out.push_back(bits[i]);
+            continue;
+        }
+        uint8_t run = 1;
+        while (i + 1 < bits.size() && bits[i + 1] == 0 && run < 255) {
+            i++;
+            run++;
+        }
+        out.push_back(0);
+        out.push_back(run);
+    }
+}
+
+void PotentiallyVisibleSet::decompress(uint32_t cell, std::vector<uint8_t>& bits) const {
+    bits.assign((node_names.size() + 7) / 8, 0);
+    size_t out = 0;
+    uint32_t end = offsets.at(cell + 1);
+    for (uint32_t i = offsets[cell]; i < end && out < bits.size(); i++) {
+        if (data[i] != 0) {
+            bits[out++] = data[i];
+        }
+        else if (i + 1 < end) {
+            out += data[++i];
+        }
+    }
+}
+
+uint32_t PotentiallyVisibleSet::get_cell(const glm::vec3& position) const {
+    glm::vec3 local = (position - origin) / cell_size;
+    if (glm::any(glm::lessThan(local, glm::vec3(0.0f))) || glm::any(glm::greaterThanEqual(local, glm::vec3(dimensions)))) {
+        return NO_CELL;
+    }
+    glm::uvec3 coordinates = glm::min(glm::uvec3(local), dimensions - 1u);
+    return coordinates.x + dimensions.x * (coordinates.y + dimensions.y * coordinates.z);
+}
+
+uint32_t PotentiallyVisibleSet::get_node_index(const std::string& name) const {
+    auto it = std::lower_bound(node_names.begin(), node_names.end(), name);
+    if (it == node_names.end() || *it != name) {
+        return NO_NODE;
+    }
+    return static_cast<uint32_t>(it - node_names.begin());
+}
+
+bool PotentiallyVisibleSet::matches(const Model& model, const PvsSettings& settings) const {
+    auto nodes = get_mesh_nodes(model);
+    return nodes == node_names && get_fingerprint(model, nodes, settings) == fingerprint;
+}
+
+void PotentiallyVisibleSet::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("failed to write pvs file " + path);
+    }
+
+    file.write(MAGIC, sizeof(MAGIC));
+    write_value(file, fingerprint);
+    write_value(file, origin);
+    write_value(file, cell_size);
+    write_value(file, dimensions);
+    write_value(file, static_cast<uint32_t>(node_names.size()));
+    for (const auto& name : node_names) {
+        write_value(file, static_cast<uint32_t>(name.size()));
+        file.write(name.data(), name.size());
+    }
+    write_value(file, static_cast<uint32_t>(data.size()));
+    file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+std::unique_ptr<PotentiallyVisibleSet> PotentiallyVisibleSet::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return nullptr;
+    }
+
+    char magic[sizeof(MAGIC)];
+    file.read(magic, sizeof(magic));
+    if (!file || !std::equal(magic, magic + 3, MAGIC)) {
+        throw std::runtime_error("not a pvs file " + path);
+    }
+    //an older layout, baked again like a missing file
+    if (magic[3] != MAGIC[3]) {
+        return nullptr;
+    }
+
+    auto pvs = std::make_unique<PotentiallyVisibleSet>();
+    read_value(file, pvs->fingerprint);
+    read_value(file, pvs->origin);
+    read_value(file, pvs->cell_size);
+    read_value(file, pvs->dimensions);
+    uint32_t node_count = 0;
+    read_value(file, node_count);
+    pvs->node_names.resize(node_count);
+    for (auto& name : pvs->node_names) {
+        uint32_t length = 0;
+        read_value(file, length);
+        name.resize(length);
+        file.read(&name[0], length);
+    }
+    uint32_t data_size = 0;
+    read_value(file, data_size);
+    pvs->offsets.resize(static_cast<size_t>(pvs->get_cell_count()) + 1);
+    pvs->data.resize(data_size);
+    file.read(reinterpret_cast<char*>(pvs->offsets.data()), pvs->offsets.size() * sizeof(uint32_t));
+    file.read(reinterpret_cast<char*>(pvs->data.data()), data_size);
+    if (!file || pvs->offsets.back() != data_size) {
+        throw std::runtime_error("truncated pvs file " + path);
+    }
+    return pvs;
+}
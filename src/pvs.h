@@ -0,0 +1,86 @@
+#pragma once
+
+#include "geometry.h"
+#include "worker_pool.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Model;
+
+struct PvsSettings {
+    //edge of the cubic cells, in world units
+    float cell_size = 4.0f;
+    //grows cell_size until the grid has at most this many cells
+    uint32_t max_cells = 1 << 16;
+    //random points per cell rays start from, on top of the cell's corners, face centres and
+    //centre
+    uint32_t samples_per_cell = 32;
+    //rays from each sample to random points on each node's surface
+    uint32_t rays_per_node = 8;
+    //every cell also takes the bits of the cells this many steps away on each axis
+    uint32_t dilation = 1;
+};
+
+//precomputed potentially visible set of a static model. the model's bounds are divided into
+//a grid of cells and every cell stores a bit per scene node with a mesh, set if any part of
+//the node can be seen from anywhere in the cell. nodes are numbered in name order.
+//
+//baking casts rays from sample points in each cell to points spread evenly over each node's
+//surface, one cell per job, against a bvh of the whole model. a node counts as visible when a
+//ray's first hit is the node itself. a missed bit hides geometry that is really there, so
+//the bake leans towards too many bits: the samples include the cell's corners and face
+//centres, and every cell is merged with its neighbours. a node seen only through a gap so
+//small that no ray finds it can still be missing, more samples and rays narrow that down.
+//the bitsets are stored with runs of zero bytes collapsed, the way quake stored its pvs, and
+//saved next to the model as <model path>.pvs, headed by a fingerprint of what the bake read
+//so a stale file is baked again
+class PotentiallyVisibleSet {
+public:
+    static constexpr uint32_t NO_CELL = ~0u;
+    static constexpr uint32_t NO_NODE = ~0u;
+
+    static std::unique_ptr<PotentiallyVisibleSet> bake(const Model& model, WorkerPool& workers, const PvsSettings& settings = {});
+    //nullptr if there is no file or it has an older version, throws if it isn't a pvs file
+    static std::unique_ptr<PotentiallyVisibleSet> load(const std::string& path);
+    void save(const std::string& path) const;
+
+    //false if the model's nodes, their transforms or meshes, or the settings changed since baking
+    bool matches(const Model& model, const PvsSettings& settings = {}) const;
+
+    uint32_t get_node_index(const std::string& name) const;
+    uint32_t get_node_count() const {
+        return static_cast<uint32_t>(node_names.size());
+    }
+    //NO_CELL outside the grid, where everything counts as visible
+    uint32_t get_cell(const glm::vec3& position) const;
+    uint32_t get_cell_count() const {
+        return dimensions.x * dimensions.y * dimensions.z;
+    }
+    size_t get_compressed_size() const {
+        return data.size();
+    }
+
+    //a bit per node, node_count rounded up to whole bytes
+    void decompress(uint32_t cell, std::vector<uint8_t>& bits) const;
+    static bool is_visible(const std::vector<uint8_t>& bits, uint32_t node) {
+        return (bits[node >> 3] & (1u << (node & 7))) != 0;
+    }
+
+private:
+    glm::vec3 origin{ 0.0f };
+    float cell_size = 1.0f;
+    glm::uvec3 dimensions{ 0 };
+    std::vector<std::string> node_names;
+    uint64_t fingerprint = 0;
+    //cell i's bits start at offsets[i], one more entry marks the end
+    std::vector<uint32_t> offsets;
+    std::vector<uint8_t> data;
+
+    static std::vector<std::string> get_mesh_nodes(const Model& model);
+    //hash of the mesh nodes' names and transforms, their meshes' vertex and index counts and
+    //bounds, and the settings
+    static uint64_t get_fingerprint(const Model& model, const std::vector<std::string>& nodes, const PvsSettings& settings);
+    static void compress(const std::vector<uint8_t>& bits, std::vector<uint8_t>& out);
+};
@@ -0,0 +1,702 @@
+#include "render_graph.h"
+#include "log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+struct UsageInfo {
+    vk::PipelineStageFlags stages;
+    vk::AccessFlags read_access;
+    vk::AccessFlags write_access;
+    vk::ImageLayout read_layout;
+    vk::ImageLayout write_layout;
+    vk::ImageUsageFlags read_usage;
+    vk::ImageUsageFlags write_usage;
+};
+
+UsageInfo get_usage_info(GraphUsage usage) {
+    using Stage = vk::PipelineStageFlagBits;
+    using Access = vk::AccessFlagBits;
+    using Layout = vk::ImageLayout;
+    using Usage = vk::ImageUsageFlagBits;
+
+    switch (usage) {
+    case GraphUsage::ColorAttachment:
+        return { Stage::eColorAttachmentOutput, Access::eColorAttachmentRead, Access::eColorAttachmentWrite,
+            Layout::eColorAttachmentOptimal, Layout::eColorAttachmentOptimal, Usage::eColorAttachment, Usage::eColorAttachment };
+    case GraphUsage::DepthAttachment:
+        return { Stage::eEarlyFragmentTests | Stage::eLateFragmentTests, Access::eDepthStencilAttachmentRead, Access::eDepthStencilAttachmentWrite,
+            Layout::eDepthStencilReadOnlyOptimal, Layout::eDepthStencilAttachmentOptimal, Usage::eDepthStencilAttachment, Usage::eDepthStencilAttachment };
+    case GraphUsage::Sampled:
+        return { Stage::eFragmentShader, Access::eShaderRead, {},
+            Layout::eShaderReadOnlyOptimal, Layout::eUndefined, Usage::eSampled, {} };
+    case GraphUsage::ComputeSampled:
+        return { Stage::eComputeShader, Access::eShaderRead, {},
+            Layout::eShaderReadOnlyOptimal, Layout::eUndefined, Usage::eSampled, {} };
+    case GraphUsage::ComputeStorage:
+        return { Stage::eComputeShader, Access::eShaderRead, Access::eShaderWrite,
+            Layout::eGeneral, Layout::eGeneral, Usage::eStorage, Usage::eStorage };
+    case GraphUsage::VertexStorage:
+        return { Stage::eVertexShader, Access::eShaderRead, Access::eShaderWrite,
+            Layout::eGeneral, Layout::eGeneral, Usage::eStorage, Usage::eStorage };
+    case GraphUsage::Indirect:
+        return { Stage::eDrawIndirect, Access::eIndirectCommandRead, {},
+            Layout::eUndefined, Layout::eUndefined, {}, {} };
+    case GraphUsage::Transfer:
+        return { Stage::eTransfer, Access::eTransferRead, Access::eTransferWrite,
+            Layout::eTransferSrcOptimal, Layout::eTransferDstOptimal, Usage::eTransferSrc, Usage::eTransferDst };
+    }
+    throw std::invalid_argument("unknown graph usage");
+}
+
+bool is_attachment(GraphUsage usage) {
+    return usage == GraphUsage::ColorAttachment || usage == GraphUsage::DepthAttachment;
+}
+
+bool is_depth_format(vk::Format format) {
+    switch (format) {
+    case vk::Format::eD16Unorm:
+    case vk::Format::eX8D24UnormPack32:
+    case vk::Format::eD32Sfloat:
+    case vk::Format::eD16UnormS8Uint:
+    case vk::Format::eD24UnormS8Uint:
+    case vk::Format::eD32SfloatS8Uint:
+        return true;
+    default:
+        return false;
+    }
+}
+
+//views of depth/stencil images only see depth, so they can be sampled
+vk::ImageAspectFlags get_view_aspect(vk::Format format) {
+    return is_depth_format(format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+}
+
+vk::ImageAspectFlags get_aspect(vk::Format format) {
+    switch (format) {
+    case vk::Format::eD16UnormS8Uint:
+    case vk::Format::eD24UnormS8Uint:
+    case vk::Format::eD32SfloatS8Uint:
+        return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+    default:
+        return is_depth_format(format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+    }
+}
+
+}
+
+void GraphStats::print() const {
+    DEBUG("render graph: " << passes << " passes, " << culled_passes << " culled, "
+        << barrier_batches << " barriers with " << image_barriers << " image transitions per frame")
+    DEBUG("render graph: " << transient_images << " transient images in " << transient_bytes
+        << " bytes, " << unaliased_bytes << " without aliasing")
+}
+
+GraphResource RenderGraph::create_image(const std::string& name, vk::Format format, vk::Extent2D extent, uint32_t mip_levels) {
+    Resource resource;
+    resource.name = name;
+    resource.is_image = true;
+    resource.format = format;
+    resource.extent = extent;
+    resource.mip_levels = mip_levels;
+    resources.push_back(resource);
+    return static_cast<GraphResource>(resources.size() - 1);
+}
+
+GraphResource RenderGraph::import_image(const std::string& name, vk::Format format, vk::Extent2D extent,
+    const std::vector<vk::Image>& images, const std::vector<vk::ImageView>& views,
+    vk::PipelineStageFlags stage, vk::ImageLayout final_layout) {
+    if (images.size() != views.size()) {
+        throw std::runtime_error("imported image " + name + " needs a view per image");
+    }
+
+    Resource resource;
+    resource.name = name;
+    resource.is_image = true;
+    resource.imported = true;
+    resource.format = format;
+    resource.extent = extent;
+    resource.import_stage = stage;
+    resource.final_layout = final_layout;
+    resource.images = images;
+    resource.views = views;
+    resources.push_back(resource);
+    return static_cast<GraphResource>(resources.size() - 1);
+}
+
+GraphResource RenderGraph::create_buffer(const std::string& name) {
+    Resource resource;
+    resource.name = name;
+    resources.push_back(resource);
+    return static_cast<GraphResource>(resources.size() - 1);
+}
+
+void RenderGraph::set_output(GraphResource resource) {
+    resources.at(resource).output = true;
+}
+
+uint32_t RenderGraph::add_pass(const std::string& name, GraphPassType type, RecordFunction record) {
+    Pass pass;
+    pass.name = name;
+    pass.type = type;
+    pass.record = std::move(record);
+    passes.push_back(std::move(pass));
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+RenderGraph::Access& RenderGraph::get_access(uint32_t pass, GraphResource resource, GraphUsage usage) {
+    if (resource >= resources.size()) {
+        throw std::runtime_error("pass " + passes.at(pass).name + " uses an unknown resource");
+    }
+    if (is_attachment(usage) && passes.at(pass).type != GraphPassType::Graphics) {
+        throw std::runtime_error("attachment " + resources[resource].name + " used outside a graphics pass");
+    }
+
+    //a resource is used one way per pass, reading and writing it merge into one access
+    for (auto& access : passes.at(pass).accesses) {
+        if (access.resource == resource) {
+            if (access.usage != usage) {
+                throw std::runtime_error("pass " + passes[pass].name + " uses " + resources[resource].name + " in two ways");
+            }
+            return access;
+        }
+    }
+
+    Access access;
+    access.resource = resource;
+    access.usage = usage;
+    passes[pass].accesses.push_back(access);
+    return passes[pass].accesses.back();
+}
+
+void RenderGraph::read(uint32_t pass, GraphResource resource, GraphUsage usage) {
+    get_access(pass, resource, usage).read = true;
+}
+
+void RenderGraph::write(uint32_t pass, GraphResource resource, GraphUsage usage) {
+    if (!get_usage_info(usage).write_access) {
+        throw std::runtime_error(resources.at(resource).name + " can't be written with that usage");
+    }
+    get_access(pass, resource, usage).write = true;
+}
+
+void RenderGraph::clear(uint32_t pass, GraphResource resource, vk::ClearValue value) {
+    for (auto& access : passes.at(pass).accesses) {
+        if (access.resource == resource && is_attachment(access.usage) && access.write) {
+            access.clear = true;
+            access.clear_value = value;
+            return;
+        }
+    }
+    throw std::runtime_error("pass " + passes[pass].name + " clears " + resources.at(resource).name + " without writing it as an attachment");
+}
+
+void RenderGraph::set_contents(uint32_t pass, vk::SubpassContents contents) {
+    passes.at(pass).contents = contents;
+}
+
+void RenderGraph::compile(uint32_t count) {
+    TRACE("compiling render graph")
+    image_count = count;
+    stats = GraphStats{};
+
+    for (const auto& resource : resources) {
+        if (resource.imported && resource.images.size() != image_count) {
+            throw std::runtime_error("imported image " + resource.name + " doesn't have an image per swapchain image");
+        }
+    }
+
+    cull_passes();
+
+    for (uint32_t i = 0; i < passes.size(); i++) {
+        if (!passes[i].alive) {
+            continue;
+        }
+        for (const auto& access : passes[i].accesses) {
+            auto& resource = resources[access.resource];
+            auto info = get_usage_info(access.usage);
+            resource.first_use = std::min(resource.first_use, i);
+            resource.last_use = std::max(resource.last_use, i);
+            if (access.read) {
+                resource.usage |= info.read_usage;
+            }
+            if (access.write) {
+                resource.usage |= info.write_usage;
+            }
+        }
+    }
+
+    create_transient_images();
+    build_barriers();
+
+    for (auto& pass : passes) {
+        if (pass.alive && pass.type == GraphPassType::Graphics) {
+            build_render_pass(pass);
+        }
+    }
+
+    stats.passes = static_cast<uint32_t>(passes.size());
+    for (const auto& pass : passes) {
+        if (!pass.alive) {
+            stats.culled_passes++;
+            TRACE("render graph culled pass " << pass.name)
+        }
+        else if (!pass.barrier.is_empty()) {
+            stats.barrier_batches++;
+            stats.image_barriers += static_cast<uint32_t>(pass.barrier.images.size());
+        }
+    }
+    if (!final_barrier.is_empty()) {
+        stats.barrier_batches++;
+        stats.image_barriers += static_cast<uint32_t>(final_barrier.images.size());
+    }
+}
+
+void RenderGraph::cull_passes() {
+    //walking backwards, needed marks resources whose current contents a later alive pass
+    //reads, or that have to survive the frame
+    std::vector<bool> needed(resources.size());
+    for (size_t i = 0; i < resources.size(); i++) {
+        needed[i] = resources[i].imported || resources[i].output;
+    }
+
+    for (size_t i = passes.size(); i-- > 0;) {
+        auto& pass = passes[i];
+        pass.alive = false;
+        for (const auto& access : pass.accesses) {
+            if (access.write && needed[access.resource]) {
+                pass.alive = true;
+            }
+        }
+        if (!pass.alive) {
+            continue;
+        }
+
+        for (const auto& access : pass.accesses) {
+            if (access.read) {
+                needed[access.resource] = true;
+            }
+            //a cleared attachment doesn't care what earlier passes wrote
+            else if (access.clear) {
+                needed[access.resource] = false;
+            }
+        }
+    }
+}
+
+void RenderGraph::create_transient_images() {
+    std::vector<GraphResource> transients;
+    std::vector<vk::MemoryRequirements> requirements(resources.size());
+    for (GraphResource i = 0; i < resources.size(); i++) {
+        auto& resource = resources[i];
+        //images no alive pass touches aren't created at all
+        if (!resource.is_image || resource.imported || resource.first_use == ~0u) {
+            continue;
+        }
+
+        vk::ImageCreateInfo create_info({},
+            vk::ImageType::e2D,
+            resource.format,
+            vk::Extent3D(resource.extent.width, resource.extent.height, 1),
+            resource.mip_levels,
+            1,
+            vk::SampleCountFlagBits::e1,
+            vk::ImageTiling::eOptimal,
+            resource.usage,
+            vk::SharingMode::eExclusive,
+            {},
+            {},
+            vk::ImageLayout::eUndefined);
+        resource.images = { context.device.createImage(create_info) };
+        requirements[i] = context.device.getImageMemoryRequirements(resource.images[0]);
+        stats.unaliased_bytes += requirements[i].size;
+        transients.push_back(i);
+    }
+    stats.transient_images = static_cast<uint32_t>(transients.size());
+
+    //biggest first, each image goes into the first slot it fits next to
+    std::sort(transients.begin(), transients.end(), [&](GraphResource a, GraphResource b) {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    for (auto index : transients) {
+        auto& resource = resources[index];
+        const auto& needs = requirements[index];
+
+        uint32_t slot_index = static_cast<uint32_t>(slots.size());
+        for (uint32_t s = 0; s < slots.size(); s++) {
+            if ((slots[s].requirements.memoryTypeBits & needs.memoryTypeBits) == 0) {
+                continue;
+            }
+            bool overlaps = false;
+            for (auto other : slots[s].resources) {
+                if (resource.first_use <= resources[other].last_use && resources[other].first_use <= resource.last_use) {
+                    overlaps = true;
+                    break;
+                }
+            }
+            if (!overlaps) {
+                slot_index = s;
+                break;
+            }
+        }
+
+        if (slot_index == slots.size()) {
+            Slot slot;
+            slot.requirements = needs;
+            slots.push_back(slot);
+        }
+        else {
+            auto& slot_requirements = slots[slot_index].requirements;
+            slot_requirements.size = std::max(slot_requirements.size, needs.size);
+            slot_requirements.alignment = std::max(slot_requirements.alignment, needs.alignment);
+            slot_requirements.memoryTypeBits &= needs.memoryTypeBits;
+        }
+        slots[slot_index].resources.push_back(index);
+        resource.slot = slot_index;
+    }
+
+    for (auto& slot : slots) {
+        std::sort(slot.resources.begin(), slot.resources.end(), [&](GraphResource a, GraphResource b) {
+            return resources[a].first_use < resources[b].first_use;
+        });
+        slot.allocation = context.allocator.allocate(slot.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal, false);
+        stats.transient_bytes += slot.requirements.size;
+
+        for (auto index : slot.resources) {
+            auto& resource = resources[index];
+            context.device.bindImageMemory(resource.images[0], slot.allocation.memory, slot.allocation.offset);
+
+            vk::ImageViewCreateInfo view_info({},
+                resource.images[0],
+                vk::ImageViewType::e2D,
+                resource.format,
+                vk::ComponentMapping{},
+                vk::ImageSubresourceRange{ get_view_aspect(resource.format), 0, resource.mip_levels, 0, 1 });
+            resource.views = { context.device.createImageView(view_info) };
+
+            if (resource.mip_levels > 1) {
+                for (uint32_t mip = 0; mip < resource.mip_levels; mip++) {
+                    view_info.subresourceRange.baseMipLevel = mip;
+                    view_info.subresourceRange.levelCount = 1;
+                    resource.mip_views.push_back(context.device.createImageView(view_info));
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::transition(State& state, GraphResource index, const Access& access, Barrier& barrier) const {
+    const auto& resource = resources[index];
+    auto info = get_usage_info(access.usage);
+
+    vk::AccessFlags dst_access;
+    if (access.read || (access.write && !access.clear)) {
+        dst_access |= info.read_access;
+    }
+    if (access.write) {
+        dst_access |= info.write_access;
+    }
+    auto layout = access.write ? info.write_layout : info.read_layout;
+    bool layout_change = resource.is_image && layout != state.layout;
+
+    vk::PipelineStageFlags src_stages;
+    vk::AccessFlags src_access;
+    if (access.write || layout_change) {
+        //writes and layout transitions wait for everything before them
+        src_stages = state.write_stages | state.read_stages;
+        src_access = state.write_access;
+    }
+    else if (state.write_access && (info.stages & ~state.read_stages)) {
+        //reads only have to wait for the last write, once per stage
+        src_stages = state.write_stages;
+        src_access = state.write_access;
+    }
+
+    if (src_stages || layout_change) {
+        barrier.src_stages |= src_stages ? src_stages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+        barrier.dst_stages |= info.stages;
+        if (layout_change) {
+            barrier.images.push_back({ index, src_access, dst_access, state.layout, layout });
+        }
+        else if (src_access) {
+            barrier.src_access |= src_access;
+            barrier.dst_access |= dst_access;
+        }
+    }
+
+    if (access.write || layout_change) {
+        state.write_stages = info.stages;
+        state.write_access = access.write ? info.write_access : vk::AccessFlags{};
+        state.read_stages = access.write ? vk::PipelineStageFlags{} : info.stages;
+        state.layout = layout;
+    }
+    else {
+        state.read_stages |= info.stages;
+    }
+}
+
+std::vector<RenderGraph::State> RenderGraph::simulate(std::vector<State> states, bool emit) {
+    std::vector<bool> written(resources.size());
+    for (auto& pass : passes) {
+        if (!pass.alive) {
+            continue;
+        }
+
+        Barrier barrier;
+        for (auto& access : pass.accesses) {
+            transition(states[access.resource], access.resource, access, barrier);
+            access.load = written[access.resource] && !access.clear;
+            if (access.write) {
+                written[access.resource] = true;
+            }
+        }
+        if (emit) {
+            pass.barrier = barrier;
+        }
+    }
+    return states;
+}
+
+void RenderGraph::build_barriers() {
+    std::vector<State> start(resources.size());
+    for (size_t i = 0; i < resources.size(); i++) {
+        if (resources[i].imported) {
+            //nothing may touch it before stage, eg. the wait on the acquire semaphore
+            start[i].write_stages = resources[i].import_stage;
+        }
+    }
+
+    //the first image in a slot follows the last one of the previous frame, the others the
+    //one before them. their contents are discarded, but the memory is shared
+    auto end = simulate(start, false);
+    for (const auto& slot : slots) {
+        for (size_t i = 0; i < slot.resources.size(); i++) {
+            auto previous = slot.resources[i == 0 ? slot.resources.size() - 1 : i - 1];
+            auto& state = start[slot.resources[i]];
+            state.write_stages = end[previous].write_stages | end[previous].read_stages;
+            state.write_access = end[previous].write_access;
+            state.read_stages = {};
+            state.layout = vk::ImageLayout::eUndefined;
+        }
+    }
+    end = simulate(start, true);
+
+    final_barrier = Barrier{};
+    for (GraphResource i = 0; i < resources.size(); i++) {
+        const auto& resource = resources[i];
+        if (!resource.imported || resource.first_use == ~0u || end[i].layout == resource.final_layout) {
+            continue;
+        }
+        final_barrier.src_stages |= end[i].write_stages | end[i].read_stages;
+        final_barrier.dst_stages |= vk::PipelineStageFlagBits::eBottomOfPipe;
+        final_barrier.images.push_back({ i, end[i].write_access, {}, end[i].layout, resource.final_layout });
+    }
+}
+
+void RenderGraph::build_render_pass(Pass& pass) {
+    std::vector<vk::AttachmentDescription> attachments;
+    std::vector<vk::AttachmentReference> color_refs;
+    vk::AttachmentReference depth_ref;
+    bool has_depth = false;
+    std::vector<GraphResource> attachment_resources;
+    pass.clear_values.clear();
+
+    uint32_t pass_index = static_cast<uint32_t>(&pass - passes.data());
+    for (const auto& access : pass.accesses) {
+        if (!is_attachment(access.usage)) {
+            continue;
+        }
+        const auto& resource = resources[access.resource];
+        auto info = get_usage_info(access.usage);
+        auto layout = access.write ? info.write_layout : info.read_layout;
+
+        //anything nobody looks at afterwards is never written out to memory
+        bool store = access.write && (resource.imported || resource.output || resource.last_use > pass_index);
+        vk::AttachmentLoadOp load_op = access.clear ? vk::AttachmentLoadOp::eClear
+            : access.load ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eDontCare;
+        vk::AttachmentStoreOp store_op = store ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+
+        vk::AttachmentDescription description{};
+        description.format = resource.format;
+        description.samples = vk::SampleCountFlagBits::e1;
+        description.loadOp = load_op;
+        description.storeOp = store_op;
+        description.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+        description.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        //the graph's barriers do all the layout transitions
+        description.initialLayout = layout;
+        description.finalLayout = layout;
+
+        vk::AttachmentReference ref(static_cast<uint32_t>(attachments.size()), layout);
+        if (access.usage == GraphUsage::DepthAttachment) {
+            if (has_depth) {
+                throw std::runtime_error("pass " + pass.name + " has more than one depth attachment");
+            }
+            depth_ref = ref;
+            has_depth = true;
+        }
+        else {
+            color_refs.push_back(ref);
+        }
+
+        if (attachments.empty()) {
+            pass.extent = resource.extent;
+        }
+        else if (resource.extent != pass.extent) {
+            throw std::runtime_error("attachments of pass " + pass.name + " differ in size");
+        }
+        attachments.push_back(description);
+        attachment_resources.push_back(access.resource);
+        pass.clear_values.push_back(access.clear_value);
+    }
+
+    if (attachments.empty()) {
+        throw std::runtime_error("graphics pass " + pass.name + " has no attachments");
+    }
+
+    vk::SubpassDescription subpass{};
+    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(color_refs.size());
+    subpass.pColorAttachments = color_refs.data();
+    subpass.pDepthStencilAttachment = has_depth ? &depth_ref : nullptr;
+
+    vk::RenderPassCreateInfo renderpass_info{};
+    renderpass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderpass_info.pAttachments = attachments.data();
+    renderpass_info.subpassCount = 1;
+    renderpass_info.pSubpasses = &subpass;
+    pass.render_pass = context.device.createRenderPass(renderpass_info);
+
+    pass.framebuffers.resize(image_count);
+    for (uint32_t image = 0; image < image_count; image++) {
+        std::vector<vk::ImageView> views;
+        for (auto resource : attachment_resources) {
+            views.push_back(get_image_view(resource, image));
+        }
+
+        vk::FramebufferCreateInfo create_info{};
+        create_info.renderPass = pass.render_pass;
+        create_info.attachmentCount = static_cast<uint32_t>(views.size());
+        create_info.pAttachments = views.data();
+        create_info.width = pass.extent.width;
+        create_info.height = pass.extent.height;
+        create_info.layers = 1;
+        pass.framebuffers[image] = context.device.createFramebuffer(create_info);
+    }
+}
+
+vk::Image RenderGraph::get_image(GraphResource resource, uint32_t image) const {
+    const auto& r = resources.at(resource);
+    return r.imported ? r.images.at(image) : r.images.at(0);
+}
+
+vk::ImageView RenderGraph::get_image_view(GraphResource resource, uint32_t image) const {
+    const auto& r = resources.at(resource);
+    if (r.views.empty()) {
+        return nullptr;
+    }
+    return r.imported ? r.views.at(image) : r.views.at(0);
+}
+
+vk::ImageView RenderGraph::get_mip_view(GraphResource resource, uint32_t mip) const {
+    const auto& r = resources.at(resource);
+    if (r.mip_views.empty()) {
+        return mip == 0 ? get_image_view(resource, 0) : nullptr;
+    }
+    return r.mip_views.at(mip);
+}
+
+void RenderGraph::record_barrier(vk::CommandBuffer command_buffer, const Barrier& barrier, uint32_t image) const {
+    if (barrier.is_empty()) {
+        return;
+    }
+
+    std::vector<vk::ImageMemoryBarrier> image_barriers;
+    image_barriers.reserve(barrier.images.size());
+    for (const auto& transition : barrier.images) {
+        const auto& resource = resources[transition.resource];
+        image_barriers.push_back(vk::ImageMemoryBarrier(transition.src_access,
+            transition.dst_access,
+            transition.old_layout,
+            transition.new_layout,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            get_image(transition.resource, image),
+            vk::ImageSubresourceRange(get_aspect(resource.format), 0, resource.mip_levels, 0, 1)));
+    }
+
+    vk::MemoryBarrier memory_barrier(barrier.src_access, barrier.dst_access);
+    uint32_t memory_barrier_count = barrier.src_access ? 1 : 0;
+    command_buffer.pipelineBarrier(barrier.src_stages, barrier.dst_stages, {},
+        memory_barrier_count, &memory_barrier,
+        0, nullptr,
+        static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+}
+
+void RenderGraph::execute(vk::CommandBuffer command_buffer, uint32_t image) {
+    for (const auto& pass : passes) {
+        if (!pass.alive) {
+            continue;
+        }
+
+        record_barrier(command_buffer, pass.barrier, image);
+
+        if (pass.type == GraphPassType::Graphics) {
+            vk::RenderPassBeginInfo begin_info{};
+            begin_info.renderPass = pass.render_pass;
+            begin_info.framebuffer = pass.framebuffers[image];
+            begin_info.renderArea.offset = vk::Offset2D{ 0, 0 };
+            begin_info.renderArea.extent = pass.extent;
+            begin_info.clearValueCount = static_cast<uint32_t>(pass.clear_values.size());
+            begin_info.pClearValues = pass.clear_values.data();
+
+            command_buffer.beginRenderPass(begin_info, pass.contents);
+            pass.record(command_buffer, image);
+            command_buffer.endRenderPass();
+        }
+        else {
+            pass.record(command_buffer, image);
+        }
+    }
+
+    record_barrier(command_buffer, final_barrier, image);
+}
+
+void RenderGraph::close() {
+    for (auto& pass : passes) {
+        for (auto framebuffer : pass.framebuffers) {
+            context.device.destroyFramebuffer(framebuffer);
+        }
+        if (pass.render_pass != vk::RenderPass(nullptr)) {
+            context.device.destroyRenderPass(pass.render_pass);
+        }
+    }
+
+    for (auto& resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+        for (auto view : resource.views) {
+            context.device.destroyImageView(view);
+        }
+        for (auto view : resource.mip_views) {
+            context.device.destroyImageView(view);
+        }
+        for (auto image : resource.images) {
+            context.device.destroyImage(image);
+        }
+    }
+
+    for (auto& slot : slots) {
+        context.allocator.free(slot.allocation);
+    }
+
+    passes.clear();
+    resources.clear();
+    slots.clear();
+    final_barrier = Barrier{};
+    stats = GraphStats{};
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "context.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//index of an image or buffer declared on a RenderGraph
+typedef uint32_t GraphResource;
+
+//how a pass uses a resource. together with whether it reads or writes, this decides the
+//stages, access masks and image layout the graph synchronizes on
+enum class GraphUsage {
+    ColorAttachment,
+    DepthAttachment,
+    //sampled in the fragment shader
+    Sampled,
+    //sampled in a compute shader
+    ComputeSampled,
+    //storage image or buffer in a compute shader
+    ComputeStorage,
+    //storage buffer in the vertex shader
+    VertexStorage,
+    //draw parameters of indirect draws
+    Indirect,
+    Transfer
+};
+
+enum class GraphPassType {
+    //runs inside a render pass built from its attachment usages
+    Graphics,
+    //records anything outside of a render pass
+    Compute
+};
+
+struct GraphStats {
+    uint32_t passes = 0;
+    uint32_t culled_passes = 0;
+    //pipeline barrier calls per frame, and the image barriers in them
+    uint32_t barrier_batches = 0;
+    uint32_t image_barriers = 0;
+    uint32_t transient_images = 0;
+    //memory backing the transient images, and what it would take without aliasing
+    vk::DeviceSize transient_bytes = 0;
+    vk::DeviceSize unaliased_bytes = 0;
+
+    void print() const;
+};
+
+//frame graph. passes declare which images and buffers they read and write, compile() works
+//out the barriers and layout transitions between them, drops passes nothing depends on and
+//places transient images with disjoint lifetimes in the same memory. execute() then records
+//the whole frame into one command buffer.
+//
+//passes run in the order they were added. images live in the graph (transient) or are
+//imported with one vk::Image per swapchain image. buffers are only names, the graph
+//synchronizes them with global memory barriers, so per image buffers that grow need no
+//changes to the graph. everything is built again when the swapchain is
+class RenderGraph {
+public:
+    typedef std::function<void(vk::CommandBuffer command_buffer, uint32_t image)> RecordFunction;
+
+    RenderGraph(Context& ctx) : context(ctx) {}
+    RenderGraph(const RenderGraph& other) = delete;
+
+    //destroys everything compile() created and forgets all declarations
+    void close();
+
+    //images owned by the graph, they don't keep their contents across frames. barriers
+    //always cover every mip level
+    GraphResource create_image(const std::string& name, vk::Format format, vk::Extent2D extent, uint32_t mip_levels = 1);
+    //images owned by someone else, one per swapchain image. they start out undefined, are
+    //first touched after stage and are left in final_layout at the end of the frame
+    GraphResource import_image(const std::string& name, vk::Format format, vk::Extent2D extent,
+        const std::vector<vk::Image>& images, const std::vector<vk::ImageView>& views,
+        vk::PipelineStageFlags stage, vk::ImageLayout final_layout);
+    GraphResource create_buffer(const std::string& name);
+    //keeps the passes writing resource alive, imported images always are
+    void set_output(GraphResource resource);
+
+    uint32_t add_pass(const std::string& name, GraphPassType type, RecordFunction record);
+    void read(uint32_t pass, GraphResource resource, GraphUsage usage);
+    void write(uint32_t pass, GraphResource resource, GraphUsage usage);
+    //attachments the pass clears instead of loading
+    void clear(uint32_t pass, GraphResource resource, vk::ClearValue value);
+    //inline draws or secondary command buffers, can change from frame to frame
+    void set_contents(uint32_t pass, vk::SubpassContents contents);
+
+    //creates transient images, render passes and framebuffers for image_count swapchain images
+    void compile(uint32_t image_count);
+    void execute(vk::CommandBuffer command_buffer, uint32_t image);
+
+    bool is_culled(uint32_t pass) const {
+        return !passes.at(pass).alive;
+    }
+    //graphics passes only, for pipelines and secondary command buffer inheritance
+    vk::RenderPass get_render_pass(uint32_t pass) const {
+        return passes.at(pass).render_pass;
+    }
+    vk::Framebuffer get_framebuffer(uint32_t pass, uint32_t image) const {
+        return passes.at(pass).framebuffers.at(image);
+    }
+    //all mip levels, and one level of transient images with several
+    vk::ImageView get_image_view(GraphResource resource, uint32_t image) const;
+    vk::ImageView get_mip_view(GraphResource resource, uint32_t mip) const;
+    const GraphStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    struct Resource {
+        std::string name;
+        bool is_image = false;
+        bool imported = false;
+        bool output = false;
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        uint32_t mip_levels = 1;
+        vk::ImageUsageFlags usage;
+        vk::PipelineStageFlags import_stage;
+        vk::ImageLayout final_layout = vk::ImageLayout::eUndefined;
+        //one per swapchain image when imported, a single one otherwise
+        std::vector<vk::Image> images;
+        std::vector<vk::ImageView> views;
+        std::vector<vk::ImageView> mip_views;
+        //transient images, the aliasing slot and the alive passes using it
+        uint32_t slot = 0;
+        uint32_t first_use = ~0u;
+        uint32_t last_use = 0;
+    };
+
+    struct Access {
+        GraphResource resource;
+        GraphUsage usage;
+        bool read = false;
+        bool write = false;
+        bool clear = false;
+        vk::ClearValue clear_value;
+        //attachments, whether an earlier pass left contents to load
+        bool load = false;
+    };
+
+    //where a resource is at some point of the frame: the last write and the reads since,
+    //which have already been made to wait for it
+    struct State {
+        vk::PipelineStageFlags write_stages;
+        vk::AccessFlags write_access;
+        vk::PipelineStageFlags read_stages;
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    };
+
+    //one pipelineBarrier call
+    struct Barrier {
+        vk::PipelineStageFlags src_stages;
+        vk::PipelineStageFlags dst_stages;
+        vk::AccessFlags src_access;
+        vk::AccessFlags dst_access;
+        //image barriers refer to resource, the image is picked at execute time
+        struct ImageTransition {
+            GraphResource resource;
+            vk::AccessFlags src_access;
+            vk::AccessFlags dst_access;
+            vk::ImageLayout old_layout;
+            vk::ImageLayout new_layout;
+        };
+        std::vector<ImageTransition> images;
+
+        bool is_empty() const {
+            return !src_stages && images.empty();
+        }
+    };
+
+    struct Pass {
+        std::string name;
+        GraphPassType type;
+        RecordFunction record;
+        std::vector<Access> accesses;
+        vk::SubpassContents contents = vk::SubpassContents::eInline;
+
+        bool alive = false;
+        Barrier barrier;
+        vk::RenderPass render_pass = nullptr;
+        std::vector<vk::Framebuffer> framebuffers;
+        std::vector<vk::ClearValue> clear_values;
+        vk::Extent2D extent;
+    };
+
+    //memory shared by transient images whose lifetimes don't overlap
+    struct Slot {
+        vk::MemoryRequirements requirements;
+        //in order of first use
+        std::vector<GraphResource> resources;
+        Allocation allocation;
+    };
+
+    Context& context;
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<Slot> slots;
+    //transitions of imported images to their final layout
+    Barrier final_barrier;
+    uint32_t image_count = 0;
+    GraphStats stats;
+
+    Access& get_access(uint32_t pass, GraphResource resource, GraphUsage usage);
+    void cull_passes();
+    void create_transient_images();
+    //steps state to the access and adds what that takes to barrier
+    void transition(State& state, GraphResource resource, const Access& access, Barrier& barrier) const;
+    //runs the alive passes from the given start states, adding barriers when emit is set
+    std::vector<State> simulate(std::vector<State> states, bool emit);
+    void build_barriers();
+    void build_render_pass(Pass& pass);
+    void record_barrier(vk::CommandBuffer command_buffer, const Barrier& barrier, uint32_t image) const;
+    vk::Image get_image(GraphResource resource, uint32_t image) const;
+};
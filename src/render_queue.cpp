@@ -0,0 +1,48 @@
+#include "render_queue.h"
+
+#include <cstring>
+#include <algorithm>
+
+uint64_t RenderQueue::make_key(DrawPass pass, uint32_t pipeline_id, uint32_t material_id, uint32_t mesh_id, float distance_squared) {
+    //positive floats order the same as their bit patterns. the top 12 bits are the exponent
+    //and 3 bits of mantissa, about 8 buckets per doubling of distance
+    uint32_t depth_bits;
+    distance_squared = std::max(distance_squared, 0.0f);
+    memcpy(&depth_bits, &distance_squared, sizeof(depth_bits));
+    uint64_t depth = depth_bits >> 20;
+    if (pass == DrawPass::Transparent) {
+        depth = 0xFFF - depth;
+    }
+
+    return (static_cast<uint64_t>(pass) & 0xF) << 60 |
+        (static_cast<uint64_t>(pipeline_id) & 0xFFF) << 48 |
+        (static_cast<uint64_t>(material_id) & 0xFFFFF) << 28 |
+        (static_cast<uint64_t>(mesh_id) & 0xFFFF) << 12 |
+        depth;
+}
+
+void RenderQueue::sort() {
+    //lsd radix sort, 8 bits per pass. passes where every key has the same byte are skipped,
+    //which is most of them with only a handful of pipelines and materials
+    scratch.resize(items.size());
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {};
+        for (const auto& item : items) {
+            counts[(item.key >> shift) & 0xFF]++;
+        }
+        if (items.empty() || counts[(items[0].key >> shift) & 0xFF] == items.size()) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (auto& count : counts) {
+            size_t c = count;
+            count = offset;
+            offset += c;
+        }
+        for (const auto& item : items) {
+            scratch[counts[(item.key >> shift) & 0xFF]++] = item;
+        }
+        items.swap(scratch);
+    }
+}
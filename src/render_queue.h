@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class DrawPass : uint8_t {
+    Opaque = 0,
+    Transparent = 1
+};
+
+struct DrawItem {
+    uint64_t key;
+    //index into the renderer's mesh_renderers
+    uint32_t index;
+};
+
+//draws for one frame, radix sorted by a packed key so that draws sharing a pipeline and
+//material end up next to each other, then draws of the same mesh (which get instanced),
+//and opaque draws within those go roughly front to back.
+//
+//key layout, most significant first:
+//  pass      4 bits
+//  pipeline 12 bits
+//  material 20 bits
+//  mesh     16 bits
+//  depth    12 bits  (distance to the camera, inverted for transparent draws)
+//
+//ids that don't fit only cost grouping, the renderer still compares the real mesh and material
+class RenderQueue {
+public:
+    static uint64_t make_key(DrawPass pass, uint32_t pipeline_id, uint32_t material_id, uint32_t mesh_id, float distance_squared);
+
+    void clear() {
+        items.clear();
+    }
+    void push(uint64_t key, uint32_t index) {
+        items.push_back({ key, index });
+    }
+    void sort();
+
+    const std::vector<DrawItem>& get_items() const {
+        return items;
+    }
+
+private:
+    std::vector<DrawItem> items;
+    std::vector<DrawItem> scratch;
+};
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <set>
+#include <algorithm>
 
 #include <chrono>
 
@@ -32,7 +33,8 @@ void Renderer::init_logical_device() {
 
     std::set<uint32_t> families = {
         context.queue_families.graphics.value(),
-        context.queue_families.presentation.value()
+        context.queue_families.presentation.value(),
+        context.queue_families.transfer.value()
     };
     
     std::vector<vk::DeviceQueueCreateInfo> queue_create_infos;
@@ -46,10 +48,31 @@ void Renderer::init_logical_device() {
         queue_create_infos.push_back(queue_create_info);
     }
 
+    auto supported = context.physical_device.getFeatures();
     vk::PhysicalDeviceFeatures features{};
     features.samplerAnisotropy = true;
+    //gpu driven drawing is used when the device can do it, see GpuCulling
+    features.multiDrawIndirect = supported.multiDrawIndirect;
+    features.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+    context.features.multi_draw_indirect = supported.multiDrawIndirect && supported.drawIndirectFirstInstance;
+    //fragment shader invocation counts, see print_stats
+    features.pipelineStatisticsQuery = supported.pipelineStatisticsQuery;
+    features.inheritedQueries = supported.inheritedQueries;
+    context.features.pipeline_statistics = supported.pipelineStatisticsQuery;
+    context.features.inherited_queries = supported.inheritedQueries;
+
+    bool vulkan_12 = context.physical_device.getProperties().apiVersion >= VK_API_VERSION_1_2;
+    vk::PhysicalDeviceVulkan12Features features_12{};
+    if (vulkan_12) {
+        auto supported_12 = context.physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        features_12.drawIndirectCount = supported_12.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount;
+    }
+    context.features.draw_indirect_count = features_12.drawIndirectCount;
 
     vk::DeviceCreateInfo create_info{};
+    if (vulkan_12) {
+        create_info.pNext = &features_12;
+    }
     create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     create_info.pEnabledFeatures = &features;
@@ -66,82 +89,11 @@ void Renderer::init_logical_device() {
     context.device = context.physical_device.createDevice(create_info, nullptr);
     context.device.getQueue(context.queue_families.graphics.value(), 0, &context.graphics_queue);
     context.device.getQueue(context.queue_families.presentation.value(), 0, &context.presentation_queue);
-}
+    context.device.getQueue(context.queue_families.transfer.value(), 0, &context.transfer_queue);
 
-void Renderer::init_render_pass() {
-    vk::AttachmentDescription color_attachment{};
-    color_attachment.format = swapchain.format;
-    color_attachment.samples = vk::SampleCountFlagBits::e1;
-    color_attachment.loadOp = vk::AttachmentLoadOp::eClear;
-    color_attachment.storeOp = vk::AttachmentStoreOp::eStore;
-    color_attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-    color_attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-    color_attachment.initialLayout = vk::ImageLayout::eUndefined;
-    color_attachment.finalLayout = vk::ImageLayout::ePresentSrcKHR;
-
-    vk::AttachmentReference color_attachment_ref{};
-    color_attachment_ref.attachment = 0;
-    color_attachment_ref.layout = vk::ImageLayout::eColorAttachmentOptimal;
-
-    vk::AttachmentDescription depth_attachment{};
-    depth_attachment.format = depth_texture->format;
-    depth_attachment.samples = vk::SampleCountFlagBits::e1;
-    depth_attachment.loadOp = vk::AttachmentLoadOp::eClear;
-    depth_attachment.storeOp = vk::AttachmentStoreOp::eDontCare;
-    depth_attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-    depth_attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-    depth_attachment.initialLayout = vk::ImageLayout::eUndefined;
-    depth_attachment.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-
-    vk::AttachmentReference depth_attachment_ref{};
-    depth_attachment_ref.attachment = 1;
-    depth_attachment_ref.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
-
-    vk::SubpassDescription subpass{};
-    subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &color_attachment_ref;
-    subpass.pDepthStencilAttachment = &depth_attachment_ref;;
-
-    vk::SubpassDependency dependency{};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-    dependency.srcAccessMask = {};
-    dependency.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests;
-    dependency.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-    std::array<vk::AttachmentDescription, 2> attachments{ color_attachment, depth_attachment };
-    vk::RenderPassCreateInfo renderpass_info{};
-    renderpass_info.attachmentCount = attachments.size();
-    renderpass_info.pAttachments = attachments.data();
-    renderpass_info.subpassCount = 1;
-    renderpass_info.pSubpasses = &subpass;
-    renderpass_info.dependencyCount = 1;
-    renderpass_info.pDependencies = &dependency;
-
-    renderpass = context.device.createRenderPass(renderpass_info, nullptr);
-}
-
-void Renderer::init_framebuffers() {
-    TRACE("initializing framebuffers")
-    framebuffers.resize(swapchain.image_views.size());
-    for(size_t i = 0; i < framebuffers.size(); i++) {
-        std::array<vk::ImageView, 2> attachments{
-            swapchain.image_views[i],
-            depth_texture->image_view
-        };
+    DEBUG("multi draw indirect " << context.features.multi_draw_indirect << ", draw indirect count " << context.features.draw_indirect_count)
 
-        vk::FramebufferCreateInfo create_info{};
-        create_info.attachmentCount = attachments.size();
-        create_info.pAttachments = attachments.data();
-        create_info.renderPass = renderpass;
-        create_info.width = swapchain.extent.width;
-        create_info.height = swapchain.extent.height;
-        create_info.layers = 1;
-
-        framebuffers[i] = context.device.createFramebuffer(create_info);
-    }
+    context.allocator.init(context.physical_device, context.device);
 }
 
 void Renderer::init_sync_objects() {
@@ -151,45 +103,283 @@ void Renderer::init_sync_objects() {
     }
 }
 
-void Renderer::init_depth()
-{
+void Renderer::init_render_graph() {
+    TRACE("initializing render graph")
+    //the gpu path samples depth to build the depth pyramid, deferred lighting to find positions
+    vk::FormatFeatureFlags depth_features = vk::FormatFeatureFlagBits::eDepthStencilAttachment;
+    if (gpu_driven || deferred) {
+        depth_features |= vk::FormatFeatureFlagBits::eSampledImage;
+    }
     auto depth_format = Texture::get_supported_format(
         context,
         {
             vk::Format::eD32Sfloat,
             vk::Format::eD32SfloatS8Uint,
-            vk::Format::eD24UnormS8Uint
+            vk::Format::eD24UnormS8Uint,
+            vk::Format::eD16Unorm
         },
         vk::ImageTiling::eOptimal,
-        vk::FormatFeatureFlagBits::eDepthStencilAttachment
+        depth_features
     );
 
-    depth_texture = std::make_unique<Texture>(context);
-    depth_texture->width = swapchain.extent.width;
-    depth_texture->height = swapchain.extent.height;
-    depth_texture->format = depth_format;
-    depth_texture->aspect = vk::ImageAspectFlagBits::eDepth;
-    depth_texture->tiling = vk::ImageTiling::eOptimal;
-    depth_texture->usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
-    depth_texture->memory_flags = vk::MemoryPropertyFlagBits::eDeviceLocal;
-    depth_texture->mip_levels = 1;
+    //the swapchain image can be written once the acquire semaphore has been waited on
+    auto backbuffer = render_graph.import_image("backbuffer", swapchain.format, swapchain.extent,
+        swapchain.images, swapchain.image_views,
+        vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::ImageLayout::ePresentSrcKHR);
+    auto depth = render_graph.create_image("depth", depth_format, swapchain.extent);
+
+    //one atlas shared by every swapchain image. it may be overwritten once the frames before
+    //are done sampling it
+    auto image_count = swapchain.images.size();
+    auto shadows = render_graph.import_image("shadow atlas", shadow_atlas.get_format(), shadow_atlas.get_extent(),
+        std::vector<vk::Image>(image_count, shadow_atlas.get_image()),
+        std::vector<vk::ImageView>(image_count, shadow_atlas.get_view()),
+        vk::PipelineStageFlagBits::eFragmentShader, vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    //the lights' cached static depth is copied in, then the dynamic casters drawn on top
+    shadow_cache_pass = render_graph.add_pass("shadow cache", GraphPassType::Compute, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+        CommandEncoder encoder(command_buffer);
+        shadow_atlas.record_cache(encoder, image, descriptor_sets[image], geometry_arena);
+        encoder_stats += encoder.get_stats();
+    });
+    render_graph.write(shadow_cache_pass, shadows, GraphUsage::Transfer);
+    shadow_pass = render_graph.add_pass("shadows", GraphPassType::Graphics, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+        CommandEncoder encoder(command_buffer);
+        shadow_atlas.record_dynamic(encoder, image, descriptor_sets[image], geometry_arena);
+        encoder_stats += encoder.get_stats();
+    });
+    render_graph.write(shadow_pass, shadows, GraphUsage::DepthAttachment);
+
+    const uint32_t early = 1u << GpuCulling::EARLY;
+    const uint32_t late = 1u << GpuCulling::LATE;
+
+    GraphResource draw_commands = 0;
+    GraphResource instance_indices = 0;
+    GraphResource visibility = 0;
+    GraphResource pyramid = 0;
+    auto pyramid_extent = DepthPyramid::get_extent(swapchain.extent);
+    auto pyramid_levels = DepthPyramid::get_mip_levels(pyramid_extent);
+    if (gpu_driven) {
+        draw_commands = render_graph.create_buffer("draw commands");
+        instance_indices = render_graph.create_buffer("instance indices");
+        visibility = render_graph.create_buffer("visibility");
+        pyramid = render_graph.create_image("depth pyramid", DepthPyramid::FORMAT, pyramid_extent, pyramid_levels);
+        cull_pass = render_graph.add_pass("cull", GraphPassType::Compute, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+            gpu_culling.record_cull(command_buffer, image, descriptor_sets[image], GpuCulling::EARLY);
+        });
+        render_graph.read(cull_pass, visibility, GraphUsage::ComputeStorage);
+        render_graph.write(cull_pass, draw_commands, GraphUsage::ComputeStorage);
+        render_graph.write(cull_pass, instance_indices, GraphUsage::ComputeStorage);
+    }
+
+    auto read_draws = [&](uint32_t pass) {
+        if (gpu_driven) {
+            render_graph.read(pass, draw_commands, GraphUsage::Indirect);
+            render_graph.read(pass, instance_indices, GraphUsage::VertexStorage);
+        }
+    };
+
+    //whatever the early phase hid behind is reduced to the pyramid, which the late phase
+    //tests everything against
+    auto add_late_cull = [&]() {
+        pyramid_pass = render_graph.add_pass("depth pyramid", GraphPassType::Compute, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+            depth_pyramid.record(command_buffer);
+        });
+        render_graph.read(pyramid_pass, depth, GraphUsage::ComputeSampled);
+        render_graph.write(pyramid_pass, pyramid, GraphUsage::ComputeStorage);
+
+        cull_late_pass = render_graph.add_pass("cull late", GraphPassType::Compute, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+            gpu_culling.record_cull(command_buffer, image, descriptor_sets[image], GpuCulling::LATE);
+        });
+        render_graph.read(cull_late_pass, pyramid, GraphUsage::ComputeSampled);
+        render_graph.write(cull_late_pass, visibility, GraphUsage::ComputeStorage);
+        render_graph.write(cull_late_pass, draw_commands, GraphUsage::ComputeStorage);
+        render_graph.write(cull_late_pass, instance_indices, GraphUsage::ComputeStorage);
+    };
+
+    //with the prepass the forward pass only tests against depth and draws both phases at
+    //once. both ways its render pass has the same attachments, so the material pipelines
+    //work with either
+    if (depth_prepass) {
+        prepass_pass = render_graph.add_pass("depth prepass", GraphPassType::Graphics, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+            record_depth_prepass(command_buffer, image, early);
+        });
+        render_graph.write(prepass_pass, depth, GraphUsage::DepthAttachment);
+        render_graph.clear(prepass_pass, depth, vk::ClearDepthStencilValue{ 1.0f, 0 });
+        read_draws(prepass_pass);
+
+        if (gpu_driven) {
+            add_late_cull();
+            prepass_late_pass = render_graph.add_pass("depth prepass late", GraphPassType::Graphics, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+                record_depth_prepass(command_buffer, image, late);
+            });
+            render_graph.write(prepass_late_pass, depth, GraphUsage::DepthAttachment);
+            read_draws(prepass_late_pass);
+        }
+    }
+
+    vk::ClearColorValue clear_color{ std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f} };
+    GraphResource albedo = 0;
+    GraphResource normal = 0;
+    GraphResource material = 0;
+    if (deferred) {
+        albedo = render_graph.create_image("albedo", DeferredLighting::ALBEDO_FORMAT, swapchain.extent);
+        normal = render_graph.create_image("normal", DeferredLighting::NORMAL_FORMAT, swapchain.extent);
+        material = render_graph.create_image("material", DeferredLighting::MATERIAL_FORMAT, swapchain.extent);
+
+        //takes the forward pass's place for the materials that have a g-buffer shader. the
+        //g-buffer is cleared to zero: with the prepass, forward only materials leave depth
+        //behind where this pass writes nothing, and the lighting pass skips pixels whose
+        //albedo alpha is still zero instead of shading whatever the memory held
+        uint32_t gbuffer_phases = depth_prepass ? early | late : early;
+        gbuffer_pass = render_graph.add_pass("gbuffer", GraphPassType::Graphics, [this, gbuffer_phases](vk::CommandBuffer command_buffer, uint32_t image) {
+            record_forward_pass(command_buffer, image, gbuffer_phases, true);
+        });
+        render_graph.write(gbuffer_pass, albedo, GraphUsage::ColorAttachment);
+        render_graph.write(gbuffer_pass, normal, GraphUsage::ColorAttachment);
+        render_graph.write(gbuffer_pass, material, GraphUsage::ColorAttachment);
+        vk::ClearColorValue clear_gbuffer{ std::array<float, 4>{0.0f, 0.0f, 0.0f, 0.0f} };
+        render_graph.clear(gbuffer_pass, albedo, clear_gbuffer);
+        render_graph.clear(gbuffer_pass, normal, clear_gbuffer);
+        render_graph.clear(gbuffer_pass, material, clear_gbuffer);
+        if (depth_prepass) {
+            render_graph.read(gbuffer_pass, depth, GraphUsage::DepthAttachment);
+        }
+        else {
+            render_graph.write(gbuffer_pass, depth, GraphUsage::DepthAttachment);
+            render_graph.clear(gbuffer_pass, depth, vk::ClearDepthStencilValue{ 1.0f, 0 });
+        }
+        read_draws(gbuffer_pass);
+
+        if (gpu_driven && !depth_prepass) {
+            add_late_cull();
+            gbuffer_late_pass = render_graph.add_pass("gbuffer late", GraphPassType::Graphics, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+                record_forward_pass(command_buffer, image, late, true);
+            });
+            render_graph.write(gbuffer_late_pass, albedo, GraphUsage::ColorAttachment);
+            render_graph.write(gbuffer_late_pass, normal, GraphUsage::ColorAttachment);
+            render_graph.write(gbuffer_late_pass, material, GraphUsage::ColorAttachment);
+            render_graph.write(gbuffer_late_pass, depth, GraphUsage::DepthAttachment);
+            read_draws(gbuffer_late_pass);
+        }
+
+        lighting_pass = render_graph.add_pass("deferred lighting", GraphPassType::Graphics, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+            deferred_lighting.record(command_buffer, descriptor_sets[image]);
+        });
+        render_graph.read(lighting_pass, albedo, GraphUsage::Sampled);
+        render_graph.read(lighting_pass, normal, GraphUsage::Sampled);
+        render_graph.read(lighting_pass, material, GraphUsage::Sampled);
+        render_graph.read(lighting_pass, depth, GraphUsage::Sampled);
+        render_graph.read(lighting_pass, shadows, GraphUsage::Sampled);
+        render_graph.write(lighting_pass, backbuffer, GraphUsage::ColorAttachment);
+        render_graph.clear(lighting_pass, backbuffer, clear_color);
+    }
+
+    //in deferred mode only the materials without a g-buffer shader are left, drawn on top of
+    //the lit image after all culling is done
+    uint32_t forward_phases = depth_prepass || deferred ? early | late : early;
+    forward_pass = render_graph.add_pass("forward", GraphPassType::Graphics, [this, forward_phases](vk::CommandBuffer command_buffer, uint32_t image) {
+        record_forward_pass(command_buffer, image, forward_phases, false);
+    });
+    render_graph.write(forward_pass, backbuffer, GraphUsage::ColorAttachment);
+    render_graph.read(forward_pass, shadows, GraphUsage::Sampled);
+    if (!deferred) {
+        render_graph.clear(forward_pass, backbuffer, clear_color);
+    }
+    if (depth_prepass) {
+        render_graph.read(forward_pass, depth, GraphUsage::DepthAttachment);
+    }
+    else {
+        render_graph.write(forward_pass, depth, GraphUsage::DepthAttachment);
+        if (!deferred) {
+            render_graph.clear(forward_pass, depth, vk::ClearDepthStencilValue{ 1.0f, 0 });
+        }
+    }
+    read_draws(forward_pass);
+
+    if (gpu_driven && !depth_prepass && !deferred) {
+        add_late_cull();
+        forward_late_pass = render_graph.add_pass("forward late", GraphPassType::Graphics, [this](vk::CommandBuffer command_buffer, uint32_t image) {
+            record_forward_pass(command_buffer, image, late, false);
+        });
+        render_graph.write(forward_late_pass, backbuffer, GraphUsage::ColorAttachment);
+        render_graph.read(forward_late_pass, shadows, GraphUsage::Sampled);
+        render_graph.write(forward_late_pass, depth, GraphUsage::DepthAttachment);
+        read_draws(forward_late_pass);
+    }
+
+    render_graph.compile(static_cast<uint32_t>(swapchain.images.size()));
+    graph_depth_prepass = depth_prepass;
+    graph_deferred = deferred;
+
+    if (gpu_driven) {
+        std::vector<vk::ImageView> mip_views;
+        for (uint32_t level = 0; level < pyramid_levels; level++) {
+            mip_views.push_back(render_graph.get_mip_view(pyramid, level));
+        }
+        depth_pyramid.init_views(render_graph.get_image_view(depth, 0), swapchain.extent, mip_views, pyramid_extent);
+        gpu_culling.set_depth_pyramid(render_graph.get_image_view(pyramid, 0), depth_pyramid.get_sampler(), pyramid_extent, pyramid_levels);
+    }
+
+    if (depth_prepass) {
+        PipelineOptions options;
+        options.depth_only = true;
+        depth_pipeline.init(swapchain.extent, render_graph.get_render_pass(prepass_pass), { descriptor_set_layout }, options);
+    }
 
-    depth_texture->init();
-    //depth_texture->transition_layout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    if (deferred) {
+        for (auto& material_type : material_manager.material_types) {
+            if (material_type.second.has_gbuffer()) {
+                material_type.second.init_gbuffer_pipeline(swapchain.extent, render_graph.get_render_pass(gbuffer_pass), descriptor_set_layout, depth_prepass);
+            }
+        }
+        deferred_lighting.init_pass(swapchain.extent, render_graph.get_render_pass(lighting_pass), descriptor_set_layout,
+            { render_graph.get_image_view(albedo, 0), render_graph.get_image_view(normal, 0),
+              render_graph.get_image_view(material, 0), render_graph.get_image_view(depth, 0) });
+    }
 }
 
-void Renderer::init_materials() {
-    material_manager.init();
+void Renderer::close_render_graph() {
+    if (gpu_driven) {
+        depth_pyramid.close_views();
+    }
+    if (graph_deferred) {
+        deferred_lighting.close_pass();
+        for (auto& material_type : material_manager.material_types) {
+            material_type.second.close_gbuffer_pipeline();
+        }
+    }
+    render_graph.close();
+    if (depth_pipeline.pipeline != vk::Pipeline(nullptr)) {
+        depth_pipeline.close();
+    }
+}
+
+void Renderer::init_statistics_queries() {
+    if (!context.features.pipeline_statistics) {
+        return;
+    }
+
+    vk::QueryPoolCreateInfo create_info({},
+        vk::QueryType::ePipelineStatistics,
+        static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
+        vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations);
+    statistics_pool = context.device.createQueryPool(create_info);
+    statistics_pending.assign(MAX_FRAMES_IN_FLIGHT, false);
+}
 
+void Renderer::init_materials() {
+    //the types and their layouts already exist, init_render_graph may have needed them
     for (auto& material_type : material_manager.material_types) {
-        material_type.second.init(swapchain.extent, renderpass, descriptor_set_layout);
+        material_type.second.rebuild_pipeline(swapchain.extent, render_graph.get_render_pass(forward_pass), descriptor_set_layout);
     }
 }
 
 void Renderer::init_descriptor_pool() {
     uint32_t max_descriptors = static_cast<uint32_t> (swapchain.images.size() * 30);
-    std::array<vk::DescriptorPoolSize, 2> pool_sizes{
+    std::array<vk::DescriptorPoolSize, 3> pool_sizes{
         vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, max_descriptors),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, max_descriptors),
 vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, max_descriptors)
     };
     vk::DescriptorPoolCreateInfo create_info({},
@@ -206,7 +396,46 @@ void Renderer::init_descriptor_set_layout() {
         1,
         vk::ShaderStageFlagBits::eAll,
         nullptr);
-    std::array<vk::DescriptorSetLayoutBinding, 1> bindings{ ubo_layout };
+    vk::DescriptorSetLayoutBinding object_layout(1,
+        vk::DescriptorType::eStorageBuffer,
+        1,
+        vk::ShaderStageFlagBits::eAll,
+        nullptr);
+    //read by the vertex shaders, written by the culling pass when gpu driven
+    vk::DescriptorSetLayoutBinding instance_layout(2,
+        vk::DescriptorType::eStorageBuffer,
+        1,
+        vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute,
+        nullptr);
+    //clustered lights, see LightClusters
+    vk::DescriptorSetLayoutBinding light_layout(3,
+        vk::DescriptorType::eStorageBuffer,
+        1,
+        vk::ShaderStageFlagBits::eFragment,
+        nullptr);
+    vk::DescriptorSetLayoutBinding cluster_layout(4,
+        vk::DescriptorType::eStorageBuffer,
+        1,
+        vk::ShaderStageFlagBits::eFragment,
+        nullptr);
+    vk::DescriptorSetLayoutBinding light_index_layout(5,
+        vk::DescriptorType::eStorageBuffer,
+        1,
+        vk::ShaderStageFlagBits::eFragment,
+        nullptr);
+    //point light shadows, see ShadowAtlas
+    vk::DescriptorSetLayoutBinding shadow_layout(6,
+        vk::DescriptorType::eStorageBuffer,
+        1,
+        vk::ShaderStageFlagBits::eFragment,
+        nullptr);
+    vk::DescriptorSetLayoutBinding shadow_atlas_layout(7,
+        vk::DescriptorType::eCombinedImageSampler,
+        1,
+        vk::ShaderStageFlagBits::eFragment,
+        nullptr);
+    std::array<vk::DescriptorSetLayoutBinding, 8> bindings{ ubo_layout, object_layout, instance_layout,
+        light_layout, cluster_layout, light_index_layout, shadow_layout, shadow_atlas_layout };
     vk::DescriptorSetLayoutCreateInfo create_info({}, static_cast<uint32_t>(bindings.size()), bindings.data());
     descriptor_set_layout = context.device.createDescriptorSetLayout(create_info);
 }
@@ -222,9 +451,12 @@ void Renderer::init_descriptor_sets() {
     descriptor_sets = context.device.allocateDescriptorSets(allocate_info);
 
     for (size_t i = 0; i < layouts.size(); i++) {
-        vk::DescriptorBufferInfo buffer_info(uniform_buffers[i].buffer, 0, sizeof(UniformBufferObject));
+        //the globals are always the first allocation of a frame, see update_uniform_buffers
+        vk::DescriptorBufferInfo buffer_info(frame_allocator.get_buffer(), frame_allocator.frame_offset(i), sizeof(UniformBufferObject));
+        //the atlas lives as long as the renderer
+        auto atlas_info = shadow_atlas.image_info();
 
-        std::array<vk::WriteDescriptorSet, 1> writes{
+        std::array<vk::WriteDescriptorSet, 2> writes{
                 vk::WriteDescriptorSet(descriptor_sets[i],
                                      0,
                                      0,
@@ -232,113 +464,527 @@ void Renderer::init_descriptor_sets() {
                                      vk::DescriptorType::eUniformBuffer,
                                      nullptr,
                                      &buffer_info,
+                                     nullptr),
+                vk::WriteDescriptorSet(descriptor_sets[i],
+                                     7,
+                                     0,
+                                     1,
+                                     vk::DescriptorType::eCombinedImageSampler,
+                                     &atlas_info,
+                                     nullptr,
                                      nullptr)
         };
 
 
         context.device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        write_storage_descriptors(static_cast<uint32_t>(i));
     }
 }
 
-void Renderer::init_uniform_buffers() {
-    vk::DeviceSize size = sizeof(UniformBufferObject);
-    for (size_t i = 0; i < swapchain.images.size(); i++)
-    {
-        uniform_buffers.push_back(Buffer(context));
-        uniform_buffers[i].init(size,
-            vk::BufferUsageFlagBits::eUniformBuffer,
-            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+void Renderer::write_storage_descriptors(uint32_t image_index) {
+    auto object_info = object_buffer.descriptor_info(image_index);
+    auto instance_info = instance_buffer.descriptor_info(image_index);
+    auto light_infos = light_clusters.descriptor_infos(image_index);
+    auto shadow_info = shadow_atlas.descriptor_info(image_index);
+    std::array<vk::WriteDescriptorSet, 4> writes{
+        vk::WriteDescriptorSet(descriptor_sets[image_index],
+            1,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            &object_info,
+            nullptr),
+        vk::WriteDescriptorSet(descriptor_sets[image_index],
+            2,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            &instance_info,
+            nullptr),
+        //lights, clusters and light indices are consecutive bindings
+        vk::WriteDescriptorSet(descriptor_sets[image_index],
+            3,
+            0,
+            static_cast<uint32_t>(light_infos.size()),
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            light_infos.data(),
+            nullptr),
+        vk::WriteDescriptorSet(descriptor_sets[image_index],
+            6,
+            0,
+            1,
+            vk::DescriptorType::eStorageBuffer,
+            nullptr,
+            &shadow_info,
+            nullptr)
+    };
+    context.device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void Renderer::init_culling_buffers() {
+    if (gpu_driven) {
+        gpu_culling.init_buffers(static_cast<uint32_t>(swapchain.images.size()), static_cast<uint32_t>(mesh_renderers.size()), descriptor_pool);
     }
+
+    //the new buffers have no entries yet
+    culling_versions.assign(swapchain.images.size(), ~0ull);
+    culling_batch_materials.assign(swapchain.images.size(), {});
 }
 
-void Renderer::update_uniform_buffers(uint32_t current_image, const std::vector<std::unique_ptr<Object>>& objects, Camera& camera) {
-    UniformBufferObject ubo{};
-    for (size_t i = 0; i < objects.size(); i++) {
-        ubo.M[i] = objects[i]->transform.matrix();
+void Renderer::init_frame_allocator() {
+    //one segment per swapchain image, the image fence protects it from being overwritten while in use
+    frame_allocator.init(static_cast<uint32_t>(swapchain.images.size()), FRAME_ALLOCATOR_SIZE);
+}
+
+void Renderer::init_object_buffers() {
+    //one dirty bit per image in object_dirty_images
+    if (swapchain.images.size() > 32) {
+        throw std::runtime_error("too many swapchain images for object change tracking");
     }
-    ubo.V = camera.view();
-    ubo.P = camera.projection();
-    ubo.camera_position = camera.transform.position;
 
-    light_manager.assign_lightdata(ubo);
+    //rebuilt with the swapchain, so start out big enough for what is already registered
+    object_buffer.init(static_cast<uint32_t>(swapchain.images.size()), static_cast<uint32_t>(mesh_renderers.size()));
+    auto instance_count = static_cast<uint32_t>(mesh_renderers.size()) * (gpu_driven ? GpuCulling::PHASE_COUNT : 1);
+    instance_buffer.init(static_cast<uint32_t>(swapchain.images.size()), instance_count);
+    light_clusters.init(static_cast<uint32_t>(swapchain.images.size()));
+    shadow_atlas.init_buffers(static_cast<uint32_t>(swapchain.images.size()));
+
+    //the new buffers start out empty
+    std::vector<uint32_t> all_objects(mesh_renderers.size());
+    for (uint32_t i = 0; i < all_objects.size(); i++) {
+        all_objects[i] = i;
+    }
+    pending_objects.clear();
+    std::fill(object_dirty_images.begin(), object_dirty_images.end(), 0);
+    mark_objects_dirty(all_objects);
+}
 
-    uniform_buffers[current_image].store(&ubo);
+void Renderer::mark_objects_dirty(const std::vector<uint32_t>& object_indices) {
+    uint32_t all_images = static_cast<uint32_t>((uint64_t(1) << swapchain.images.size()) - 1);
+    for (auto index : object_indices) {
+        if (object_dirty_images[index] == 0) {
+            pending_objects.push_back(index);
+        }
+        object_dirty_images[index] = all_images;
+    }
 }
 
+void Renderer::update_uniform_buffers(uint32_t current_image, Camera& camera) {
+    frame_allocator.begin_frame(current_image);
 
-void Renderer::build_command_buffer(uint32_t image_index)
+    //a changed transform has to reach every image's copy of the object buffer,
+    //each image catches up on whatever changed since it was last drawn
+    for (auto index : changed_objects) {
+        mesh_renderers[index]->transform->clear_queued();
+    }
+    mark_objects_dirty(changed_objects);
+    changed_objects.clear();
+
+    //render() has already made room for every mesh renderer
+    auto objects = object_buffer.data<ObjectData>(current_image);
+    uint32_t image_bit = 1u << current_image;
+    size_t still_pending = 0;
+    for (auto index : pending_objects) {
+        auto& dirty_images = object_dirty_images[index];
+        if (dirty_images & image_bit) {
+            objects[index].M = mesh_renderers[index]->transform->matrix();
+            dirty_images &= ~image_bit;
+        }
+        if (dirty_images != 0) {
+            pending_objects[still_pending++] = index;
+        }
+    }
+    pending_objects.resize(still_pending);
+
+    //written straight into the mapped frame segment, no staging copy of the ubo
+    auto globals = frame_allocator.allocate_uniform(sizeof(UniformBufferObject));
+    auto ubo = globals.as<UniformBufferObject>();
+    //the segment is only written, never read back
+    auto V = camera.view();
+    auto P = camera.projection();
+    ubo->V = V;
+    ubo->P = P;
+    ubo->camera_position = camera.transform.get_position();
+    ubo->inverse_VP = glm::inverse(P * V);
+
+    //render() has already assigned the lights to this image's clusters
+    light_clusters.fill_globals(*ubo);
+}
+
+
+void Renderer::record_frame(FrameCommands& frame, uint32_t image_index)
 {
     vk::CommandBufferBeginInfo begin_info{};
-    begin_info.flags = {};
+    begin_info.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
     begin_info.pInheritanceInfo = nullptr;
 
-    auto& command_buffer = command_buffers.commands[image_index];
+    auto command_buffer = frame.commands;
 
     command_buffer.begin(begin_info);
 
-    vk::RenderPassBeginInfo renderpass_begin_info{};
-    renderpass_begin_info.framebuffer = framebuffers[image_index];
-    renderpass_begin_info.renderPass = renderpass;
-    renderpass_begin_info.renderArea.offset = vk::Offset2D{ 0,0 };
-    renderpass_begin_info.renderArea.extent = swapchain.extent;
-    std::array<vk::ClearValue, 2> clear_colors{
-        vk::ClearColorValue{ std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f} },
-        vk::ClearDepthStencilValue{ 1.0f, 0 }
-    };
-    renderpass_begin_info.clearValueCount = clear_colors.size();
-    renderpass_begin_info.pClearValues = clear_colors.data();
+    //on the gpu path the culling pass writes the draws instead
+    frame_draws.clear();
+    gbuffer_draws.clear();
+    if (!gpu_driven) {
+        frame_draws = build_instanced_draws(image_index);
+    }
+    //in deferred mode the g-buffer pass takes what it can draw, in queue order
+    if (graph_deferred) {
+        size_t forward_count = 0;
+        for (const auto& draw : frame_draws) {
+            if (draw.mesh_renderer->material->material_type.has_gbuffer()) {
+                gbuffer_draws.push_back(draw);
+            }
+            else {
+                frame_draws[forward_count++] = draw;
+            }
+        }
+        frame_draws.resize(forward_count);
+    }
+    bool parallel_forward = frame_draws.size() >= PARALLEL_RECORD_THRESHOLD;
+    bool parallel_gbuffer = gbuffer_draws.size() >= PARALLEL_RECORD_THRESHOLD;
+    bool parallel = parallel_forward || parallel_gbuffer;
+
+    //the query has to stay active across the secondary command buffers, which not every
+    //device can do
+    bool query = statistics_pool != vk::QueryPool(nullptr) && (!parallel || context.features.inherited_queries);
+    auto query_index = static_cast<uint32_t>(current_frame);
+    if (query) {
+        command_buffer.resetQueryPool(statistics_pool, query_index, 1);
+        command_buffer.beginQuery(statistics_pool, query_index, {});
+    }
 
-    command_buffer.beginRenderPass(renderpass_begin_info, vk::SubpassContents::eInline);
+    encoder_stats = EncoderStats{};
+    recording_frame = &frame;
+    render_graph.set_contents(forward_pass, parallel_forward ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
+    if (graph_deferred) {
+        render_graph.set_contents(gbuffer_pass, parallel_gbuffer ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
+    }
+    render_graph.execute(command_buffer, image_index);
+    recording_frame = nullptr;
 
-    glm::uint32_t object_index = 0;
-    for (auto mesh_renderer : mesh_renderers) {
+    if (query) {
+        command_buffer.endQuery(statistics_pool, query_index);
+    }
+    if (statistics_pool != vk::QueryPool(nullptr)) {
+        statistics_pending[query_index] = query;
+    }
+
+    command_buffer.end();
+}
 
+void Renderer::record_depth_prepass(vk::CommandBuffer command_buffer, uint32_t image_index, uint32_t phases) {
+    //one pipeline for everything, so the prepass is recorded inline even for long draw lists
+    CommandEncoder encoder(command_buffer);
+    geometry_arena.bind(encoder);
+    encoder.bind_pipeline(depth_pipeline);
+    encoder.bind_descriptor_set(depth_pipeline, 0, descriptor_sets[image_index]);
+
+    if (gpu_driven) {
+        auto batch_count = static_cast<uint32_t>(culling_batch_materials[image_index].size());
+        for (uint32_t phase = 0; phase < GpuCulling::PHASE_COUNT; phase++) {
+            if ((phases & (1u << phase)) == 0) {
+                continue;
+            }
+            for (uint32_t batch = 0; batch < batch_count; batch++) {
+                gpu_culling.draw_batch(encoder, image_index, batch, phase);
+            }
+        }
+    }
+    else {
+        //the prepass covers the g-buffer's draws too
+        for (const auto* draws : { &gbuffer_draws, &frame_draws }) {
+            for (const auto& draw : *draws) {
+                draw.mesh_renderer->command_buffer(encoder, draw.first_instance, draw.instance_count);
+            }
+        }
+    }
+    encoder_stats += encoder.get_stats();
+}
+
+void Renderer::record_forward_pass(vk::CommandBuffer command_buffer, uint32_t image_index, uint32_t phases, bool gbuffer) {
+    const auto& draws = gbuffer ? gbuffer_draws : frame_draws;
+    if (draws.size() >= PARALLEL_RECORD_THRESHOLD) {
+        record_draws_parallel(*recording_frame, image_index, draws, gbuffer);
+        return;
+    }
+
+    CommandEncoder encoder(command_buffer);
+
+    //every mesh lives in the arena, so the geometry is bound once for the whole pass
+    geometry_arena.bind(encoder);
+
+    if (gpu_driven) {
+        //both phases of a batch go out under one material bind
+        const auto& batch_materials = culling_batch_materials[image_index];
+        for (uint32_t batch = 0; batch < batch_materials.size(); batch++) {
+            //in deferred mode a batch goes to the g-buffer pass or the forward pass
+            if (graph_deferred && batch_materials[batch]->material_type.has_gbuffer() != gbuffer) {
+                continue;
+            }
+            bind_material(encoder, image_index, *batch_materials[batch], gbuffer);
+            for (uint32_t phase = 0; phase < GpuCulling::PHASE_COUNT; phase++) {
+                if (phases & (1u << phase)) {
+                    gpu_culling.draw_batch(encoder, image_index, batch, phase);
+                }
+            }
+        }
+    }
+    else {
+        record_draws(encoder, image_index, draws, 0, draws.size(), gbuffer);
+    }
+    encoder_stats += encoder.get_stats();
+}
+
+bool Renderer::prepare_draw(MeshRenderer* mesh_renderer) {
+    auto material = mesh_renderer->material;
+
+    //build material descriptor sets if they weren't already
+    //TODO: initialize explicitly somehwere?
+    if (material->get_descriptor_set() == vk::DescriptorSet(nullptr)) {
+        material->init_descriptor_set(descriptor_pool, asset_manager);
+    }
+
+    if (material->get_descriptor_set() == vk::DescriptorSet(nullptr)) {
+        throw std::runtime_error("null descriptor set on " + material->material_type.name);
+    }
+
+    //draws whose uploads haven't reached the graphics queue yet are left out,
+    //they are picked up again once they have
+    auto ticket = std::max(mesh_renderer->get_upload_ticket(), material->get_upload_ticket());
+    if (!upload_queue.is_ready(ticket)) {
+        pending_upload_ticket = std::max(pending_upload_ticket, ticket);
+        return false;
+    }
+    return true;
+}
+
+void Renderer::bind_material(CommandEncoder& encoder, uint32_t image_index, Material& material, bool gbuffer) {
+    const auto& pipeline = material.get_pipeline(graph_depth_prepass, gbuffer);
+    encoder.bind_pipeline(pipeline);
+    encoder.bind_descriptor_set(pipeline, 0, descriptor_sets[image_index]);
+    encoder.bind_descriptor_set(pipeline, 1, material.get_descriptor_set());
+}
+
+std::vector<InstancedDraw> Renderer::build_instanced_draws(uint32_t image_index) {
+    std::vector<InstancedDraw> draws;
+
+    //nothing else reads this image's instance buffer while we record it, render() has
+    //waited on the image's last frame
+    auto instances = instance_buffer.data<uint32_t>(image_index);
+    uint32_t instance_count = 0;
+
+    const auto& items = render_queue.get_items();
+    for (size_t i = 0; i < items.size();) {
+        auto mesh_renderer = mesh_renderers[items[i].index];
         auto material = mesh_renderer->material;
-        const auto& pipeline = material->get_pipeline();
+        if (!prepare_draw(mesh_renderer)) {
+            i++;
+            continue;
+        }
 
-        //build material descriptor sets if they weren't already
-        //TODO: initialize explicitly somehwere?
-        if (material->get_descriptor_set() == vk::DescriptorSet(nullptr)) {
-            material->init_descriptor_set(descriptor_pool, asset_manager);
+        //the queue keeps the same mesh and material together, each run becomes one
+        //instanced draw. they share uploads, so the whole run is ready
+        uint32_t first_instance = instance_count;
+        size_t next = i;
+        while (next < items.size()) {
+            auto other = mesh_renderers[items[next].index];
+            if (other->material != material || other->geometry != mesh_renderer->geometry) {
+                break;
+            }
+            instances[instance_count++] = other->object_index;
+            next++;
         }
 
-        if (material->get_descriptor_set() == vk::DescriptorSet(nullptr)) {
-            throw std::runtime_error("null descriptor set on " + material->material_type.name);
+        draws.push_back(InstancedDraw{ mesh_renderer, first_instance, instance_count - first_instance });
+        i = next;
+    }
+
+    return draws;
+}
+
+void Renderer::record_draws(CommandEncoder& encoder, uint32_t image_index, const std::vector<InstancedDraw>& draws, size_t first, size_t last, bool gbuffer) {
+    for (size_t i = first; i < last; i++) {
+        const auto& draw = draws[i];
+        bind_material(encoder, image_index, *draw.mesh_renderer->material, gbuffer);
+        draw.mesh_renderer->command_buffer(encoder, draw.first_instance, draw.instance_count);
+    }
+}
+
+void Renderer::record_draws_parallel(FrameCommands& frame, uint32_t image_index, const std::vector<InstancedDraw>& draws, bool gbuffer) {
+    auto& worker_pools = frame.worker_pools[gbuffer ? FrameCommands::GBUFFER : FrameCommands::FORWARD];
+    auto& worker_commands = frame.worker_commands[gbuffer ? FrameCommands::GBUFFER : FrameCommands::FORWARD];
+    size_t max_jobs = worker_commands.size();
+    uint32_t job_count = static_cast<uint32_t>(std::min(max_jobs, (draws.size() + MIN_DRAWS_PER_JOB - 1) / MIN_DRAWS_PER_JOB));
+    size_t slice = (draws.size() + job_count - 1) / job_count;
+
+    std::vector<EncoderStats> job_stats(job_count);
+    uint32_t pass = gbuffer ? gbuffer_pass : forward_pass;
+    vk::CommandBufferInheritanceInfo inheritance_info(render_graph.get_render_pass(pass), 0, render_graph.get_framebuffer(pass, image_index));
+    //record_frame only keeps the statistics query running across them when this is allowed
+    if (statistics_pool != vk::QueryPool(nullptr) && context.features.inherited_queries) {
+        inheritance_info.pipelineStatistics = vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+    }
+
+    //contiguous slices keep the queue order, and with it the state sorting
+    workers.parallel_for(job_count, [&](uint32_t job) {
+        //render() has waited on this frame's fence, so the job's pool is free to reset
+        context.device.resetCommandPool(worker_pools[job], {});
+        auto secondary = worker_commands[job];
+
+        vk::CommandBufferBeginInfo begin_info(vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit, &inheritance_info);
+        secondary.begin(begin_info);
+
+        //secondaries start with no state bound
+        CommandEncoder encoder(secondary);
+        geometry_arena.bind(encoder);
+        record_draws(encoder, image_index, draws, job * slice, std::min(draws.size(), (job + 1) * slice), gbuffer);
+
+        secondary.end();
+        job_stats[job] = encoder.get_stats();
+    });
+
+    frame.commands.executeCommands(job_count, worker_commands.data());
+
+    for (const auto& stats : job_stats) {
+        encoder_stats += stats;
+    }
+}
+
+void Renderer::build_culling_batches(uint32_t image_index) {
+    auto& batch_materials = culling_batch_materials[image_index];
+    batch_materials.clear();
+    gpu_culling.begin(image_index);
+
+    //the queue is sorted by pipeline and material, so each material is one batch
+    for (const auto& item : render_queue.get_items()) {
+        auto mesh_renderer = mesh_renderers[item.index];
+        if (!pvs_visible[item.index] || !prepare_draw(mesh_renderer)) {
+            continue;
         }
 
-        std::array<vk::DescriptorSet, 2> descriptors{ descriptor_sets[image_index], material->get_descriptor_set() };
-        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.pipeline);
-        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.layout, 0, descriptors.size(), descriptors.data(), 0, nullptr);
+        if (batch_materials.empty() || batch_materials.back() != mesh_renderer->material) {
+            gpu_culling.begin_batch();
+            batch_materials.push_back(mesh_renderer->material);
+        }
+        gpu_culling.push(mesh_renderer->object_index, geometry_arena.get_range(mesh_renderer->geometry));
+    }
+}
 
-        PushConstants push_constants{ object_index };
-        object_index++;
-        command_buffer.pushConstants(pipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstants), &push_constants);
-        mesh_renderer->command_buffer(command_buffer);
+void Renderer::update_visibility(Camera& camera) {
+    //same changes update_uniform_buffers writes to the object buffer, it drains the list
+    for (auto index : changed_objects) {
+        auto mesh_renderer = mesh_renderers[index];
+        frustum_culler.set_bounds(index, mesh_renderer->mesh->bounds, mesh_renderer->transform->matrix());
     }
 
-    command_buffer.endRenderPass();
-    command_buffer.end();
+    frustum_culler.cull(camera.frustum(), visible_objects);
+
+    //occluders hidden by the frustum can't hide anything either
+    if (software_occlusion) {
+        occlusion_culler.begin(camera.projection() * camera.view());
+        for (auto index : visible_objects) {
+            auto mesh_renderer = mesh_renderers[index];
+            if (mesh_renderer->occluder && !mesh_renderer->mesh->vertices.empty()) {
+                const auto& mesh = *mesh_renderer->mesh;
+                occlusion_culler.add_occluder(mesh_renderer->transform->matrix(), &mesh.vertices[0].pos, sizeof(Vertex),
+                    static_cast<uint32_t>(mesh.vertices.size()), mesh.indices.data(), static_cast<uint32_t>(mesh.indices.size()));
+            }
+        }
+        occlusion_culler.rasterize(workers);
+        occlusion_culler.cull(workers, frustum_culler, visible_objects);
+    }
 }
 
-void Renderer::init_command_buffers() {
-    TRACE("initializing command buffers")
+void Renderer::build_render_queue(Camera& camera) {
+    render_queue.clear();
 
-    vk::CommandBufferAllocateInfo allocate_info{};
-    allocate_info.commandPool = context.command_pool;
-    allocate_info.level = vk::CommandBufferLevel::ePrimary;
-    allocate_info.commandBufferCount = (uint32_t)framebuffers.size();
+    //gpu driven, every object goes in and the culling pass decides what is drawn. draws
+    //within a batch are issued in object order there, so only the grouping matters
+    if (gpu_driven) {
+        for (auto mesh_renderer : mesh_renderers) {
+            auto material = mesh_renderer->material;
+            auto key = RenderQueue::make_key(DrawPass::Opaque, material->material_type.id, material->id, mesh_renderer->geometry, 0.0f);
+            render_queue.push(key, mesh_renderer->object_index);
+        }
+    }
+    else {
+        auto camera_position = camera.transform.get_position();
+        for (auto index : visible_objects) {
+            auto mesh_renderer = mesh_renderers[index];
+            auto material = mesh_renderer->material;
+            glm::vec3 offset = glm::vec3(mesh_renderer->transform->matrix()[3]) - camera_position;
+            auto key = RenderQueue::make_key(DrawPass::Opaque, material->material_type.id, material->id, mesh_renderer->geometry, glm::dot(offset, offset));
+            render_queue.push(key, mesh_renderer->object_index);
+        }
+    }
 
-    command_buffers.commands = context.device.allocateCommandBuffers(allocate_info);
+    render_queue.sort();
+}
+
+void Renderer::init_workers() {
+    //the render thread records a slice as well
+    uint32_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+    workers.init(cores - 1);
+}
 
-    for(size_t i = 0; i < command_buffers.commands.size(); i++) {
-        build_command_buffer(i);
+void FrameCommands::init(Context& context, uint32_t job_count) {
+    //transient, everything in them is recorded again every frame
+    vk::CommandPoolCreateInfo pool_create_info{};
+    pool_create_info.queueFamilyIndex = context.queue_families.graphics.value();
+    pool_create_info.flags = vk::CommandPoolCreateFlagBits::eTransient;
+
+    pool = context.device.createCommandPool(pool_create_info);
+    vk::CommandBufferAllocateInfo allocate_info(pool, vk::CommandBufferLevel::ePrimary, 1);
+    commands = context.device.allocateCommandBuffers(allocate_info).front();
+
+    for (uint32_t pass = 0; pass < PARALLEL_PASS_COUNT; pass++) {
+        for (uint32_t job = 0; job < job_count; job++) {
+            auto worker_pool = context.device.createCommandPool(pool_create_info);
+            vk::CommandBufferAllocateInfo worker_allocate_info(worker_pool, vk::CommandBufferLevel::eSecondary, 1);
+            worker_pools[pass].push_back(worker_pool);
+            worker_commands[pass].push_back(context.device.allocateCommandBuffers(worker_allocate_info).front());
+        }
     }
+}
 
-    command_buffers.needs_rebuild.resize(command_buffers.commands.size());
+void FrameCommands::close(Context& context) {
+    //destroying a pool frees its command buffers
+    context.device.destroyCommandPool(pool);
+    for (uint32_t pass = 0; pass < PARALLEL_PASS_COUNT; pass++) {
+        for (auto worker_pool : worker_pools[pass]) {
+            context.device.destroyCommandPool(worker_pool);
+        }
+        worker_pools[pass].clear();
+        worker_commands[pass].clear();
+    }
 }
 
 void Renderer::render(Camera &camera, const std::vector<std::unique_ptr<Object>> &objects) {
+    //the graph's images and render passes may still be in use by frames in flight
+    if (depth_prepass != graph_depth_prepass || deferred != graph_deferred) {
+        DEBUG("depth prepass " << (depth_prepass ? "on" : "off") << ", deferred shading " << (deferred ? "on" : "off")
+            << ", " << fragment_invocations << " fragment shader invocations before")
+        context.device.waitIdle();
+        close_render_graph();
+        init_render_graph();
+    }
+
     context.device.waitForFences(1, &sync[current_frame].in_flight_frame.fence, VK_TRUE, UINT64_MAX);
+
+    //this frame slot's query has finished along with its commands
+    if (statistics_pool != vk::QueryPool(nullptr) && statistics_pending[current_frame]) {
+        uint64_t invocations = 0;
+        auto result = context.device.getQueryPoolResults(statistics_pool, static_cast<uint32_t>(current_frame), 1,
+            sizeof(invocations), &invocations, sizeof(invocations), vk::QueryResultFlagBits::e64);
+        if (result == vk::Result::eSuccess) {
+            fragment_invocations = invocations;
+        }
+        statistics_pending[current_frame] = false;
+    }
     auto next_image_res = context.device.acquireNextImageKHR(swapchain.swapchain, UINT64_MAX, sync[current_frame].image_available.semaphore, nullptr);
 
     uint32_t next_image;
@@ -361,20 +1007,87 @@ void Renderer::render(Camera &camera, const std::vector<std::unique_ptr<Object>>
     }
     swapchain.image_fences[next_image] = sync[current_frame].in_flight_frame.fence;
 
+    //with the image's last frame done, so is its culling
+    if (gpu_driven) {
+        gpu_culling.read_stats(next_image, occlusion_stats);
+    }
+
 
     //update dirty materials
-    for(auto &renderer : mesh_renderers) {
-        renderer->material->update_if_dirty();
+    material_manager.update_dirty();
+
+    //anything uploaded since the last frame goes out ahead of this frame. with a transfer
+    //queue this only submits the graphics side of batches that have finished copying
+    upload_queue.flush();
+    upload_queue.collect();
+
+    //draws left out for uploads come back by themselves on the cpu path, the gpu culling
+    //inputs have to be written again
+    if (pending_upload_ticket != 0 && upload_queue.is_ready(pending_upload_ticket)) {
+        pending_upload_ticket = 0;
+        scene_version++;
+    }
+
+    //culling inputs point at arena ranges that have since moved
+    if (geometry_arena.get_version() != seen_geometry_version) {
+        scene_version++;
+        seen_geometry_version = geometry_arena.get_version();
+    }
+
+    update_pvs(camera.transform.get_position());
+
+    //a grown buffer means a new descriptor for this image, which nothing in flight uses.
+    //there are never more instances than mesh renderers, per gpu culling phase
+    auto object_count = static_cast<uint32_t>(mesh_renderers.size());
+    uint32_t instance_count = gpu_driven ? object_count * GpuCulling::PHASE_COUNT : object_count;
+    bool objects_grown = object_buffer.reserve(next_image, object_count);
+    bool instances_grown = instance_buffer.reserve(next_image, instance_count);
+    //only lights reaching into the frustum are uploaded and sorted into clusters
+    auto view = camera.view();
+    auto projection = camera.projection();
+    light_manager.update();
+    light_manager.cull(camera.frustum(), visible_lights);
+    bool lights_grown = light_clusters.update(next_image, light_manager.get_records(), visible_lights, view, projection,
+        camera.near_clip, camera.far_clip, swapchain.extent);
+    //a static object that was added or moved makes every cached shadow stale
+    for (auto index : changed_objects) {
+        if (mesh_renderers[index]->is_static) {
+            static_version++;
+            break;
+        }
+    }
+    bool shadows_grown = shadow_atlas.update(next_image, light_manager.get_records(), visible_lights, mesh_renderers, upload_queue,
+        static_version, camera.transform.get_position(), projection, swapchain.extent);
+    if (objects_grown || instances_grown || lights_grown || shadows_grown) {
+        write_storage_descriptors(next_image);
+    }
+
+    if (gpu_driven) {
+        //the queue doesn't depend on the camera, it and the image's culling inputs are
+        //only rebuilt when the scene changes, so steady frames touch no per-object state
+        if (gpu_culling.reserve(next_image, object_count)) {
+            culling_versions[next_image] = ~0ull;
+        }
+        if (culling_versions[next_image] != scene_version) {
+            if (render_queue_version != scene_version) {
+                build_render_queue(camera);
+                render_queue_version = scene_version;
+            }
+            build_culling_batches(next_image);
+            culling_versions[next_image] = scene_version;
+        }
+    }
+    else {
+        update_visibility(camera);
+        build_render_queue(camera);
     }
 
-    //rebuild command buffers if needed
-    if (command_buffers.needs_rebuild[next_image] == true) {
-        command_buffers.commands[next_image].reset({});
-        build_command_buffer(next_image);
-        command_buffers.needs_rebuild[next_image] = false;
-   }
+    //this frame's fence has signalled, everything recorded from its pools is done
+    auto& frame = frame_commands[current_frame];
+    context.device.resetCommandPool(frame.pool, {});
+    record_frame(frame, next_image);
 
-    update_uniform_buffers(next_image, objects, camera);
+    update_uniform_buffers(next_image, camera);
 
 
     vk::Semaphore wait_semaphores[] = {sync[current_frame].image_available.semaphore};
@@ -385,7 +1098,7 @@ void Renderer::render(Camera &camera, const std::vector<std::unique_ptr<Object>>
     submit_info.pWaitSemaphores = wait_semaphores;
     submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffers.commands[next_image];
+    submit_info.pCommandBuffers = &frame.commands;
     submit_info.signalSemaphoreCount = 1;
     submit_info.pSignalSemaphores = signal_semaphores;
 
@@ -424,16 +1137,84 @@ void Renderer::render(Camera &camera, const std::vector<std::unique_ptr<Object>>
 
 void Renderer::register_mesh(MeshRenderer* mr)
 {
+    mr->object_index = static_cast<uint32_t>(mesh_renderers.size());
     mesh_renderers.push_back(mr);
-    command_buffers.mark_dirty();
+    object_dirty_images.push_back(0);
+    frustum_culler.resize(static_cast<uint32_t>(mesh_renderers.size()));
+    //queues the index in changed_objects straight away
+    mr->transform->track(&changed_objects, mr->object_index);
+    scene_version++;
+
+    pvs_visible.push_back(1);
+    if (mr->pvs != nullptr) {
+        auto it = std::find_if(pvs_states.begin(), pvs_states.end(), [&](const PvsState& state) {
+            return state.pvs == mr->pvs;
+        });
+        if (it == pvs_states.end()) {
+            pvs_states.push_back(PvsState{ mr->pvs, PotentiallyVisibleSet::NO_CELL, {} });
+        }
+        pvs_dirty = true;
+    }
 }
 
-void Renderer::init_command_pool() {
-    vk::CommandPoolCreateInfo pool_create_info{};
-    pool_create_info.queueFamilyIndex = context.queue_families.graphics.value();
-    pool_create_info.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+void Renderer::compact_geometry() {
+    if (geometry_arena.needs_compaction()) {
+        geometry_arena.compact();
+    }
+}
+
+void Renderer::update_pvs(const glm::vec3& camera_position) {
+    bool changed = pvs_dirty;
+    for (auto& state : pvs_states) {
+        auto cell = state.pvs->get_cell(camera_position);
+        if (cell != state.cell) {
+            state.cell = cell;
+            if (cell != PotentiallyVisibleSet::NO_CELL) {
+                state.pvs->decompress(cell, state.bits);
+            }
+            changed = true;
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    pvs_dirty = false;
+
+    //outside a pvs's grid all of its nodes count as visible
+    for (uint32_t index = 0; index < mesh_renderers.size(); index++) {
+        auto mesh_renderer = mesh_renderers[index];
+        bool visible = true;
+        if (mesh_renderer->pvs != nullptr && mesh_renderer->pvs_node != PotentiallyVisibleSet::NO_NODE) {
+            for (const auto& state : pvs_states) {
+                if (state.pvs == mesh_renderer->pvs && state.cell != PotentiallyVisibleSet::NO_CELL) {
+                    visible = PotentiallyVisibleSet::is_visible(state.bits, mesh_renderer->pvs_node);
+                }
+            }
+        }
+        pvs_visible[index] = visible ? 1 : 0;
+        frustum_culler.set_enabled(index, visible);
+    }
 
-    context.command_pool = context.device.createCommandPool(pool_create_info);
+    //the gpu culling inputs leave hidden objects out
+    scene_version++;
+}
+
+void Renderer::init_frame_commands() {
+    TRACE("initializing frame command pools")
+    frame_commands.resize(MAX_FRAMES_IN_FLIGHT);
+    for (auto& frame : frame_commands) {
+        frame.init(context, workers.get_concurrency());
+    }
+}
+
+void Renderer::init_upload_queue() {
+    upload_queue.init();
+    context.upload_queue = &upload_queue;
+}
+
+void Renderer::init_geometry_arena() {
+    geometry_arena.init();
+    seen_geometry_version = geometry_arena.get_version();
 }
 
 void Renderer::rebuild_swapchain() {
@@ -449,27 +1230,23 @@ void Renderer::rebuild_swapchain() {
     close_swapchain();
 
     swapchain.init();
-    init_depth();
-    init_render_pass();
+    init_render_graph();
 
     for (auto& material_type : material_manager.material_types) {
-        material_type.second.rebuild_pipeline(swapchain.extent, renderpass, descriptor_set_layout);
+        material_type.second.rebuild_pipeline(swapchain.extent, render_graph.get_render_pass(forward_pass), descriptor_set_layout);
     }
 
-    init_framebuffers();
-    init_uniform_buffers();
+    init_frame_allocator();
+    init_object_buffers();
     init_descriptor_pool();
     init_descriptor_sets();
+    init_culling_buffers();
 
     //must rebuild all the material descriptor sets, too
     //TODO: what about materials that aren't attached to a MeshRenderer?
     for (auto& renderer : mesh_renderers) {
         renderer->material->init_descriptor_set(descriptor_pool, asset_manager);
     }
-
-    init_command_buffers();
-
-
 }
 
 
@@ -477,54 +1254,108 @@ void Renderer::init() {
     init_physical_device();
     init_logical_device();
     swapchain.init();
-    init_depth();
-    init_render_pass();
+
+    //decides whether the graph has a culling pass
+    gpu_driven = context.features.multi_draw_indirect;
     init_descriptor_set_layout();
+    shadow_atlas.init(descriptor_set_layout);
+    material_manager.init();
+    deferred_lighting.init();
+    if (gpu_driven) {
+        depth_pyramid.init();
+    }
+    init_render_graph();
     init_materials();
 
-    init_framebuffers();
-    init_command_pool();
-    init_uniform_buffers();
+    if (gpu_driven) {
+        gpu_culling.init(descriptor_set_layout);
+    }
+
+    init_workers();
+    occlusion_culler.init(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+    init_frame_commands();
+    init_upload_queue();
+    init_geometry_arena();
+    init_frame_allocator();
+    init_object_buffers();
     init_descriptor_pool();
     init_descriptor_sets();
-    init_command_buffers();
+    init_culling_buffers();
+    init_statistics_queries();
     init_sync_objects();
 }
 
+void Renderer::print_stats() const {
+    DEBUG("last recorded frame:")
+    encoder_stats.print();
+    render_graph.get_stats().print();
+    if (statistics_pool != vk::QueryPool(nullptr)) {
+        DEBUG(fragment_invocations << " fragment shader invocations, depth prepass " << (graph_depth_prepass ? "on" : "off")
+            << ", deferred shading " << (graph_deferred ? "on" : "off"))
+    }
+    if (gpu_driven) {
+        occlusion_stats.print();
+    }
+    else {
+        const auto& culling = frustum_culler.get_stats();
+        DEBUG("last frame culled " << culling.culled() << " of " << culling.tested << " objects, " << culling.visible << " visible")
+        if (software_occlusion) {
+            occlusion_culler.get_stats().print();
+        }
+    }
+    light_clusters.get_stats().print();
+    shadow_atlas.get_stats().print();
+}
+
 void Renderer::wait_for_idle() {
     context.device.waitIdle();
 }
 
 void Renderer::close_swapchain() {
-    depth_texture.reset();
-
-    for(auto framebuffer : framebuffers) {
-        context.device.destroyFramebuffer(framebuffer);
-    }
-    for(auto &uniform_buffer: uniform_buffers) {
-        uniform_buffer.close();
+    close_render_graph();
+    frame_allocator.close();
+    object_buffer.close();
+    instance_buffer.close();
+    light_clusters.close();
+    shadow_atlas.close_buffers();
+    if (gpu_driven) {
+        gpu_culling.close_buffers();
     }
-
-    uniform_buffers.clear();
     context.device.destroyDescriptorPool(descriptor_pool);
-    command_buffers.close(context);
 
     material_manager.close_pipelines();
 
-    context.device.destroyRenderPass(renderpass);
     swapchain.close();
 }
 
 void Renderer::close() {
+    workers.close();
+    mesh_cache.close();
+    geometry_arena.close();
+    upload_queue.close();
+    context.upload_queue = nullptr;
     close_swapchain();
+    if (gpu_driven) {
+        gpu_culling.close();
+        depth_pyramid.close();
+    }
+    deferred_lighting.close();
+    shadow_atlas.close();
+    if (statistics_pool != vk::QueryPool(nullptr)) {
+        context.device.destroyQueryPool(statistics_pool);
+    }
     context.device.destroyDescriptorSetLayout(descriptor_set_layout);
     material_manager.close_layouts();
     for (auto &m : mesh_renderers) {
         m->material->close();
     }
 
-    context.device.destroyCommandPool(context.command_pool);
+    for (auto& frame : frame_commands) {
+        frame.close(context);
+    }
+    frame_commands.clear();
     context.instance.destroySurfaceKHR(context.surface);
     sync.clear();
+    context.allocator.close();
     context.device.destroy();
 }
\ No newline at end of file
@@ -6,12 +6,30 @@
 #include "semaphore.h"
 #include "fence.h"
 #include "buffer.h"
+#include "frame_allocator.h"
+#include "upload.h"
+#include "geometry_arena.h"
+#include "mesh_cache.h"
+#include "per_image_buffer.h"
+#include "render_queue.h"
+#include "render_graph.h"
+#include "gpu_culling.h"
+#include "depth_pyramid.h"
+#include "deferred_lighting.h"
+#include "culling.h"
+#include "occlusion_culler.h"
+#include "pvs.h"
+#include "worker_pool.h"
+#include "command_encoder.h"
 #include "object.h"
 #include "mesh.h"
 #include "asset_manager.h"
 #include "light.h"
+#include "light_clusters.h"
+#include "shadow_atlas.h"
 #include "material.h"
 
+#include <array>
 #include <memory>
 
 class Camera;
@@ -29,38 +47,73 @@ struct FrameSync {
         in_flight_frame(Fence(context, true)){}
 };
 
-struct CommandBufferSet {
-    //one for each image in the swapchain
-    std::vector<vk::CommandBuffer> commands;
-    std::vector<bool> needs_rebuild;
+//command recording for one frame in flight. everything comes from transient pools that are
+//reset as a whole once the frame's fence has signalled, and is recorded again every frame
+struct FrameCommands {
+    //passes that may record on the workers in the same frame
+    enum ParallelPass : uint32_t {
+        FORWARD = 0,
+        GBUFFER = 1,
+        PARALLEL_PASS_COUNT
+    };
 
-    void close(Context& context) {
-        context.device.freeCommandBuffers(context.command_pool, commands);
-    }
+    vk::CommandPool pool = nullptr;
+    vk::CommandBuffer commands = nullptr;
+    //a pool and secondary command buffer per pass and recording job. a job only ever touches
+    //its own pool so jobs can record side by side, and every pass has its own secondaries so
+    //recording one pass doesn't reset those the primary already executed for another
+    std::array<std::vector<vk::CommandPool>, PARALLEL_PASS_COUNT> worker_pools;
+    std::array<std::vector<vk::CommandBuffer>, PARALLEL_PASS_COUNT> worker_commands;
 
-    void mark_dirty() {
-        for (size_t i = 0; i < needs_rebuild.size(); i++) {
-            needs_rebuild[i] = true;
-        }
-    }
+    void init(Context& context, uint32_t job_count);
+    void close(Context& context);
+};
+
+//one instanced draw of the cpu path, instances start at first_instance in the instance buffer
+struct InstancedDraw {
+    MeshRenderer* mesh_renderer;
+    uint32_t first_instance;
+    uint32_t instance_count;
 };
 
 class Renderer
 {
 public:
     const int MAX_FRAMES_IN_FLIGHT = 2;
+    const vk::DeviceSize FRAME_ALLOCATOR_SIZE = 1024 * 1024;
+    //below this many draws recording on one thread beats the secondary command buffer overhead
+    const size_t PARALLEL_RECORD_THRESHOLD = 2048;
+    const size_t MIN_DRAWS_PER_JOB = 512;
+    //software occlusion buffer, a few pixels per screen tile is all coarse occluders need
+    const uint32_t OCCLUSION_WIDTH = 320;
+    const uint32_t OCCLUSION_HEIGHT = 192;
 
     Renderer(Context &ctx, AssetManager &assetmanager) : 
         context(ctx), 
         swapchain(Swapchain(ctx)), 
 //        pipeline(Pipeline(ctx)),
         asset_manager(assetmanager),
-        material_manager(ctx) {};
+        material_manager(ctx),
+        frame_allocator(ctx),
+        upload_queue(ctx),
+        geometry_arena(ctx),
+        mesh_cache(geometry_arena),
+        object_buffer(ctx, sizeof(ObjectData)),
+        instance_buffer(ctx, sizeof(uint32_t)),
+        gpu_culling(ctx),
+        depth_pyramid(ctx),
+        light_clusters(ctx),
+        shadow_atlas(ctx),
+        render_graph(ctx),
+        deferred_lighting(ctx),
+        depth_pipeline(ctx, "depth") {};
     
     void init();
 
     void close();
     void wait_for_idle();
+    //bind counts from the last command buffer recording
+    void print_stats() const;
     void render(Camera &camera, const std::vector<std::unique_ptr<Object>> &objects);
 
     void register_mesh(MeshRenderer* mr);
@@ -72,6 +125,70 @@ public:
         return light_manager;
     }
 
+    GeometryArena& get_geometry_arena() {
+        return geometry_arena;
+    }
+
+    MeshCache& get_mesh_cache() {
+        return mesh_cache;
+    }
+    //packs the geometry arena once enough meshes were freed. this stalls the device, so it
+    //belongs at load and unload points, never in the frame loop. the next frame picks up the
+    //moved ranges
+    void compact_geometry();
+
+    //depth only pass ahead of the forward pass, so the material shaders run about once per
+    //pixel. switching rebuilds the render graph before the next frame
+    void set_depth_prepass(bool enabled) {
+        depth_prepass = enabled;
+    }
+    bool get_depth_prepass() const {
+        return depth_prepass;
+    }
+
+    //materials with a g-buffer shader write albedo, normal and roughness/metallic, and a
+    //full screen pass lights every pixel once. the others are still drawn forward on top.
+    //switching rebuilds the render graph before the next frame
+    void set_deferred(bool enabled) {
+        deferred = enabled;
+    }
+    bool get_deferred() const {
+        return deferred;
+    }
+
+    //of the newest frame whose results are in, 0 without pipeline statistics queries
+    uint64_t get_fragment_invocations() const {
+        return fragment_invocations;
+    }
+
+    //gpu frustum and occlusion culling of the newest frame whose results are in, empty when
+    //the cpu culls
+    const OcclusionStats& get_occlusion_stats() const {
+        return occlusion_stats;
+    }
+
+    //cpu frustum culling of the last frame, empty when the gpu culls
+    const CullingStats& get_culling_stats() const {
+        return frustum_culler.get_stats();
+    }
+
+    //tests what frustum culling kept against the occluder meshes on the cpu path
+    void set_software_occlusion(bool enabled) {
+        software_occlusion = enabled;
+    }
+    bool get_software_occlusion() const {
+        return software_occlusion;
+    }
+    const OcclusionCullerStats& get_software_occlusion_stats() const {
+        return occlusion_culler.get_stats();
+    }
+    const LightClusterStats& get_light_cluster_stats() const {
+        return light_clusters.get_stats();
+    }
+    const ShadowStats& get_shadow_stats() const {
+        return shadow_atlas.get_stats();
+    }
+
 
 private:
     AssetManager& asset_manager;
@@ -80,38 +197,152 @@ private:
 
     Context &context;
     Swapchain swapchain;
-    vk::RenderPass renderpass;
 //    Pipeline pipeline;
     vk::DescriptorSetLayout descriptor_set_layout;
-    std::vector<vk::Framebuffer> framebuffers;
     vk::DescriptorPool descriptor_pool;
     std::vector<vk::DescriptorSet> descriptor_sets;
-    CommandBufferSet command_buffers;
+    //one per frame in flight
+    std::vector<FrameCommands> frame_commands;
+    WorkerPool workers;
     std::vector<FrameSync> sync;
-    std::vector<Buffer> uniform_buffers;
+    FrameAllocator frame_allocator;
+    UploadQueue upload_queue;
+    GeometryArena geometry_arena;
+    MeshCache mesh_cache;
+    //ObjectData per mesh renderer, indexed by object_index
+    PerImageBuffer object_buffer;
+    //object indices of each instanced draw, written when the command buffer is recorded
+    PerImageBuffer instance_buffer;
+    //object indices whose transform changed since the last frame, filled by Transform
+    std::vector<uint32_t> changed_objects;
+    //per object, a bit for each swapchain image whose object buffer still has the old data
+    std::vector<uint32_t> object_dirty_images;
+    //objects with any bit set in object_dirty_images
+    std::vector<uint32_t> pending_objects;
+    //draws are culled and issued by the gpu, set when the device supports it
+    bool gpu_driven = false;
+    GpuCulling gpu_culling;
+    //built from the early phase's depth for the late culling phase, when gpu driven
+    DepthPyramid depth_pyramid;
+    OcclusionStats occlusion_stats;
+    //world space bounds of every object, culled on the cpu when not gpu driven
+    FrustumCuller frustum_culler;
+    //the pvs of every registered object's model, with the camera cell its bits are for
+    struct PvsState {
+        const PotentiallyVisibleSet* pvs;
+        uint32_t cell;
+        std::vector<uint8_t> bits;
+    };
+    std::vector<PvsState> pvs_states;
+    //per object, cleared when the camera's cell can't see it. filtered before any culling
+    std::vector<uint8_t> pvs_visible;
+    bool pvs_dirty = false;
+    OcclusionCuller occlusion_culler;
+    bool software_occlusion = true;
+    std::vector<uint32_t> visible_objects;
+    //the lights each cluster of the view touches, rebuilt every frame for the fragment shaders
+    LightClusters light_clusters;
+    //indices of the lights inside the frustum this frame
+    std::vector<uint32_t> visible_lights;
+    //the visible lights' shadows, with the static casters' depth cached per light
+    ShadowAtlas shadow_atlas;
+    //bumped when static objects are added or move, every light's cached shadow is drawn again
+    uint64_t static_version = 0;
+    RenderQueue render_queue;
+    //built with the swapchain, the forward pass's render pass is what the material pipelines use
+    RenderGraph render_graph;
+    uint32_t shadow_cache_pass = 0;
+    uint32_t shadow_pass = 0;
+    uint32_t cull_pass = 0;
+    uint32_t prepass_pass = 0;
+    uint32_t forward_pass = 0;
+    //the late culling phase and what it draws, when gpu driven
+    uint32_t pyramid_pass = 0;
+    uint32_t cull_late_pass = 0;
+    uint32_t prepass_late_pass = 0;
+    uint32_t forward_late_pass = 0;
+    //the g-buffer and lighting passes, in deferred mode
+    uint32_t gbuffer_pass = 0;
+    uint32_t gbuffer_late_pass = 0;
+    uint32_t lighting_pass = 0;
+    bool depth_prepass = false;
+    bool deferred = false;
+    //what render_graph was built for
+    bool graph_depth_prepass = false;
+    bool graph_deferred = false;
+    DeferredLighting deferred_lighting;
+    //position only, no fragment shader. only created with the prepass
+    Pipeline depth_pipeline;
+    //fragment shader invocations, one query per frame in flight
+    vk::QueryPool statistics_pool = nullptr;
+    std::vector<bool> statistics_pending;
+    uint64_t fragment_invocations = 0;
+    //what the passes record while record_frame runs the graph
+    FrameCommands* recording_frame = nullptr;
+    std::vector<InstancedDraw> frame_draws;
+    //the draws of materials with a g-buffer shader, taken out of frame_draws in deferred mode
+    std::vector<InstancedDraw> gbuffer_draws;
+    EncoderStats encoder_stats;
+    //bumped whenever the set of drawable objects or their arena ranges change. the gpu
+    //culling inputs are only written again when their version falls behind
+    uint64_t scene_version = 0;
+    uint64_t render_queue_version = ~0ull;
+    //per swapchain image
+    std::vector<uint64_t> culling_versions;
+    std::vector<std::vector<Material*>> culling_batch_materials;
+    //arena version scene_version last caught up with
+    uint32_t seen_geometry_version = 0;
+    //newest upload a draw was skipped for
+    UploadTicket pending_upload_ticket = 0;
     std::vector<MeshRenderer*> mesh_renderers;
-
-    std::unique_ptr<Texture> depth_texture;
     
 
     size_t current_frame = 0;
 
     void init_sync_objects();
-    void init_depth();
-    void init_command_pool();
-    void init_command_buffers();
-    void init_framebuffers();
+    void init_render_graph();
+    void close_render_graph();
+    void init_statistics_queries();
+    void init_frame_commands();
+    void init_upload_queue();
+    void init_geometry_arena();
+    void init_workers();
     void init_descriptor_set_layout();
     void init_materials();
-    void init_render_pass();
     void init_physical_device();
     void init_logical_device();
-    void init_uniform_buffers();
+    void init_frame_allocator();
+    void init_object_buffers();
     void init_descriptor_pool();
     void init_descriptor_sets();
-    void build_command_buffer(uint32_t image_index);
+    void init_culling_buffers();
+    void write_storage_descriptors(uint32_t image_index);
+    void mark_objects_dirty(const std::vector<uint32_t>& object_indices);
+    //looks the camera up in every pvs, only touches the objects when a cell changed
+    void update_pvs(const glm::vec3& camera_position);
+    //records this frame's primary command buffer for the image
+    void record_frame(FrameCommands& frame, uint32_t image_index);
+    //inside the prepass's and forward pass's render passes. phases is a mask of the gpu
+    //culling phases whose draws go in, the cpu path ignores it. the g-buffer pass records
+    //like the forward pass, with the materials' g-buffer pipelines
+    void record_depth_prepass(vk::CommandBuffer command_buffer, uint32_t image_index, uint32_t phases);
+    void record_forward_pass(vk::CommandBuffer command_buffer, uint32_t image_index, uint32_t phases, bool gbuffer);
+    //inits the material's descriptor set, false if the draw has to wait for uploads
+    bool prepare_draw(MeshRenderer* mesh_renderer);
+    void bind_material(CommandEncoder& encoder, uint32_t image_index, Material& material, bool gbuffer);
+    //writes the instance buffer and returns the draws, in queue order
+    std::vector<InstancedDraw> build_instanced_draws(uint32_t image_index);
+    void record_draws(CommandEncoder& encoder, uint32_t image_index, const std::vector<InstancedDraw>& draws, size_t first, size_t last, bool gbuffer);
+    //records slices of draws into the frame's secondary command buffers on the worker pool and
+    //executes them from the primary, which must be in the forward or g-buffer pass with
+    //secondary contents
+    void record_draws_parallel(FrameCommands& frame, uint32_t image_index, const std::vector<InstancedDraw>& draws, bool gbuffer);
+    //fills the image's culling batches from the render queue and culling_batch_materials
+    void build_culling_batches(uint32_t image_index);
+    void update_visibility(Camera& camera);
+    void build_render_queue(Camera& camera);
 
-    void update_uniform_buffers(uint32_t current_image, const std::vector<std::unique_ptr<Object>> &objects, Camera& camera);
+    void update_uniform_buffers(uint32_t current_image, Camera& camera);
 
     void rebuild_swapchain();
     void close_swapchain();
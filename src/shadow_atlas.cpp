@@ -0,0 +1,579 @@
+#include "shadow_atlas.h"
+#include "mesh.h"
+#include "upload.h"
+#include "log.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+//cube faces in the order the shaders pick them, see shadow_factor in lighting.glsl
+static const std::array<glm::vec3, ShadowAtlas::FACES> FACE_DIRECTIONS{
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+};
+static const std::array<glm::vec3, ShadowAtlas::FACES> FACE_UPS{
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+};
+
+//the even bits of a morton index, x of the cell
+static uint32_t compact_bits(uint32_t value) {
+    value &= 0x55555555;
+    value = (value | (value >> 1)) & 0x33333333;
+    value = (value | (value >> 2)) & 0x0f0f0f0f;
+    value = (value | (value >> 4)) & 0x00ff00ff;
+    value = (value | (value >> 8)) & 0x0000ffff;
+    return value;
+}
+
+static vk::Rect2D get_tile_rect(uint32_t first_cell, uint32_t size) {
+    auto x = static_cast<int32_t>(compact_bits(first_cell) * ShadowAtlas::MIN_TILE);
+    auto y = static_cast<int32_t>(compact_bits(first_cell >> 1) * ShadowAtlas::MIN_TILE);
+    return vk::Rect2D(vk::Offset2D(x, y), vk::Extent2D(size, size));
+}
+
+static bool box_in_frustum(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extent) {
+    for (const auto& plane : frustum.planes) {
+        glm::vec3 normal(plane);
+        if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent) < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShadowStats::print() const {
+    DEBUG("shadows: " << shadowed_lights << " lights in " << tiles << " tiles, " << static_tiles_rendered << " static tiles rendered with "
+        << static_draws << " draws, " << dynamic_draws << " dynamic draws")
+}
+
+void ShadowAtlas::init(vk::DescriptorSetLayout global_layout) {
+    TRACE("initializing shadow atlas")
+
+    auto format = Texture::get_supported_format(
+        context,
+        { vk::Format::eD32Sfloat, vk::Format::eD16Unorm },
+        vk::ImageTiling::eOptimal,
+        vk::FormatFeatureFlagBits::eDepthStencilAttachment | vk::FormatFeatureFlagBits::eSampledImage
+    );
+    for (auto* texture : { &atlas, &cache }) {
+        texture->width = SIZE;
+        texture->height = SIZE;
+        texture->mip_levels = 1;
+        texture->format = format;
+        texture->aspect = vk::ImageAspectFlagBits::eDepth;
+        texture->tiling = vk::ImageTiling::eOptimal;
+        texture->memory_flags = vk::MemoryPropertyFlagBits::eDeviceLocal;
+    }
+    atlas.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+    cache.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+    atlas.init();
+    cache.init();
+    cache_layout = vk::ImageLayout::eUndefined;
+
+    //the cache keeps what isn't drawn over, record_cache moves it in and out of transfer src
+    vk::AttachmentDescription attachment({},
+        format,
+        vk::SampleCountFlagBits::e1,
+        vk::AttachmentLoadOp::eLoad,
+        vk::AttachmentStoreOp::eStore,
+        vk::AttachmentLoadOp::eDontCare,
+        vk::AttachmentStoreOp::eDontCare,
+        vk::ImageLayout::eDepthStencilAttachmentOptimal,
+        vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    vk::AttachmentReference depth_reference(0, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    vk::SubpassDescription subpass({}, vk::PipelineBindPoint::eGraphics, 0, nullptr, 0, nullptr, nullptr, &depth_reference);
+    vk::RenderPassCreateInfo render_pass_info({}, 1, &attachment, 1, &subpass);
+    cache_render_pass = context.device.createRenderPass(render_pass_info);
+
+    vk::FramebufferCreateInfo framebuffer_info({}, cache_render_pass, 1, &cache.image_view, SIZE, SIZE, 1);
+    cache_framebuffer = context.device.createFramebuffer(framebuffer_info);
+
+    //sampler2DShadow, 1 where the stored depth is at least the reference
+    vk::SamplerCreateInfo sampler_info({},
+        vk::Filter::eNearest,
+        vk::Filter::eNearest,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        0.0f,
+        false,
+        1.0f,
+        true,
+        vk::CompareOp::eLessOrEqual,
+        0.0f,
+        0.0f,
+        vk::BorderColor::eFloatOpaqueWhite,
+        false);
+    sampler = context.device.createSampler(sampler_info);
+
+    std::array<vk::DescriptorSetLayoutBinding, 2> bindings{
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex, nullptr),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex, nullptr)
+    };
+    vk::DescriptorSetLayoutCreateInfo create_info({}, static_cast<uint32_t>(bindings.size()), bindings.data());
+    descriptor_set_layout = context.device.createDescriptorSetLayout(create_info);
+
+    //the graph's shadow pass has the same single depth attachment, so the pipeline works in
+    //both render passes
+    PipelineOptions options;
+    options.depth_only = true;
+    options.dynamic_viewport = true;
+    options.depth_bias_constant = 1.25f;
+    options.depth_bias_slope = 1.75f;
+    pipeline.init(get_extent(), cache_render_pass, { global_layout, descriptor_set_layout }, options);
+
+    occupied.assign(CELL_COUNT, 0);
+    entries.clear();
+}
+
+void ShadowAtlas::close() {
+    pipeline.close();
+    context.device.destroyDescriptorSetLayout(descriptor_set_layout);
+    context.device.destroySampler(sampler);
+    context.device.destroyFramebuffer(cache_framebuffer);
+    context.device.destroyRenderPass(cache_render_pass);
+    cache.close();
+    atlas.close();
+}
+
+void ShadowAtlas::init_buffers(uint32_t image_count) {
+    views.init(image_count, 0);
+    instances.init(image_count, 0);
+    records.init(image_count, 0);
+
+    vk::DescriptorPoolSize pool_size(vk::DescriptorType::eStorageBuffer, image_count * 2);
+    vk::DescriptorPoolCreateInfo pool_info({}, image_count, 1, &pool_size);
+    descriptor_pool = context.device.createDescriptorPool(pool_info);
+
+    std::vector<vk::DescriptorSetLayout> layouts(image_count, descriptor_set_layout);
+    vk::DescriptorSetAllocateInfo allocate_info(descriptor_pool, image_count, layouts.data());
+    descriptor_sets = context.device.allocateDescriptorSets(allocate_info);
+    for (uint32_t image = 0; image < image_count; image++) {
+        write_descriptors(image);
+    }
+}
+
+void ShadowAtlas::close_buffers() {
+    views.close();
+    instances.close();
+    records.close();
+    context.device.destroyDescriptorPool(descriptor_pool);
+    descriptor_pool = nullptr;
+    descriptor_sets.clear();
+}
+
+void ShadowAtlas::write_descriptors(uint32_t image) {
+    std::array<vk::DescriptorBufferInfo, 2> buffer_infos{ views.descriptor_info(image), instances.descriptor_info(image) };
+    vk::WriteDescriptorSet write(descriptor_sets[image], 0, 0, static_cast<uint32_t>(buffer_infos.size()),
+        vk::DescriptorType::eStorageBuffer, nullptr, buffer_infos.data(), nullptr);
+    context.device.updateDescriptorSets(1, &write, 0, nullptr);
+}
+
+bool ShadowAtlas::allocate(CacheEntry& entry, uint32_t size) {
+    for (; size >= MIN_TILE; size /= 2) {
+        uint32_t cells = (size / MIN_TILE) * (size / MIN_TILE);
+        uint32_t faces = 0;
+        //aligned tiles of a size start every cells cells
+        for (uint32_t first = 0; first < CELL_COUNT && faces < FACES; first += cells) {
+            auto begin = occupied.begin() + first;
+            if (std::all_of(begin, begin + cells, [](uint8_t cell) { return cell == 0; })) {
+                std::fill(begin, begin + cells, 1);
+                entry.first_cells[faces++] = first;
+            }
+        }
+        if (faces == FACES) {
+            entry.size = size;
+            entry.valid = false;
+            return true;
+        }
+        for (uint32_t face = 0; face < faces; face++) {
+            std::fill_n(occupied.begin() + entry.first_cells[face], cells, 0);
+        }
+    }
+    return false;
+}
+
+uint32_t ShadowAtlas::largest_fit(const std::vector<uint8_t>& cells, uint32_t size) {
+    for (; size >= MIN_TILE; size /= 2) {
+        uint32_t tile_cells = (size / MIN_TILE) * (size / MIN_TILE);
+        uint32_t faces = 0;
+        for (uint32_t first = 0; first < CELL_COUNT && faces < FACES; first += tile_cells) {
+            auto begin = cells.begin() + first;
+            if (std::all_of(begin, begin + tile_cells, [](uint8_t cell) { return cell == 0; })) {
+                faces++;
+            }
+        }
+        if (faces == FACES) {
+            return size;
+        }
+    }
+    return 0;
+}
+
+void ShadowAtlas::free_cells(std::vector<uint8_t>& cells, const CacheEntry& entry) {
+    uint32_t tile_cells = (entry.size / MIN_TILE) * (entry.size / MIN_TILE);
+    for (auto first : entry.first_cells) {
+        std::fill_n(cells.begin() + first, tile_cells, 0);
+    }
+}
+
+void ShadowAtlas::release(CacheEntry& entry) {
+    free_cells(occupied, entry);
+    entry.size = 0;
+    entry.requested = 0;
+    entry.valid = false;
+}
+
+bool ShadowAtlas::update_casters(const std::vector<MeshRenderer*>& mesh_renderers) {
+    //objects are only ever added, but may become static or dynamic at any time
+    bool rebuild = casters.size() != mesh_renderers.size();
+    casters.resize(mesh_renderers.size());
+    for (uint32_t index = 0; index < mesh_renderers.size(); index++) {
+        auto& caster = casters[index];
+        if (caster.mesh_renderer != mesh_renderers[index] || caster.is_static != mesh_renderers[index]->is_static) {
+            caster.mesh_renderer = mesh_renderers[index];
+            caster.is_static = mesh_renderers[index]->is_static;
+            rebuild = true;
+        }
+    }
+    if (rebuild) {
+        static_objects.clear();
+        dynamic_objects.clear();
+        for (uint32_t index = 0; index < casters.size(); index++) {
+            (casters[index].is_static ? static_objects : dynamic_objects).push_back(index);
+        }
+    }
+
+    for (auto& caster : casters) {
+        auto transform = caster.mesh_renderer->transform;
+        if (caster.version == transform->get_version() || caster.mesh_renderer->mesh == nullptr) {
+            continue;
+        }
+        const auto& bounds = caster.mesh_renderer->mesh->bounds;
+        auto M = transform->matrix();
+        glm::vec3 half = (bounds.max - bounds.min) * 0.5f;
+        caster.center = glm::vec3(M * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+        caster.extent = glm::abs(glm::vec3(M[0])) * half.x +
+            glm::abs(glm::vec3(M[1])) * half.y +
+            glm::abs(glm::vec3(M[2])) * half.z;
+        caster.version = transform->get_version();
+    }
+    return rebuild;
+}
+
+bool ShadowAtlas::gather_casters(const std::vector<uint32_t>& objects, const LightRecord& light, UploadQueue& upload_queue,
+    std::vector<uint32_t>& candidates) {
+    candidates.clear();
+    bool complete = true;
+    for (auto index : objects) {
+        const auto& caster = casters[index];
+        glm::vec3 closest = glm::clamp(light.position, caster.center - caster.extent, caster.center + caster.extent);
+        glm::vec3 offset = closest - light.position;
+        if (glm::dot(offset, offset) > light.range * light.range) {
+            continue;
+        }
+        auto mesh_renderer = caster.mesh_renderer;
+        if (mesh_renderer->geometry == GeometryArena::INVALID_HANDLE || !upload_queue.is_ready(mesh_renderer->get_upload_ticket())) {
+            complete = false;
+            continue;
+        }
+        candidates.push_back(index);
+    }
+    return complete;
+}
+
+void ShadowAtlas::add_draws(uint32_t view, const Frustum& frustum, const std::vector<uint32_t>& candidates, std::vector<ShadowDraw>& draws) {
+    tile_casters.clear();
+    for (auto index : candidates) {
+        const auto& caster = casters[index];
+        if (box_in_frustum(frustum, caster.center, caster.extent)) {
+            tile_casters.emplace_back(caster.mesh_renderer->geometry, index);
+        }
+    }
+    std::sort(tile_casters.begin(), tile_casters.end());
+
+    for (size_t i = 0; i < tile_casters.size();) {
+        auto geometry = tile_casters[i].first;
+        ShadowDraw draw{ casters[tile_casters[i].second].mesh_renderer, view, static_cast<uint32_t>(frame_instances.size()), 0 };
+        for (; i < tile_casters.size() && tile_casters[i].first == geometry; i++) {
+            frame_instances.push_back(tile_casters[i].second);
+            draw.instance_count++;
+        }
+        draws.push_back(draw);
+    }
+}
+
+bool ShadowAtlas::update(uint32_t image, const std::vector<LightRecord>& lights, const std::vector<uint32_t>& visible,
+    const std::vector<MeshRenderer*>& mesh_renderers, UploadQueue& upload_queue, uint64_t static_version,
+    const glm::vec3& camera_position, const glm::mat4& P, vk::Extent2D extent) {
+    stats = ShadowStats{};
+    entries.resize(lights.size());
+    //both counters only grow, so their sum changes whenever either does
+    if (update_casters(mesh_renderers)) {
+        caster_version++;
+    }
+    static_version += caster_version;
+
+    //the tile size follows the radius of the light's sphere on screen in pixels, a camera
+    //inside the sphere gets the biggest tiles
+    float pixel_scale = std::abs(P[1][1]) * extent.height * 0.5f;
+    requested_sizes.assign(lights.size(), 0);
+    importance.resize(visible.size());
+    for (uint32_t i = 0; i < visible.size(); i++) {
+        const auto& light = lights[visible[i]];
+        float distance = glm::length(light.position - camera_position);
+        float radius = static_cast<float>(MAX_TILE);
+        if (distance > light.range) {
+            radius = light.range / std::sqrt(distance * distance - light.range * light.range) * pixel_scale;
+        }
+        importance[i] = radius;
+
+        uint32_t size = MIN_TILE;
+        while (size < radius && size < MAX_TILE) {
+            size *= 2;
+        }
+        if (light.range > NEAR_CLIP) {
+            requested_sizes[visible[i]] = size;
+        }
+    }
+
+    //lights out of view give their tiles back, and so do lights asking for less than half
+    //of what they hold. shrinking by one step is let go so lights near the threshold don't
+    //render again every frame
+    for (uint32_t light = 0; light < entries.size(); light++) {
+        auto& entry = entries[light];
+        auto requested = requested_sizes[light];
+        if (entry.size != 0 && (requested == 0 || entry.size > requested * 2)) {
+            release(entry);
+        }
+    }
+
+    order.resize(visible.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return importance[a] > importance[b];
+    });
+    //most important first. a light without tiles, or with smaller ones than it asked for
+    //because the atlas was full, gets the biggest size that fits once every less important
+    //light is gone. only as many of those as that size needs give their tiles up, the least
+    //important first, and they are placed again further down the loop. a light that can't
+    //grow keeps its tiles, so nothing is evicted and drawn again every frame
+    for (uint32_t k = 0; k < order.size(); k++) {
+        auto& entry = entries[visible[order[k]]];
+        auto requested = requested_sizes[visible[order[k]]];
+        if (requested == 0 || entry.size >= requested) {
+            entry.requested = requested;
+            continue;
+        }
+
+        scratch_cells.assign(occupied.begin(), occupied.end());
+        free_cells(scratch_cells, entry);
+        uint32_t without_eviction = largest_fit(scratch_cells, requested);
+        uint32_t target = without_eviction;
+        if (target < requested) {
+            for (uint32_t j = k + 1; j < order.size(); j++) {
+                free_cells(scratch_cells, entries[visible[order[j]]]);
+            }
+            target = largest_fit(scratch_cells, requested);
+        }
+        if (target > entry.size) {
+            if (target > without_eviction) {
+                scratch_cells.assign(occupied.begin(), occupied.end());
+                free_cells(scratch_cells, entry);
+                for (uint32_t j = static_cast<uint32_t>(order.size()) - 1; j > k && largest_fit(scratch_cells, target) < target; j--) {
+                    auto& other = entries[visible[order[j]]];
+                    if (other.size != 0) {
+                        free_cells(scratch_cells, other);
+                        release(other);
+                    }
+                }
+            }
+            if (entry.size != 0) {
+                release(entry);
+            }
+            allocate(entry, target);
+        }
+        entry.requested = requested;
+    }
+
+    tile_rects.clear();
+    view_projections.clear();
+    dirty_views.clear();
+    static_draws.clear();
+    dynamic_draws.clear();
+    frame_instances.clear();
+
+    auto light_count = static_cast<uint32_t>(visible.size());
+    bool records_grown = records.reserve(image, light_count);
+    auto shadow_records = records.data<ShadowRecord>(image);
+    for (uint32_t i = 0; i < light_count; i++) {
+        const auto& light = lights[visible[i]];
+        auto& entry = entries[visible[i]];
+        auto& record = shadow_records[i];
+        record = ShadowRecord{};
+        if (entry.size == 0) {
+            continue;
+        }
+        stats.shadowed_lights++;
+
+        //the cache holds the static casters as they were for this light and its tiles
+        bool dirty = !entry.valid || entry.position != light.position || entry.range != light.range ||
+            entry.static_version != static_version;
+        bool complete = true;
+        if (dirty) {
+            entry.position = light.position;
+            entry.range = light.range;
+            entry.static_version = static_version;
+            complete = gather_casters(static_objects, light, upload_queue, static_candidates);
+        }
+        gather_casters(dynamic_objects, light, upload_queue, dynamic_candidates);
+
+        //flipped like the camera's projection, so the same faces are culled
+        glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(90.0f), 1.0f, NEAR_CLIP, light.range);
+        projection[1][1] *= -1;
+        for (uint32_t face = 0; face < FACES; face++) {
+            auto view = static_cast<uint32_t>(tile_rects.size());
+            auto rect = get_tile_rect(entry.first_cells[face], entry.size);
+            glm::mat4 view_projection = projection * glm::lookAt(light.position, light.position + FACE_DIRECTIONS[face], FACE_UPS[face]);
+            tile_rects.push_back(rect);
+            view_projections.push_back(view_projection);
+            record.view_projection[face] = view_projection;
+            record.rects[face] = glm::vec4(rect.offset.x, rect.offset.y, rect.extent.width, rect.extent.height) / static_cast<float>(SIZE);
+
+            auto frustum = Frustum::from_matrix(view_projection);
+            if (dirty) {
+                dirty_views.push_back(view);
+                add_draws(view, frustum, static_candidates, static_draws);
+            }
+            add_draws(view, frustum, dynamic_candidates, dynamic_draws);
+        }
+        //a static caster still uploading draws it all again once it's there
+        entry.valid = complete;
+    }
+
+    stats.tiles = static_cast<uint32_t>(tile_rects.size());
+    stats.static_tiles_rendered = static_cast<uint32_t>(dirty_views.size());
+    stats.static_draws = static_cast<uint32_t>(static_draws.size());
+    stats.dynamic_draws = static_cast<uint32_t>(dynamic_draws.size());
+
+    bool views_grown = views.reserve(image, static_cast<uint32_t>(view_projections.size()));
+    bool instances_grown = instances.reserve(image, static_cast<uint32_t>(frame_instances.size()));
+    std::copy(view_projections.begin(), view_projections.end(), views.data<glm::mat4>(image));
+    std::copy(frame_instances.begin(), frame_instances.end(), instances.data<uint32_t>(image));
+    if (views_grown || instances_grown) {
+        write_descriptors(image);
+    }
+    return records_grown;
+}
+
+void ShadowAtlas::bind(CommandEncoder& encoder, uint32_t image, vk::DescriptorSet global_set, const GeometryArena& arena) {
+    arena.bind(encoder);
+    encoder.bind_pipeline(pipeline);
+    encoder.bind_descriptor_set(pipeline, 0, global_set);
+    encoder.bind_descriptor_set(pipeline, 1, descriptor_sets[image]);
+}
+
+void ShadowAtlas::record_draws(CommandEncoder& encoder, uint32_t view, const std::vector<ShadowDraw>& draws, size_t& next) {
+    if (next == draws.size() || draws[next].view != view) {
+        return;
+    }
+
+    auto command_buffer = encoder.get_command_buffer();
+    const auto& rect = tile_rects[view];
+    vk::Viewport viewport(
+        static_cast<float>(rect.offset.x),
+        static_cast<float>(rect.offset.y),
+        static_cast<float>(rect.extent.width),
+        static_cast<float>(rect.extent.height),
+        0.0f,
+        1.0f);
+    command_buffer.setViewport(0, 1, &viewport);
+    command_buffer.setScissor(0, 1, &rect);
+    encoder.push_constants(pipeline, vk::ShaderStageFlagBits::eVertex, 0, sizeof(view), &view);
+
+    //draws are in view order
+    for (; next < draws.size() && draws[next].view == view; next++) {
+        const auto& draw = draws[next];
+        draw.mesh_renderer->command_buffer(encoder, draw.first_instance, draw.instance_count);
+    }
+}
+
+void ShadowAtlas::record_cache(CommandEncoder& encoder, uint32_t image, vk::DescriptorSet global_set, const GeometryArena& arena) {
+    auto command_buffer = encoder.get_command_buffer();
+    vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1);
+    auto depth_access = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    auto depth_stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+
+    if (!dirty_views.empty()) {
+        //earlier frames' copies out of the tiles have to be done before they are drawn over
+        vk::ImageMemoryBarrier to_depth(
+            vk::AccessFlagBits::eTransferRead,
+            depth_access,
+            cache_layout,
+            vk::ImageLayout::eDepthStencilAttachmentOptimal,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            cache.image,
+            range);
+        command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, depth_stages, {}, 0, nullptr, 0, nullptr, 1, &to_depth);
+
+        vk::RenderPassBeginInfo begin_info(cache_render_pass, cache_framebuffer, vk::Rect2D(vk::Offset2D(0, 0), get_extent()), 0, nullptr);
+        command_buffer.beginRenderPass(begin_info, vk::SubpassContents::eInline);
+        bind(encoder, image, global_set, arena);
+        size_t next = 0;
+        for (auto view : dirty_views) {
+            //only the tile is cleared, the other lights' cached depth stays
+            vk::ClearAttachment clear(vk::ImageAspectFlagBits::eDepth, 0, vk::ClearDepthStencilValue{ 1.0f, 0 });
+            vk::ClearRect clear_rect(tile_rects[view], 0, 1);
+            command_buffer.clearAttachments(1, &clear, 1, &clear_rect);
+            record_draws(encoder, view, static_draws, next);
+        }
+        command_buffer.endRenderPass();
+
+        vk::ImageMemoryBarrier to_transfer(
+            vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+            vk::AccessFlagBits::eTransferRead,
+            vk::ImageLayout::eDepthStencilAttachmentOptimal,
+            vk::ImageLayout::eTransferSrcOptimal,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            cache.image,
+            range);
+        command_buffer.pipelineBarrier(depth_stages, vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0, nullptr, 1, &to_transfer);
+        cache_layout = vk::ImageLayout::eTransferSrcOptimal;
+    }
+
+    if (tile_rects.empty()) {
+        return;
+    }
+    //every tile is in the cache by now, new ones were just drawn
+    std::vector<vk::ImageCopy> copies;
+    copies.reserve(tile_rects.size());
+    vk::ImageSubresourceLayers layers(vk::ImageAspectFlagBits::eDepth, 0, 0, 1);
+    for (const auto& rect : tile_rects) {
+        vk::Offset3D offset(rect.offset.x, rect.offset.y, 0);
+        copies.emplace_back(layers, offset, layers, offset, vk::Extent3D(rect.extent.width, rect.extent.height, 1));
+    }
+    command_buffer.copyImage(cache.image, vk::ImageLayout::eTransferSrcOptimal, atlas.image, vk::ImageLayout::eTransferDstOptimal,
+        static_cast<uint32_t>(copies.size()), copies.data());
+}
+
+void ShadowAtlas::record_dynamic(CommandEncoder& encoder, uint32_t image, vk::DescriptorSet global_set, const GeometryArena& arena) {
+    if (dynamic_draws.empty()) {
+        return;
+    }
+
+    bind(encoder, image, global_set, arena);
+    size_t next = 0;
+    for (uint32_t view = 0; view < tile_rects.size(); view++) {
+        record_draws(encoder, view, dynamic_draws, next);
+    }
+}
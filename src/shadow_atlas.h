@@ -0,0 +1,213 @@
+#pragma once
+
+#include "context.h"
+#include "pipeline.h"
+#include "per_image_buffer.h"
+#include "texture.h"
+#include "culling.h"
+#include "command_encoder.h"
+#include "geometry_arena.h"
+
+#include <array>
+#include <vector>
+
+class MeshRenderer;
+class UploadQueue;
+
+//where a visible light's shadow is, indexed like the light buffer. one tile per cube face in
+//the order +x -x +y -y +z -z, a light without a shadow has empty rects
+struct ShadowRecord {
+    alignas(16) glm::mat4 view_projection[6];
+    //atlas uv of the tile's corner in xy, its size in zw
+    alignas(16) glm::vec4 rects[6];
+};
+
+struct ShadowStats {
+    uint32_t shadowed_lights = 0;
+    uint32_t tiles = 0;
+    //tiles whose static casters were drawn into the cache, and the draws that took
+    uint32_t static_tiles_rendered = 0;
+    uint32_t static_draws = 0;
+    //dynamic casters are drawn into every tile every frame
+    uint32_t dynamic_draws = 0;
+
+    void print() const;
+};
+
+//point light shadows in one depth atlas. every visible light gets a square tile per cube
+//face, sized by how many pixels the light's sphere covers on screen, so lights near the
+//camera get more texels than far ones. tiles are powers of two between MIN_TILE and
+//MAX_TILE, packed in morton order of MIN_TILE cells where every aligned tile is one run of
+//cells. the most important lights are placed first and take tiles from less important ones
+//before they shrink. a light keeps its tiles from frame to frame until it leaves the view,
+//wants much smaller ones or there is room for the bigger ones it asked for.
+//
+//static casters (MeshRenderer::is_static) are drawn into a cache image with the same layout,
+//only when a light gets new tiles, moves or the static content changes. every frame the
+//cached tiles are copied into the atlas and the dynamic casters drawn on top, see
+//record_cache and record_dynamic. the fragment shaders find a light's tiles in the shadow
+//buffer (set 0 binding 6) and sample the atlas (binding 7), see lighting.glsl
+class ShadowAtlas {
+public:
+    static constexpr uint32_t SIZE = 4096;
+    static constexpr uint32_t MIN_TILE = 64;
+    static constexpr uint32_t MAX_TILE = 512;
+    static constexpr uint32_t FACES = 6;
+    static constexpr uint32_t CELLS = SIZE / MIN_TILE;
+    static constexpr uint32_t CELL_COUNT = CELLS * CELLS;
+    static constexpr float NEAR_CLIP = 0.05f;
+
+    ShadowAtlas(Context& ctx) :
+        context(ctx),
+        atlas(ctx),
+        cache(ctx),
+        pipeline(ctx, "shadow"),
+        views(ctx, sizeof(glm::mat4)),
+        instances(ctx, sizeof(uint32_t)),
+        records(ctx, sizeof(ShadowRecord)) {}
+    ShadowAtlas(const ShadowAtlas& other) = delete;
+
+    //global_layout is the renderer's set 0, the casters' matrices come from its object buffer
+    void init(vk::DescriptorSetLayout global_layout);
+    void close();
+    //per swapchain buffers and the sets pointing at them
+    void init_buffers(uint32_t image_count);
+    void close_buffers();
+
+    //places the visible lights' tiles, works out which cached tiles are stale and gathers
+    //the casters of every tile into the image's buffers. returns true if the shadow buffer
+    //was replaced and the image's set 0 has to be written again
+    bool update(uint32_t image, const std::vector<LightRecord>& lights, const std::vector<uint32_t>& visible,
+        const std::vector<MeshRenderer*>& mesh_renderers, UploadQueue& upload_queue, uint64_t static_version,
+        const glm::vec3& camera_position, const glm::mat4& P, vk::Extent2D extent);
+
+    //outside a render pass with the atlas in transfer dst layout: draws the stale tiles'
+    //static casters into the cache, then copies every tile into the atlas
+    void record_cache(CommandEncoder& encoder, uint32_t image, vk::DescriptorSet global_set, const GeometryArena& arena);
+    //inside a render pass with the atlas as its only, loaded, depth attachment
+    void record_dynamic(CommandEncoder& encoder, uint32_t image, vk::DescriptorSet global_set, const GeometryArena& arena);
+
+    vk::Format get_format() const {
+        return atlas.format;
+    }
+    vk::Extent2D get_extent() const {
+        return vk::Extent2D(SIZE, SIZE);
+    }
+    vk::Image get_image() const {
+        return atlas.image;
+    }
+    vk::ImageView get_view() const {
+        return atlas.image_view;
+    }
+    //the shadow buffer, binding 6
+    vk::DescriptorBufferInfo descriptor_info(uint32_t image) const {
+        return records.descriptor_info(image);
+    }
+    //the atlas with a depth compare sampler, binding 7
+    vk::DescriptorImageInfo image_info() const {
+        return vk::DescriptorImageInfo(sampler, atlas.image_view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    }
+    const ShadowStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    //a light's tiles and what its cached static depth was drawn for
+    struct CacheEntry {
+        //granted tile size in pixels, 0 without tiles
+        uint32_t size = 0;
+        //the size it asked for this frame. a full atlas may have granted a smaller one, which
+        //is grown again once there is room
+        uint32_t requested = 0;
+        //morton index of each face's first cell
+        std::array<uint32_t, FACES> first_cells{};
+        bool valid = false;
+        glm::vec3 position{ 0.0f };
+        float range = 0.0f;
+        uint64_t static_version = 0;
+    };
+
+    //world space box of an object, refreshed when its transform changes
+    struct Caster {
+        MeshRenderer* mesh_renderer = nullptr;
+        glm::vec3 center{ 0.0f };
+        glm::vec3 extent{ 0.0f };
+        uint32_t version = ~0u;
+        //MeshRenderer::is_static when the object lists were last built
+        bool is_static = false;
+    };
+
+    //casters of one geometry drawn into one tile, their object indices start at
+    //first_instance in the instance buffer
+    struct ShadowDraw {
+        MeshRenderer* mesh_renderer;
+        uint32_t view;
+        uint32_t first_instance;
+        uint32_t instance_count;
+    };
+
+    Context& context;
+    Texture atlas;
+    Texture cache;
+    vk::ImageLayout cache_layout = vk::ImageLayout::eUndefined;
+    vk::RenderPass cache_render_pass = nullptr;
+    vk::Framebuffer cache_framebuffer = nullptr;
+    vk::Sampler sampler = nullptr;
+    Pipeline pipeline;
+    vk::DescriptorSetLayout descriptor_set_layout = nullptr;
+    vk::DescriptorPool descriptor_pool = nullptr;
+    std::vector<vk::DescriptorSet> descriptor_sets;
+
+    //view projection per tile, the object indices of the draws and a record per visible light
+    PerImageBuffer views;
+    PerImageBuffer instances;
+    PerImageBuffer records;
+
+    //per light, indexed like the light manager's lights
+    std::vector<CacheEntry> entries;
+    //1 for cells taken by a tile, in morton order
+    std::vector<uint8_t> occupied;
+    std::vector<Caster> casters;
+    std::vector<uint32_t> static_objects;
+    std::vector<uint32_t> dynamic_objects;
+    //bumped when the object lists are rebuilt, added to the renderer's static version
+    uint64_t caster_version = 0;
+
+    //this frame's tiles, indexed by view
+    std::vector<vk::Rect2D> tile_rects;
+    std::vector<glm::mat4> view_projections;
+    //views whose static casters go into the cache
+    std::vector<uint32_t> dirty_views;
+    std::vector<ShadowDraw> static_draws;
+    std::vector<ShadowDraw> dynamic_draws;
+    std::vector<uint32_t> frame_instances;
+    ShadowStats stats;
+
+    //scratch
+    std::vector<uint32_t> requested_sizes;
+    std::vector<float> importance;
+    std::vector<uint32_t> order;
+    std::vector<uint8_t> scratch_cells;
+    std::vector<uint32_t> static_candidates;
+    std::vector<uint32_t> dynamic_candidates;
+    std::vector<std::pair<GeometryHandle, uint32_t>> tile_casters;
+
+    void write_descriptors(uint32_t image);
+    //finds room for every face at size or smaller, false if not even MIN_TILE fits
+    bool allocate(CacheEntry& entry, uint32_t size);
+    void release(CacheEntry& entry);
+    //largest tile size up to size with room for every face among the cells, 0 if none
+    static uint32_t largest_fit(const std::vector<uint8_t>& cells, uint32_t size);
+    //marks the cells of the entry's tiles free
+    static void free_cells(std::vector<uint8_t>& cells, const CacheEntry& entry);
+    //true if the static and dynamic object lists were rebuilt, for new objects or ones that
+    //became static or dynamic
+    bool update_casters(const std::vector<MeshRenderer*>& mesh_renderers);
+    //objects reaching into the light's sphere, false if one was left out for its uploads
+    bool gather_casters(const std::vector<uint32_t>& objects, const LightRecord& light, UploadQueue& upload_queue,
+        std::vector<uint32_t>& candidates);
+    //instanced draws of the candidates inside the face's frustum, grouped by geometry
+    void add_draws(uint32_t view, const Frustum& frustum, const std::vector<uint32_t>& candidates, std::vector<ShadowDraw>& draws);
+    void record_draws(CommandEncoder& encoder, uint32_t view, const std::vector<ShadowDraw>& draws, size_t& next);
+    void bind(CommandEncoder& encoder, uint32_t image, vk::DescriptorSet global_set, const GeometryArena& arena);
+};
@@ -1,4 +1,5 @@
 #include "texture.h"
+#include "upload.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -72,22 +73,6 @@ bool Texture::has_stencil(vk::Format format)
 	return false;
 }
 
-void Texture::copy_from_buffer(Buffer& buffer)
-{
-	auto command = OneTimeSubmitCommand::create(context);
-
-	vk::ImageSubresourceLayers subresource(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
-	vk::BufferImageCopy region({},
-		{},
-		{},
-		subresource,
-		{ 0,0,0 },
-		{ width,height,1 });
-
-	command.buffer.copyBufferToImage(buffer.buffer, image, layout, 1, &region);
-	command.execute();
-}
-
 void Texture::init()
 {
 	if (format == vk::Format::eUndefined) {
@@ -113,11 +98,8 @@ void Texture::init()
 	image = context.device.createImage(create_info);
 
 	auto memory_requirements = context.device.getImageMemoryRequirements(image);
-	vk::MemoryAllocateInfo allocate_info(memory_requirements.size,
-		context.find_memory_type(memory_requirements.memoryTypeBits, memory_flags));
-
-	image_memory = context.device.allocateMemory(allocate_info);
-	context.device.bindImageMemory(image, image_memory, 0);
+	image_allocation = context.allocator.allocate(memory_requirements, memory_flags, tiling == vk::ImageTiling::eLinear);
+	context.device.bindImageMemory(image, image_allocation.memory, image_allocation.offset);
 
 	//image view
 	vk::ImageViewCreateInfo view_info({},
@@ -133,25 +115,25 @@ void Texture::init()
 
 void Texture::upload(bool generate_mipmaps)
 {
+	//everything goes into the upload batches, no waiting on the gpu here
+	auto& uploads = *context.upload_queue;
 
-	Buffer staging(context);
-	staging.init(width * height * channels,
-		vk::BufferUsageFlagBits::eTransferSrc,
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-	staging.store(pixels);
-
-	transition_layout(vk::ImageLayout::eTransferDstOptimal);
-	copy_from_buffer(staging);
+	transition_layout(uploads.get_command_buffer(), vk::ImageLayout::eTransferDstOptimal);
+	uploads.upload_image(pixels, width, height, channels, image, vk::ImageAspectFlagBits::eColor);
 
-	staging.close();
+	//the pixels live in the staging ring now
+	stbi_image_free(pixels);
+	pixels = nullptr;
 
+	//blits and shader layouts need the graphics queue, the image has been handed over to it
+	auto command_buffer = uploads.get_graphics_command_buffer();
 	if (generate_mipmaps) {
 		//create_mipmaps also transitions layout to ShaderReadOnlyOptimal
-		create_mipmaps();
+		create_mipmaps(command_buffer);
 	} else {
-		transition_layout(vk::ImageLayout::eShaderReadOnlyOptimal);
+		transition_layout(command_buffer, vk::ImageLayout::eShaderReadOnlyOptimal);
 	}
-	
+	upload_ticket = uploads.current_ticket();
 
 	//sampler
 	vk::SamplerCreateInfo sampler_info({},
@@ -195,15 +177,13 @@ void Texture::close()
 		context.device.destroyImage(image);
 		image = nullptr;
 	}
-	if (image_memory != vk::DeviceMemory(nullptr)) {
-		context.device.freeMemory(image_memory);
-		image_memory = nullptr;
+	if (image_allocation.is_valid()) {
+		context.allocator.free(image_allocation);
 	}
 }
 
-void Texture::create_mipmaps()
+void Texture::create_mipmaps(vk::CommandBuffer command_buffer)
 {
-	auto command = OneTimeSubmitCommand::create(context);
 
 	vk::ImageSubresourceRange subresource_range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
 	vk::ImageMemoryBarrier barrier(
@@ -232,7 +212,7 @@ void Texture::create_mipmaps()
 		barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal,
 		barrier.subresourceRange.baseMipLevel = i - 1;
 
-		command.buffer.pipelineBarrier(
+		command_buffer.pipelineBarrier(
 			vk::PipelineStageFlagBits::eTransfer,
 			vk::PipelineStageFlagBits::eTransfer,
 			{},
@@ -254,7 +234,7 @@ void Texture::create_mipmaps()
 			vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, i, 0, 1 },
 			dest_offset
 		);
-		command.buffer.blitImage(
+		command_buffer.blitImage(
 			image, vk::ImageLayout::eTransferSrcOptimal,
 			image, vk::ImageLayout::eTransferDstOptimal,
 			1, &blit,
@@ -268,7 +248,7 @@ void Texture::create_mipmaps()
 		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
 		barrier.subresourceRange.baseMipLevel = i - 1;
 
-		command.buffer.pipelineBarrier(
+		command_buffer.pipelineBarrier(
 			vk::PipelineStageFlagBits::eTransfer,
 			vk::PipelineStageFlagBits::eFragmentShader,
 			{},
@@ -287,7 +267,7 @@ void Texture::create_mipmaps()
 	barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
 	barrier.subresourceRange.baseMipLevel = mip_levels - 1;
 
-	command.buffer.pipelineBarrier(
+	command_buffer.pipelineBarrier(
 		vk::PipelineStageFlagBits::eTransfer,
 		vk::PipelineStageFlagBits::eFragmentShader,
 		{},
@@ -295,13 +275,18 @@ void Texture::create_mipmaps()
 		0, nullptr,
 		1, &barrier);
 
-	command.execute();
 	layout = vk::ImageLayout::eShaderReadOnlyOptimal;
 }
 
 void Texture::transition_layout(vk::ImageLayout new_layout)
 {
-	auto command = OneTimeSubmitCommand::create(context);
+	auto& uploads = *context.upload_queue;
+	transition_layout(uploads.get_graphics_command_buffer(), new_layout);
+	upload_ticket = uploads.current_ticket();
+}
+
+void Texture::transition_layout(vk::CommandBuffer command_buffer, vk::ImageLayout new_layout)
+{
 
 	vk::AccessFlags src_access_mask;
 	vk::AccessFlags dest_access_mask;
@@ -318,7 +303,7 @@ void Texture::transition_layout(vk::ImageLayout new_layout)
 	}
 	else if (layout == vk::ImageLayout::eTransferDstOptimal && new_layout == vk::ImageLayout::eShaderReadOnlyOptimal) {
 		src_access_mask = vk::AccessFlagBits::eTransferWrite;
-		dest_access_mask == vk::AccessFlagBits::eShaderRead;
+		dest_access_mask = vk::AccessFlagBits::eShaderRead;
 		src_stage = vk::PipelineStageFlagBits::eTransfer;
 		dest_stage = vk::PipelineStageFlagBits::eFragmentShader;
 	}
@@ -349,9 +334,7 @@ void Texture::transition_layout(vk::ImageLayout new_layout)
 		subresource_range);
 		
 
-	command.buffer.pipelineBarrier(src_stage, dest_stage, {}, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	command.execute();
+	command_buffer.pipelineBarrier(src_stage, dest_stage, {}, 0, nullptr, 0, nullptr, 1, &barrier);
 
 	layout = new_layout;
 }
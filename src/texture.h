@@ -17,7 +17,7 @@ public:
 	uint32_t channels;
 	uint32_t mip_levels;
 	vk::Image image;
-	vk::DeviceMemory image_memory;
+	Allocation image_allocation;
 	vk::ImageView image_view;
 	vk::Sampler sampler;
 	vk::Format format;
@@ -27,6 +27,8 @@ public:
 	vk::MemoryPropertyFlagBits memory_flags;
 
 	bool uploaded;
+	//upload batch holding the copy, mipmap and layout commands
+	uint64_t upload_ticket = 0;
 
 	static std::unique_ptr<Texture> load_image(Context &context, const std::string& path, ColorSpace color_space);
 	static vk::Format get_supported_format(Context& context,
@@ -35,9 +37,9 @@ public:
 		vk::FormatFeatureFlags features);
 	static bool has_stencil(vk::Format format);
 	void init();
-	void copy_from_buffer(Buffer& buffer);
 	void upload(bool generate_mipmaps);
 	void transition_layout(vk::ImageLayout layout);
+	void transition_layout(vk::CommandBuffer command_buffer, vk::ImageLayout layout);
 
 	Texture(Context& ctx) : 
 		context(ctx), 
@@ -64,5 +66,5 @@ private:
 	
 	vk::ImageLayout layout;
 
-	void create_mipmaps();
+	void create_mipmaps(vk::CommandBuffer command_buffer);
 };
\ No newline at end of file
@@ -12,20 +12,73 @@ void decompose(const glm::mat4& m, glm::vec3& pos, glm::quat& rot, glm::vec3& sc
     rot = glm::quat_cast(rot_mat);
 }
 
+Transform& Transform::operator=(const Transform& other)
+{
+	if (&other != this) {
+		position = other.position;
+		rotation = other.rotation;
+		scale = other.scale;
+		mark_changed();
+	}
+	return *this;
+}
+
+void Transform::mark_changed()
+{
+	matrix_dirty = true;
+	version++;
+	if (changed_list != nullptr && !queued) {
+		queued = true;
+		changed_list->push_back(tracking_id);
+	}
+}
+
+void Transform::track(std::vector<uint32_t>* changed, uint32_t id)
+{
+	changed_list = changed;
+	tracking_id = id;
+	queued = false;
+	//whoever tracks us hasn't seen the current state yet
+	mark_changed();
+}
+
+void Transform::set_position(const glm::vec3& pos)
+{
+	position = pos;
+	mark_changed();
+}
+
+void Transform::set_rotation(const glm::quat& rot)
+{
+	rotation = rot;
+	mark_changed();
+}
+
 void Transform::set_rotation(const glm::vec3& euler)
 {
 	rotation = glm::quat(euler);
+	mark_changed();
+}
+
+void Transform::set_scale(const glm::vec3& s)
+{
+	scale = s;
+	mark_changed();
 }
 
 void Transform::set_matrix(const glm::mat4& mat)
 {
     decompose(mat, position, rotation, scale);
+	mark_changed();
 }
 
 glm::mat4 Transform::matrix() const
 {
-	glm::mat4 m = glm::translate(position) * glm::toMat4(rotation) * glm::scale(scale);
-	return m;
+	if (matrix_dirty) {
+		cached_matrix = glm::translate(position) * glm::toMat4(rotation) * glm::scale(scale);
+		matrix_dirty = false;
+	}
+	return cached_matrix;
 
 }
 
@@ -33,4 +86,4 @@ glm::vec3 Transform::forward() const
 {
 	//TODO: BROKEN
 	return glm::vec4(0, 1, 0, 0) * matrix();
-}
\ No newline at end of file
+}
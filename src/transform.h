@@ -4,16 +4,57 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <vector>
+
 class Transform {
 public:
-	glm::vec3 position;
-	glm::quat rotation;
-	glm::vec3 scale;
-
 	Transform() : position(glm::vec3(0)), rotation(glm::vec3(0)), scale(glm::vec3(1)) {};
+	//only position/rotation/scale are copied, whoever tracks the source doesn't track the copy
+	Transform(const Transform& other) : position(other.position), rotation(other.rotation), scale(other.scale) {}
+	Transform& operator=(const Transform& other);
+
+	const glm::vec3& get_position() const {
+		return position;
+	}
+	const glm::quat& get_rotation() const {
+		return rotation;
+	}
+	const glm::vec3& get_scale() const {
+		return scale;
+	}
 
+	void set_position(const glm::vec3& pos);
+	void set_rotation(const glm::quat& rot);
 	void set_rotation(const glm::vec3& euler);
+	void set_scale(const glm::vec3& s);
 	void set_matrix(const glm::mat4& mat);
+	//cached until the next change
 	glm::mat4 matrix() const;
 	glm::vec3 forward() const;
+
+	//bumped on every change
+	uint32_t get_version() const {
+		return version;
+	}
+	//the first change after being tracked or drained pushes id onto changed
+	void track(std::vector<uint32_t>* changed, uint32_t id);
+	//called by whoever drains the changed list
+	void clear_queued() {
+		queued = false;
+	}
+
+private:
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+
+	mutable glm::mat4 cached_matrix = glm::mat4(1);
+	mutable bool matrix_dirty = true;
+	uint32_t version = 0;
+
+	std::vector<uint32_t>* changed_list = nullptr;
+	uint32_t tracking_id = 0;
+	bool queued = false;
+
+	void mark_changed();
 };
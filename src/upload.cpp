@@ -0,0 +1,459 @@
+#include "upload.h"
+#include "log.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void UploadQueue::init() {
+    TRACE("initializing upload queue")
+    graphics_family = context.queue_families.graphics.value();
+    transfer_family = context.queue_families.transfer.value_or(graphics_family);
+    dedicated = transfer_family != graphics_family;
+    if (dedicated) {
+        DEBUG("uploading on dedicated transfer queue family " << transfer_family)
+    }
+
+    vk::CommandPoolCreateInfo pool_create_info{};
+    pool_create_info.queueFamilyIndex = transfer_family;
+    pool_create_info.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient;
+
+    command_pool = context.device.createCommandPool(pool_create_info);
+
+    if (dedicated) {
+        pool_create_info.queueFamilyIndex = graphics_family;
+        graphics_command_pool = context.device.createCommandPool(pool_create_info);
+    }
+
+    staging.init(STAGING_SIZE,
+        vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    staging_head = 0;
+    staging_tail = 0;
+    staging_in_use = 0;
+}
+
+void UploadQueue::close() {
+    flush();
+    if (!in_flight.empty()) {
+        wait(in_flight.back().ticket);
+    }
+
+    for (auto fence : free_fences) {
+        context.device.destroyFence(fence);
+    }
+    free_fences.clear();
+    free_command_buffers.clear();
+    free_graphics_command_buffers.clear();
+
+    context.device.destroyCommandPool(command_pool);
+    command_pool = nullptr;
+    if (graphics_command_pool != vk::CommandPool(nullptr)) {
+        context.device.destroyCommandPool(graphics_command_pool);
+        graphics_command_pool = nullptr;
+    }
+    staging.close();
+}
+
+vk::CommandBuffer UploadQueue::get_free_command_buffer(vk::CommandPool pool, std::vector<vk::CommandBuffer>& free_list) {
+    vk::CommandBuffer command_buffer;
+    if (free_list.empty()) {
+        vk::CommandBufferAllocateInfo alloc_info(pool, vk::CommandBufferLevel::ePrimary, 1);
+        command_buffer = context.device.allocateCommandBuffers(alloc_info)[0];
+    }
+    else {
+        command_buffer = free_list.back();
+        free_list.pop_back();
+    }
+
+    vk::CommandBufferBeginInfo begin_info(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    command_buffer.begin(begin_info);
+    return command_buffer;
+}
+
+vk::CommandBuffer UploadQueue::get_command_buffer() {
+    if (recording) {
+        return current.command_buffer;
+    }
+
+    current.command_buffer = get_free_command_buffer(command_pool, free_command_buffers);
+    current.ticket = next_ticket;
+    recording = true;
+
+    return current.command_buffer;
+}
+
+vk::CommandBuffer UploadQueue::get_graphics_command_buffer() {
+    if (!dedicated) {
+        return get_command_buffer();
+    }
+
+    //the graphics side always belongs to a batch with a transfer side, even an empty one
+    get_command_buffer();
+    if (!recording_graphics) {
+        current.graphics_command_buffer = get_free_command_buffer(graphics_command_pool, free_graphics_command_buffers);
+        recording_graphics = true;
+    }
+
+    return current.graphics_command_buffer;
+}
+
+vk::Fence UploadQueue::get_fence() {
+    if (free_fences.empty()) {
+        return context.device.createFence(vk::FenceCreateInfo{});
+    }
+    auto fence = free_fences.back();
+    free_fences.pop_back();
+    return fence;
+}
+
+bool UploadQueue::try_allocate_staging(vk::DeviceSize size, vk::DeviceSize& offset) {
+    //copies out of a buffer need 4 byte offsets, 16 keeps every texel size happy
+    const vk::DeviceSize alignment = 16;
+    size = align_up(size, alignment);
+
+    if (staging_in_use == 0) {
+        staging_head = 0;
+        staging_tail = 0;
+    }
+
+    vk::DeviceSize padding = 0;
+    if (staging_head >= staging_tail && staging_in_use < STAGING_SIZE) {
+        //free space is [head, end) and [0, tail)
+        if (staging_head + size <= STAGING_SIZE) {
+            offset = staging_head;
+        }
+        else if (size <= staging_tail) {
+            padding = STAGING_SIZE - staging_head;
+            offset = 0;
+        }
+        else {
+            return false;
+        }
+    }
+    else if (staging_head < staging_tail && staging_head + size <= staging_tail) {
+        offset = staging_head;
+    }
+    else {
+        return false;
+    }
+
+    staging_head = offset + size;
+    staging_in_use += padding + size;
+    current.staging_bytes += padding + size;
+    return true;
+}
+
+StagingAllocation UploadQueue::allocate_staging(vk::DeviceSize size) {
+    if (size > STAGING_SIZE) {
+        throw std::runtime_error("staging allocation larger than the staging ring");
+    }
+
+    vk::DeviceSize offset = 0;
+    while (!try_allocate_staging(size, offset)) {
+        //the ring is full: push out what we have recorded and wait for the oldest batch
+        if (recording && current.staging_bytes > 0) {
+            flush();
+        }
+        if (in_flight.empty()) {
+            throw std::runtime_error("staging ring exhausted with no uploads in flight");
+        }
+        wait(in_flight.front().ticket);
+    }
+
+    //make sure the staging space belongs to the batch that will record the copy
+    get_command_buffer();
+
+    return StagingAllocation{
+        staging.buffer,
+        offset,
+        size,
+        static_cast<char*>(staging.data()) + offset
+    };
+}
+
+void UploadQueue::release_staging(Batch& batch) {
+    if (batch.staging_bytes > 0) {
+        staging_tail = batch.staging_end;
+        staging_in_use -= batch.staging_bytes;
+        batch.staging_bytes = 0;
+    }
+}
+
+void UploadQueue::release_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size) {
+    if (!dedicated) {
+        return;
+    }
+
+    //releases are recorded together at flush, acquires go in right away so graphics
+    //work recorded later in the batch can use the buffer
+    buffer_releases.push_back(vk::BufferMemoryBarrier(
+        vk::AccessFlagBits::eTransferWrite,
+        {},
+        transfer_family,
+        graphics_family,
+        buffer,
+        offset,
+        size));
+
+    vk::BufferMemoryBarrier acquire(
+        {},
+        vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead |
+        vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead |
+        vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite,
+        transfer_family,
+        graphics_family,
+        buffer,
+        offset,
+        size);
+    get_graphics_command_buffer().pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eVertexInput |
+        vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader,
+        {},
+        0, nullptr,
+        1, &acquire,
+        0, nullptr);
+}
+
+void UploadQueue::release_image(vk::Image image, vk::ImageLayout layout, vk::ImageAspectFlags aspect) {
+    if (!dedicated) {
+        return;
+    }
+
+    vk::ImageSubresourceRange subresource_range(aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS);
+
+    image_releases.push_back(vk::ImageMemoryBarrier(
+        vk::AccessFlagBits::eTransferWrite,
+        {},
+        layout,
+        layout,
+        transfer_family,
+        graphics_family,
+        image,
+        subresource_range));
+
+    vk::ImageMemoryBarrier acquire(
+        {},
+        vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead,
+        layout,
+        layout,
+        transfer_family,
+        graphics_family,
+        image,
+        subresource_range);
+    get_graphics_command_buffer().pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eFragmentShader,
+        {},
+        0, nullptr,
+        0, nullptr,
+        1, &acquire);
+}
+
+UploadTicket UploadQueue::upload_buffer(const void* data, vk::DeviceSize size, vk::Buffer dest, vk::DeviceSize dest_offset) {
+    auto src = static_cast<const char*>(data);
+    vk::DeviceSize done = 0;
+    while (done < size) {
+        vk::DeviceSize chunk = std::min(size - done, MAX_CHUNK_SIZE);
+        auto alloc = allocate_staging(chunk);
+        memcpy(alloc.data, src + done, (size_t)chunk);
+
+        vk::BufferCopy copy_info(alloc.offset, dest_offset + done, chunk);
+        get_command_buffer().copyBuffer(alloc.buffer, dest, 1, &copy_info);
+        //each chunk is released with the batch it was copied in
+        release_buffer(dest, dest_offset + done, chunk);
+
+        done += chunk;
+    }
+
+    return current_ticket();
+}
+
+UploadTicket UploadQueue::upload_image(const void* pixels, uint32_t width, uint32_t height, uint32_t texel_size, vk::Image image, vk::ImageAspectFlags aspect) {
+    auto src = static_cast<const char*>(pixels);
+    vk::DeviceSize row_size = static_cast<vk::DeviceSize>(width) * texel_size;
+    uint32_t rows_per_chunk = static_cast<uint32_t>(std::max<vk::DeviceSize>(1, MAX_CHUNK_SIZE / row_size));
+
+    for (uint32_t row = 0; row < height; row += rows_per_chunk) {
+        uint32_t rows = std::min(rows_per_chunk, height - row);
+        vk::DeviceSize chunk = row_size * rows;
+        auto alloc = allocate_staging(chunk);
+        memcpy(alloc.data, src + row_size * row, (size_t)chunk);
+
+        vk::ImageSubresourceLayers subresource(aspect, 0, 0, 1);
+        vk::BufferImageCopy region(alloc.offset,
+            0,
+            0,
+            subresource,
+            { 0, static_cast<int32_t>(row), 0 },
+            { width, rows, 1 });
+        get_command_buffer().copyBufferToImage(alloc.buffer, image, vk::ImageLayout::eTransferDstOptimal, 1, &region);
+    }
+
+    //earlier chunks went out on the same transfer queue, so the image only changes
+    //hands once all of it has been written
+    release_image(image, vk::ImageLayout::eTransferDstOptimal, aspect);
+
+    return current_ticket();
+}
+
+UploadTicket UploadQueue::flush() {
+    if (!recording) {
+        return next_ticket - 1;
+    }
+
+    //make the copies visible to everything that reads them later in submission order
+    vk::MemoryBarrier barrier(
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead |
+        vk::AccessFlagBits::eUniformRead | vk::AccessFlagBits::eShaderRead);
+    vk::PipelineStageFlags consumer_stages =
+        vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+
+    if (dedicated) {
+        if (!buffer_releases.empty() || !image_releases.empty()) {
+            current.command_buffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eTransfer,
+                vk::PipelineStageFlagBits::eBottomOfPipe,
+                {},
+                0, nullptr,
+                static_cast<uint32_t>(buffer_releases.size()), buffer_releases.data(),
+                static_cast<uint32_t>(image_releases.size()), image_releases.data());
+            buffer_releases.clear();
+            image_releases.clear();
+        }
+        current.command_buffer.end();
+
+        auto graphics_command_buffer = get_graphics_command_buffer();
+        graphics_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, consumer_stages, {}, 1, &barrier, 0, nullptr, 0, nullptr);
+        graphics_command_buffer.end();
+        recording_graphics = false;
+
+        current.transfer_fence = get_fence();
+
+        vk::SubmitInfo submit_info;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &current.command_buffer;
+        context.transfer_queue.submit(1, &submit_info, current.transfer_fence);
+    }
+    else {
+        current.command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, consumer_stages, {}, 1, &barrier, 0, nullptr, 0, nullptr);
+        current.command_buffer.end();
+
+        current.fence = get_fence();
+
+        vk::SubmitInfo submit_info;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &current.command_buffer;
+        context.graphics_queue.submit(1, &submit_info, current.fence);
+
+        current.graphics_submitted = true;
+        ready_ticket = current.ticket;
+    }
+
+    UploadTicket ticket = current.ticket;
+    current.staging_end = staging_head;
+    in_flight.push_back(std::move(current));
+    current = Batch{};
+    recording = false;
+    next_ticket++;
+
+    return ticket;
+}
+
+void UploadQueue::submit_graphics(Batch& batch) {
+    //the transfer side is done, so the acquires in here don't make the graphics queue wait
+    batch.fence = get_fence();
+
+    vk::SubmitInfo submit_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch.graphics_command_buffer;
+    context.graphics_queue.submit(1, &submit_info, batch.fence);
+
+    batch.graphics_submitted = true;
+    ready_ticket = batch.ticket;
+}
+
+bool UploadQueue::is_ready(UploadTicket ticket) {
+    if (ticket <= ready_ticket) {
+        return true;
+    }
+    collect();
+    return ticket <= ready_ticket;
+}
+
+bool UploadQueue::is_complete(UploadTicket ticket) {
+    if (ticket <= completed_ticket) {
+        return true;
+    }
+    collect();
+    return ticket <= completed_ticket;
+}
+
+void UploadQueue::wait(UploadTicket ticket) {
+    if (recording && ticket >= current.ticket) {
+        flush();
+    }
+
+    //batches complete in submission order, so waiting on the ticket's own fences is enough
+    for (auto& batch : in_flight) {
+        if (batch.ticket == ticket) {
+            if (!batch.graphics_submitted) {
+                context.device.waitForFences(1, &batch.transfer_fence, VK_TRUE, UINT64_MAX);
+                collect();
+            }
+            break;
+        }
+    }
+    for (auto& batch : in_flight) {
+        if (batch.ticket == ticket) {
+            context.device.waitForFences(1, &batch.fence, VK_TRUE, UINT64_MAX);
+            break;
+        }
+    }
+    collect();
+}
+
+void UploadQueue::collect() {
+    //hand finished transfers over to the graphics queue, in order
+    for (auto& batch : in_flight) {
+        if (batch.graphics_submitted) {
+            continue;
+        }
+        if (context.device.getFenceStatus(batch.transfer_fence) != vk::Result::eSuccess) {
+            break;
+        }
+
+        release_staging(batch);
+        context.device.resetFences(1, &batch.transfer_fence);
+        free_fences.push_back(batch.transfer_fence);
+        batch.transfer_fence = nullptr;
+        batch.command_buffer.reset({});
+        free_command_buffers.push_back(batch.command_buffer);
+        batch.command_buffer = nullptr;
+
+        submit_graphics(batch);
+    }
+
+    while (!in_flight.empty()) {
+        auto& batch = in_flight.front();
+        if (!batch.graphics_submitted || context.device.getFenceStatus(batch.fence) != vk::Result::eSuccess) {
+            break;
+        }
+
+        release_staging(batch);
+        context.device.resetFences(1, &batch.fence);
+        free_fences.push_back(batch.fence);
+        if (batch.command_buffer != vk::CommandBuffer(nullptr)) {
+            batch.command_buffer.reset({});
+            free_command_buffers.push_back(batch.command_buffer);
+        }
+        if (batch.graphics_command_buffer != vk::CommandBuffer(nullptr)) {
+            batch.graphics_command_buffer.reset({});
+            free_graphics_command_buffers.push_back(batch.graphics_command_buffer);
+        }
+
+        completed_ticket = batch.ticket;
+        in_flight.pop_front();
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "context.h"
+#include "buffer.h"
+
+#include <deque>
+
+typedef uint64_t UploadTicket;
+
+struct StagingAllocation {
+    vk::Buffer buffer;
+    vk::DeviceSize offset;
+    vk::DeviceSize size;
+    void* data;
+};
+
+//records buffer/image copies and layout transitions from many resources into one
+//command buffer and submits them together with a fence. callers get a ticket for
+//the batch their commands went into and can poll or wait on it.
+//staging memory comes from one persistently mapped ring that is recycled as batches
+//complete, large uploads are split into chunks so the ring never has to grow.
+//
+//when the device has a transfer-only queue family the copies run there, alongside
+//rendering. written resources are released to the graphics family and each batch has
+//a second command buffer on the graphics queue that acquires them and does the work
+//the transfer queue can't (mipmap blits, shader layout transitions). that command
+//buffer is only submitted once the transfer fence has signalled, so the graphics
+//queue never stalls waiting on an upload
+class UploadQueue {
+public:
+    static constexpr vk::DeviceSize STAGING_SIZE = 32 * 1024 * 1024;
+    static constexpr vk::DeviceSize MAX_CHUNK_SIZE = STAGING_SIZE / 4;
+
+    UploadQueue(Context& ctx) : context(ctx), staging(ctx) {}
+    UploadQueue(const UploadQueue& other) = delete;
+
+    void init();
+    void close();
+
+    bool is_dedicated() const {
+        return dedicated;
+    }
+
+    //transfer queue command buffer of the batch being recorded, begun on first use.
+    //upload_buffer/upload_image may submit the batch to free staging space, so don't
+    //hold on to the command buffer across those calls
+    vk::CommandBuffer get_command_buffer();
+    //graphics queue command buffer of the same batch, runs after everything released in
+    //the batch has been acquired. same as get_command_buffer() without a transfer queue
+    vk::CommandBuffer get_graphics_command_buffer();
+    //ticket of the batch currently being recorded
+    UploadTicket current_ticket() const {
+        return next_ticket;
+    }
+
+    //copy size bytes from data into dest and release the range to the graphics family.
+    //returns the ticket of the batch with the last chunk
+    UploadTicket upload_buffer(const void* data, vk::DeviceSize size, vk::Buffer dest, vk::DeviceSize dest_offset);
+    //copy tightly packed pixels into mip 0 of an image already in TransferDstOptimal and
+    //release the image to the graphics family, still in TransferDstOptimal
+    UploadTicket upload_image(const void* pixels, uint32_t width, uint32_t height, uint32_t texel_size, vk::Image image, vk::ImageAspectFlags aspect);
+
+    //hand resources written by the transfer command buffer over to the graphics family.
+    //nothing to do without a dedicated transfer queue
+    void release_buffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size);
+    void release_image(vk::Image image, vk::ImageLayout layout, vk::ImageAspectFlags aspect);
+
+    //submits the batch being recorded, if any, and returns its ticket
+    UploadTicket flush();
+    //the graphics side of the batch has been submitted, so anything submitted to the
+    //graphics queue from now on sees the uploaded data
+    bool is_ready(UploadTicket ticket);
+    //the whole batch has finished executing
+    bool is_complete(UploadTicket ticket);
+    void wait(UploadTicket ticket);
+    //submits the graphics side of batches whose transfers have finished and recycles
+    //command buffers, fences and staging space of completed batches
+    void collect();
+
+private:
+    struct Batch {
+        UploadTicket ticket = 0;
+        vk::CommandBuffer command_buffer = nullptr;
+        //only used with a dedicated transfer queue
+        vk::CommandBuffer graphics_command_buffer = nullptr;
+        vk::Fence transfer_fence = nullptr;
+        //signalled when the last submit of the batch has finished
+        vk::Fence fence = nullptr;
+        bool graphics_submitted = false;
+        //staging ring bytes owned by this batch (including any wrap-around padding)
+        //and where the ring head was when it was submitted
+        vk::DeviceSize staging_bytes = 0;
+        vk::DeviceSize staging_end = 0;
+    };
+
+    Context& context;
+    bool dedicated = false;
+    uint32_t transfer_family = 0;
+    uint32_t graphics_family = 0;
+    vk::CommandPool command_pool = nullptr;
+    vk::CommandPool graphics_command_pool = nullptr;
+
+    bool recording = false;
+    bool recording_graphics = false;
+    Batch current;
+    std::deque<Batch> in_flight;
+    std::vector<vk::CommandBuffer> free_command_buffers;
+    std::vector<vk::CommandBuffer> free_graphics_command_buffers;
+    std::vector<vk::Fence> free_fences;
+    std::vector<vk::BufferMemoryBarrier> buffer_releases;
+    std::vector<vk::ImageMemoryBarrier> image_releases;
+
+    Buffer staging;
+    vk::DeviceSize staging_head = 0;
+    vk::DeviceSize staging_tail = 0;
+    vk::DeviceSize staging_in_use = 0;
+
+    UploadTicket next_ticket = 1;
+    UploadTicket ready_ticket = 0;
+    UploadTicket completed_ticket = 0;
+
+    StagingAllocation allocate_staging(vk::DeviceSize size);
+    bool try_allocate_staging(vk::DeviceSize size, vk::DeviceSize& offset);
+    void release_staging(Batch& batch);
+    vk::Fence get_fence();
+    vk::CommandBuffer get_free_command_buffer(vk::CommandPool pool, std::vector<vk::CommandBuffer>& free_list);
+    void submit_graphics(Batch& batch);
+};
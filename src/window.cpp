@@ -36,6 +36,10 @@ void Window::poll_events() {
     glfwPollEvents();
 }
 
+bool Window::is_key_down(int key) {
+    return glfwGetKey(window, key) == GLFW_PRESS;
+}
+
 void Window::on_framebuffer_resized(int w, int h) {
     TRACE("framebuffer resized" << w << "x" << h)
     context.framebuffer_resized = true;
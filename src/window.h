@@ -16,6 +16,8 @@ class Window {
 
         bool should_close();
         void poll_events();
+        //GLFW_KEY_* held down as of the last poll_events
+        bool is_key_down(int key);
         void create_surface();
 
         void on_framebuffer_resized(int w, int h);
@@ -0,0 +1,83 @@
+#include "worker_pool.h"
+#include "log.h"
+
+void WorkerPool::init(uint32_t thread_count) {
+    TRACE("starting " << thread_count << " worker threads")
+    stopping = false;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(&WorkerPool::worker_loop, this);
+    }
+}
+
+void WorkerPool::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+void WorkerPool::parallel_for(uint32_t count, const std::function<void(uint32_t)>& job) {
+    if (count == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    current_job = &job;
+    job_count = count;
+    next_job = 0;
+    finished_jobs = 0;
+    error = nullptr;
+    work_ready.notify_all();
+
+    run_jobs(lock);
+    work_done.wait(lock, [this] { return finished_jobs == job_count; });
+
+    current_job = nullptr;
+    job_count = 0;
+    next_job = 0;
+    if (error) {
+        auto rethrown = error;
+        error = nullptr;
+        std::rethrow_exception(rethrown);
+    }
+}
+
+void WorkerPool::run_jobs(std::unique_lock<std::mutex>& lock) {
+    while (next_job < job_count) {
+        uint32_t index = next_job++;
+        auto job = current_job;
+        lock.unlock();
+
+        std::exception_ptr job_error;
+        try {
+            (*job)(index);
+        }
+        catch (...) {
+            job_error = std::current_exception();
+        }
+
+        lock.lock();
+        if (job_error && !error) {
+            error = job_error;
+        }
+        if (++finished_jobs == job_count) {
+            work_done.notify_all();
+        }
+    }
+}
+
+void WorkerPool::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [this] { return stopping || next_job < job_count; });
+        if (stopping) {
+            return;
+        }
+        run_jobs(lock);
+    }
+}
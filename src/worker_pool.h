@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//fixed set of threads that run the jobs of one parallel_for at a time. the calling thread
+//takes jobs too, so a pool of n threads runs up to n + 1 jobs at once
+class WorkerPool {
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool& other) = delete;
+    ~WorkerPool() {
+        close();
+    }
+
+    void init(uint32_t thread_count);
+    void close();
+
+    //threads including the caller's
+    uint32_t get_concurrency() const {
+        return static_cast<uint32_t>(threads.size()) + 1;
+    }
+
+    //calls job(index) for every index below count and returns once all of them have finished.
+    //the first exception thrown by a job is rethrown here. jobs must not call parallel_for
+    void parallel_for(uint32_t count, const std::function<void(uint32_t)>& job);
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    bool stopping = false;
+
+    const std::function<void(uint32_t)>* current_job = nullptr;
+    uint32_t job_count = 0;
+    uint32_t next_job = 0;
+    uint32_t finished_jobs = 0;
+    std::exception_ptr error;
+
+    void worker_loop();
+    //runs jobs until none are left to take, lock is held on entry and exit
+    void run_jobs(std::unique_lock<std::mutex>& lock);
+};
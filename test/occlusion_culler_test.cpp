@@ -0,0 +1,153 @@
+#include "occlusion_culler.h"
+#include "worker_pool.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+//headless checks of the software occlusion path, no window or gpu. a quad facing the camera
+//has to hide a box behind it and keep one in front of it, then a grid of boxes behind a
+//wall is timed. build with -mavx to run the avx path instead of sse
+
+namespace {
+    //the square -1..1 on x and y at z = 0
+    const std::vector<glm::vec3> QUAD_POSITIONS{
+        glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f),
+        glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f)
+    };
+    const std::vector<uint32_t> QUAD_INDICES{ 0, 1, 2, 2, 3, 0 };
+
+    //set up like Camera::projection, 0..1 depth and y flipped
+    glm::mat4 camera_view_projection() {
+        glm::mat4 projection = glm::perspectiveRH_ZO(glm::radians(60.0f), 1.0f, 0.1f, 100.0f);
+        projection[1][1] *= -1;
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        return projection * view;
+    }
+
+    Bounds make_box(const glm::vec3& center, float half) {
+        Bounds bounds;
+        bounds.min = center - glm::vec3(half);
+        bounds.max = center + glm::vec3(half);
+        bounds.sphere = glm::vec4(center, half * 1.7320508f);
+        return bounds;
+    }
+
+    bool contains(const std::vector<uint32_t>& indices, uint32_t index) {
+        for (auto i : indices) {
+            if (i == index) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        std::cout << (condition ? "ok     " : "FAILED ") << what << std::endl;
+        if (!condition) {
+            failures++;
+        }
+    }
+
+    void test_quad_occluder(WorkerPool& workers) {
+        auto view_projection = camera_view_projection();
+        auto frustum = Frustum::from_matrix(view_projection);
+
+        //a wall 4 units wide at the origin, the camera looks at it from z = 5
+        glm::mat4 wall = glm::scale(glm::mat4(1.0f), glm::vec3(2.0f));
+        const uint32_t BEHIND = 0;
+        const uint32_t IN_FRONT = 1;
+        const uint32_t BESIDE = 2;
+        FrustumCuller boxes;
+        boxes.resize(3);
+        boxes.set_bounds(BEHIND, make_box(glm::vec3(0.0f, 0.0f, -3.0f), 0.5f), glm::mat4(1.0f));
+        boxes.set_bounds(IN_FRONT, make_box(glm::vec3(0.0f, 0.0f, 2.0f), 0.5f), glm::mat4(1.0f));
+        //behind the wall's plane but outside it on screen
+        boxes.set_bounds(BESIDE, make_box(glm::vec3(4.5f, 0.0f, -3.0f), 0.5f), glm::mat4(1.0f));
+
+        std::vector<uint32_t> visible;
+        boxes.cull(frustum, visible);
+        check(visible.size() == 3, "every box is inside the frustum");
+
+        OcclusionCuller culler;
+        culler.init(320, 192);
+        culler.begin(view_projection);
+        culler.add_occluder(wall, QUAD_POSITIONS.data(), sizeof(glm::vec3), static_cast<uint32_t>(QUAD_POSITIONS.size()),
+            QUAD_INDICES.data(), static_cast<uint32_t>(QUAD_INDICES.size()));
+        check(culler.has_occluders(), "the quad is rasterized");
+        culler.rasterize(workers);
+        culler.cull(workers, boxes, visible);
+
+        check(!contains(visible, BEHIND), "the box behind the quad is hidden");
+        check(contains(visible, IN_FRONT), "the box in front of the quad is kept");
+        check(contains(visible, BESIDE), "the box beside the quad is kept");
+        check(culler.get_stats().occluded == 1, "exactly one box is counted as occluded");
+
+        //without occluders nothing is hidden
+        culler.begin(view_projection);
+        culler.rasterize(workers);
+        boxes.cull(frustum, visible);
+        culler.cull(workers, boxes, visible);
+        check(visible.size() == 3, "an empty depth buffer hides nothing");
+    }
+
+    void benchmark(WorkerPool& workers) {
+        const uint32_t SIDE = 100;
+        const uint32_t FRAMES = 100;
+        auto view_projection = camera_view_projection();
+        auto frustum = Frustum::from_matrix(view_projection);
+
+        //a wall covering the whole view with a grid of small boxes behind it
+        glm::mat4 wall = glm::scale(glm::mat4(1.0f), glm::vec3(20.0f));
+        FrustumCuller boxes;
+        boxes.resize(SIDE * SIDE);
+        for (uint32_t y = 0; y < SIDE; y++) {
+            for (uint32_t x = 0; x < SIDE; x++) {
+                glm::vec3 center(x * 0.05f - 2.5f, y * 0.05f - 2.5f, -3.0f);
+                boxes.set_bounds(y * SIDE + x, make_box(center, 0.02f), glm::mat4(1.0f));
+            }
+        }
+
+        OcclusionCuller culler;
+        culler.init(320, 192);
+        std::vector<uint32_t> visible;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < FRAMES; frame++) {
+            boxes.cull(frustum, visible);
+            culler.begin(view_projection);
+            culler.add_occluder(wall, QUAD_POSITIONS.data(), sizeof(glm::vec3), static_cast<uint32_t>(QUAD_POSITIONS.size()),
+                QUAD_INDICES.data(), static_cast<uint32_t>(QUAD_INDICES.size()));
+            culler.rasterize(workers);
+            culler.cull(workers, boxes, visible);
+        }
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        check(visible.empty(), "the wall hides the whole grid");
+        culler.get_stats().print();
+        std::cout << SIDE * SIDE << " boxes, " << elapsed / FRAMES << " ms per frame" << std::endl;
+    }
+}
+
+int main() {
+#if defined(__AVX__)
+    std::cout << "avx path" << std::endl;
+#else
+    std::cout << "sse or scalar path" << std::endl;
+#endif
+    WorkerPool workers;
+    workers.init(3);
+    test_quad_occluder(workers);
+    benchmark(workers);
+    workers.close();
+
+    if (failures > 0) {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
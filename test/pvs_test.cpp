@@ -0,0 +1,97 @@
+#include "model.h"
+#include "pvs.h"
+#include "worker_pool.h"
+
+#include <iostream>
+#include <vector>
+
+//headless checks of the pvs bake, no window or gpu. a wall with a small opening stands
+//between a viewer and a large panel, only a sliver of the panel shows through the opening
+//and it has to stay visible from in front of the wall
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char* what) {
+        std::cout << (condition ? "ok     " : "FAILED ") << what << std::endl;
+        if (!condition) {
+            failures++;
+        }
+    }
+
+    //two triangles per axis aligned rectangle, corners given in order around it
+    void add_rectangle(Mesh& mesh, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d) {
+        auto first = static_cast<uint32_t>(mesh.vertices.size());
+        for (const auto& position : { a, b, c, d }) {
+            Vertex vertex{};
+            vertex.pos = position;
+            mesh.vertices.push_back(vertex);
+        }
+        for (uint32_t index : { 0u, 1u, 2u, 2u, 3u, 0u }) {
+            mesh.indices.push_back(first + index);
+        }
+    }
+
+    void add_node(Model& model, const std::string& name, Mesh mesh) {
+        mesh.bounds = calculate_bounds(mesh);
+        model.meshes[name] = std::move(mesh);
+        SceneNode node;
+        node.mesh = name;
+        node.name = name;
+        model.nodes[name] = node;
+    }
+
+    //the wall is 20 units across at z = 0 with a 2 unit hole in the middle, the panel
+    //20 units across at z = -4 behind it and a floor runs from the panel to z = 8 so the
+    //grid reaches in front of the wall
+    void build_scene(Model& model) {
+        Mesh wall;
+        add_rectangle(wall, glm::vec3(-10, -10, 0), glm::vec3(10, -10, 0), glm::vec3(10, -1, 0), glm::vec3(-10, -1, 0));
+        add_rectangle(wall, glm::vec3(-10, 1, 0), glm::vec3(10, 1, 0), glm::vec3(10, 10, 0), glm::vec3(-10, 10, 0));
+        add_rectangle(wall, glm::vec3(-10, -1, 0), glm::vec3(-1, -1, 0), glm::vec3(-1, 1, 0), glm::vec3(-10, 1, 0));
+        add_rectangle(wall, glm::vec3(1, -1, 0), glm::vec3(10, -1, 0), glm::vec3(10, 1, 0), glm::vec3(1, 1, 0));
+        add_node(model, "wall", std::move(wall));
+
+        Mesh panel;
+        add_rectangle(panel, glm::vec3(-10, -10, -4), glm::vec3(10, -10, -4), glm::vec3(10, 10, -4), glm::vec3(-10, 10, -4));
+        add_node(model, "panel", std::move(panel));
+
+        Mesh floor;
+        add_rectangle(floor, glm::vec3(-10, -10, -4), glm::vec3(10, -10, -4), glm::vec3(10, -10, 8), glm::vec3(-10, -10, 8));
+        add_node(model, "floor", std::move(floor));
+    }
+
+    bool visible_from(const PotentiallyVisibleSet& pvs, const glm::vec3& position, const std::string& node) {
+        auto cell = pvs.get_cell(position);
+        if (cell == PotentiallyVisibleSet::NO_CELL) {
+            return true;
+        }
+        std::vector<uint8_t> bits;
+        pvs.decompress(cell, bits);
+        return PotentiallyVisibleSet::is_visible(bits, pvs.get_node_index(node));
+    }
+}
+
+int main() {
+    WorkerPool workers;
+    workers.init(3);
+
+    Model model;
+    build_scene(model);
+    auto pvs = PotentiallyVisibleSet::bake(model, workers);
+    check(pvs->get_node_count() == 3, "every mesh node is in the set");
+    check(pvs->get_cell(glm::vec3(0.5f, 0.5f, 6.0f)) != PotentiallyVisibleSet::NO_CELL, "the viewer is inside the grid");
+    check(visible_from(*pvs, glm::vec3(0.5f, 0.5f, 6.0f), "panel"), "the panel shows through the opening");
+    check(visible_from(*pvs, glm::vec3(0.5f, 0.5f, 6.0f), "wall"), "the wall is visible");
+    check(visible_from(*pvs, glm::vec3(0.5f, 0.5f, -2.0f), "panel"), "the panel is visible behind the wall");
+    check(pvs->matches(model), "the bake matches its model");
+
+    workers.close();
+
+    if (failures > 0) {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}